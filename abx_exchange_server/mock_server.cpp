@@ -0,0 +1,443 @@
+// Native stand-in for main.js, for load and latency testing.
+//
+// main.js only knows its 14 hard-coded packets and drops them with Math.random(), which is fine for
+// checking the client works but useless for seeing how it behaves with millions of packets. This one
+// speaks the same protocol and makes up as many packets as you like:
+//
+//   * Call Type 1 (Stream All Packets): streams sequences 1..N, leaving out a deterministic subset
+//     (the last packet is never dropped, same promise as the real server). The request can be the
+//     1 byte the spec describes or the 2 bytes main.js reads - a trailing second byte is ignored.
+//   * Call Type 2 (Resend Packet): 2 bytes, the sequence read as an Int8 just like main.js does.
+//     The connection stays open for more requests until the client closes it.
+//   * Call Types 3-5, which main.js doesn't have (see resend_protocol.h): a capabilities byte, a
+//     resend with a 4-byte sequence, and a resend of a whole range. --legacy-only turns them off, and
+//     Call Type 3 then goes unanswered (the connection stays usable) just like main.js would leave it.
+//
+// Every packet's contents depend only on (seed, sequence), so a resent packet is always identical to
+// the one the stream would have sent and two runs with the same seed produce the same output.json.
+//
+// Build from the repo root:
+//     g++ -O2 -std=c++17 -pthread abx_exchange_server/mock_server.cpp -o mock_server
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <cstring>  // strerror
+#include <cerrno>
+#include <cstdlib>  // strtol, strtod, strtoull
+#include <cstdint>
+#include <csignal>
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>    // TCP_NODELAY
+#include <unistd.h>
+
+#include "../packet.h"      // Packet, PACKET_SIZE, encode_packet()
+#include "../resend_protocol.h" // Call types 3-5 and get_be32()
+
+struct ServerOptions {
+    int port = 3000;
+    size_t packet_count = 14;
+    size_t symbol_count = 4;
+    double drop_rate = 0.25;      // Same ballpark as main.js
+    uint64_t seed = 1;
+    int latency_us = 0;           // Delay before answering any request
+    size_t chunk_bytes = 16 * 1024; // The stream goes out in send() calls of this size...
+    int chunk_delay_us = 0;       // ...with this pause between them
+    bool legacy_only = false;     // Only Call Types 1 and 2, like main.js
+    bool show_help = false;
+};
+
+void print_usage(const char* program) {
+    std::cout << "Usage: " << program << " [options]\n"
+              << "  --port N            Port to listen on (default 3000)\n"
+              << "  --packets N         Sequences 1..N in the stream (default 14)\n"
+              << "  --symbols N         Size of the symbol universe (default 4)\n"
+              << "  --drop-rate R       Fraction of packets left out of the stream, 0..1 (default 0.25)\n"
+              << "  --seed N            Seed for packet contents and drops (default 1)\n"
+              << "  --latency-us N      Delay before answering each request (default 0)\n"
+              << "  --chunk-bytes N     Bytes per send() while streaming (default 16384)\n"
+              << "  --chunk-delay-us N  Pause between stream chunks (default 0)\n"
+              << "  --legacy-only       Don't answer the extended resend call types (3-5), like main.js\n"
+              << "  --help              Show this message" << std::endl;
+}
+
+// Returns false if the arguments don't make sense (usage has already been printed by then).
+bool parse_options(int argc, char** argv, ServerOptions& options) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--help") {
+            options.show_help = true;
+            continue;
+        }
+        if (arg == "--legacy-only") {
+            options.legacy_only = true;
+            continue;
+        }
+        if (i + 1 >= argc) {
+            print_usage(argv[0]);
+            return false;
+        }
+        const char* value = argv[++i];
+        char* end = nullptr;
+        if (arg == "--port") {
+            options.port = static_cast<int>(std::strtol(value, &end, 10));
+        } else if (arg == "--packets") {
+            options.packet_count = static_cast<size_t>(std::strtoull(value, &end, 10));
+        } else if (arg == "--symbols") {
+            options.symbol_count = static_cast<size_t>(std::strtoull(value, &end, 10));
+        } else if (arg == "--drop-rate") {
+            options.drop_rate = std::strtod(value, &end);
+        } else if (arg == "--seed") {
+            options.seed = std::strtoull(value, &end, 10);
+        } else if (arg == "--latency-us") {
+            options.latency_us = static_cast<int>(std::strtol(value, &end, 10));
+        } else if (arg == "--chunk-bytes") {
+            options.chunk_bytes = static_cast<size_t>(std::strtoull(value, &end, 10));
+        } else if (arg == "--chunk-delay-us") {
+            options.chunk_delay_us = static_cast<int>(std::strtol(value, &end, 10));
+        } else {
+            print_usage(argv[0]);
+            return false;
+        }
+        // The whole value has to be the number: "1e6" packets or a "5%" drop rate is a typo, not 1 or 5.
+        if (end == value || *end != '\0') {
+            std::cerr << arg << " needs a number, not \"" << value << "\"." << std::endl;
+            print_usage(argv[0]);
+            return false;
+        }
+    }
+    if (options.port < 1 || options.port > 65535 || options.packet_count < 1 ||
+        options.packet_count > static_cast<size_t>(INT32_MAX) || options.symbol_count < 1 ||
+        options.drop_rate < 0.0 || options.drop_rate > 1.0 || options.chunk_bytes < 1 ||
+        options.latency_us < 0 || options.chunk_delay_us < 0) {
+        std::cerr << "Option out of range." << std::endl;
+        print_usage(argv[0]);
+        return false;
+    }
+    return true;
+}
+
+// Makes up packets from (seed, sequence) alone, so any packet can be produced at any time.
+class PacketSource {
+public:
+    explicit PacketSource(const ServerOptions& options)
+        : seed_(options.seed),
+          count_(static_cast<int32_t>(options.packet_count)),
+          // Compare against the top 32 bits of a hash instead of calling into floating point per packet.
+          drop_threshold_(static_cast<uint64_t>(options.drop_rate * 4294967296.0)) {
+        // The familiar names first, then made-up 4-letter ones. A few short ones get padded with
+        // spaces so the client's symbol trimming gets exercised too.
+        static const char* known[] = {"MSFT", "AAPL", "AMZN", "META", "GOOG", "NVDA", "TSLA", "IBM ", "GE  ", "F   "};
+        const size_t known_count = sizeof(known) / sizeof(known[0]);
+        for (size_t i = 0; i < options.symbol_count; ++i) {
+            if (i < known_count) {
+                symbols_.push_back(symbol_code(known[i]));
+                continue;
+            }
+            char name[4];
+            size_t n = i - known_count;
+            for (int k = 3; k >= 0; --k) {
+                name[k] = static_cast<char>('A' + n % 26);
+                n /= 26;
+            }
+            symbols_.push_back(symbol_code(name));
+        }
+    }
+
+    int32_t count() const { return count_; }
+
+    Packet packet(int32_t sequence) const {
+        uint64_t h = mix(seed_ ^ (static_cast<uint64_t>(sequence) * 0x9E3779B97F4A7C15ull));
+        Packet packet = {};
+        packet.symbol = symbols_[h % symbols_.size()];
+        packet.buysell_indicator = (h >> 20) & 1 ? 'S' : 'B';
+        packet.quantity = static_cast<int32_t>(1 + (h >> 21) % 1000);
+        packet.price = static_cast<int32_t>(10 + (h >> 31) % 10000);
+        packet.sequence = sequence;
+        return packet;
+    }
+
+    // Whether the stream leaves this one out. Independent of the packet's contents, so changing the
+    // drop rate doesn't change what the packets look like.
+    bool dropped(int32_t sequence) const {
+        if (sequence == count_) {
+            return false; // The last packet always makes it, like the spec says
+        }
+        uint64_t h = mix(~seed_ ^ (static_cast<uint64_t>(sequence) * 0xC2B2AE3D27D4EB4Full));
+        return (h >> 32) < drop_threshold_;
+    }
+
+private:
+    // splitmix64 finaliser: cheap and scrambles well enough for test data.
+    static uint64_t mix(uint64_t x) {
+        x ^= x >> 30;
+        x *= 0xBF58476D1CE4E5B9ull;
+        x ^= x >> 27;
+        x *= 0x94D049BB133111EBull;
+        x ^= x >> 31;
+        return x;
+    }
+
+    uint64_t seed_;
+    int32_t count_;
+    uint64_t drop_threshold_;
+    std::vector<uint32_t> symbols_;
+};
+
+void pause_us(int microseconds) {
+    if (microseconds > 0) {
+        std::this_thread::sleep_for(std::chrono::microseconds(microseconds));
+    }
+}
+
+bool send_all(int fd, const unsigned char* data, size_t size) {
+    while (size > 0) {
+        ssize_t sent = send(fd, data, size, MSG_NOSIGNAL);
+        if (sent < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        data += sent;
+        size -= static_cast<size_t>(sent);
+    }
+    return true;
+}
+
+// Each connection's request bytes. recv() takes whatever has arrived into a buffer and whole frames
+// come out of it, so a client batching a hundred resends costs a handful of recv() calls, not one per
+// byte; a frame split across segments just waits in the buffer for the rest.
+class RequestReader {
+public:
+    explicit RequestReader(int fd) : fd_(fd) {}
+
+    // Points `frame` at the next `size` bytes (size <= CAPACITY), receiving more only if they aren't
+    // buffered yet. The bytes stay valid until the next call. False on EOF or error.
+    bool take(size_t size, const unsigned char*& frame) {
+        if (end_ - start_ < size) {
+            std::memmove(buffer_, buffer_ + start_, end_ - start_);
+            end_ -= start_;
+            start_ = 0;
+            while (end_ < size) {
+                ssize_t got = recv(fd_, buffer_ + end_, CAPACITY - end_, 0);
+                if (got < 0 && errno == EINTR) {
+                    continue;
+                }
+                if (got <= 0) {
+                    return false;
+                }
+                end_ += static_cast<size_t>(got);
+            }
+        }
+        frame = buffer_ + start_;
+        start_ += size;
+        return true;
+    }
+
+    static const size_t CAPACITY = 4096;
+
+private:
+    int fd_;
+    unsigned char buffer_[CAPACITY];
+    size_t start_ = 0;
+    size_t end_ = 0;
+};
+
+// How many bytes a request starting with `call_type` takes, call type included; 0 if we don't speak
+// it. Call Type 1 counts as 1: the optional second byte is left for stream_all's drain to swallow.
+size_t request_size(unsigned char call_type, bool legacy_only) {
+    switch (call_type) {
+    case 1:
+        return 1;
+    case CALL_TYPE_RESEND:
+    case CALL_TYPE_CAPABILITIES:
+        return 2;
+    case CALL_TYPE_WIDE_RESEND:
+        return legacy_only ? 0 : 5;
+    case CALL_TYPE_RANGE_RESEND:
+        return legacy_only ? 0 : MAX_RESEND_REQUEST_SIZE;
+    default:
+        return 0;
+    }
+}
+
+void stream_all(int fd, const ServerOptions& options, const PacketSource& source) {
+    auto started = std::chrono::steady_clock::now();
+    pause_us(options.latency_us);
+    // Round the chunk down to whole packets so the client sees bursts that end on a boundary unless
+    // the chunk is smaller than a packet - then it gets to deal with split packets.
+    size_t chunk = options.chunk_bytes >= PACKET_SIZE ? options.chunk_bytes / PACKET_SIZE * PACKET_SIZE : options.chunk_bytes;
+    std::vector<unsigned char> buffer(PACKET_SIZE * (chunk / PACKET_SIZE + 1));
+    size_t used = 0;
+    size_t sent_packets = 0;
+    bool ok = true;
+    for (int32_t sequence = 1; ok && sequence <= source.count(); ++sequence) {
+        if (source.dropped(sequence)) {
+            continue;
+        }
+        encode_packet(source.packet(sequence), buffer.data() + used);
+        used += PACKET_SIZE;
+        ++sent_packets;
+        // Ship every full chunk; whatever's left over waits for the next packet.
+        size_t shipped = 0;
+        while (ok && used - shipped >= chunk) {
+            ok = send_all(fd, buffer.data() + shipped, chunk);
+            shipped += chunk;
+            pause_us(options.chunk_delay_us);
+        }
+        if (shipped > 0) {
+            std::memmove(buffer.data(), buffer.data() + shipped, used - shipped);
+            used -= shipped;
+        }
+    }
+    if (ok && used > 0) {
+        ok = send_all(fd, buffer.data(), used);
+    }
+
+    // Hang up our side but keep reading until the client closes: closing with its trailing request
+    // byte still unread would make the kernel send a RST, which can throw away data in flight.
+    shutdown(fd, SHUT_WR);
+    timeval linger_timeout = {2, 0};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &linger_timeout, sizeof(linger_timeout));
+    unsigned char ignored[64];
+    while (recv(fd, ignored, sizeof(ignored), 0) > 0) {
+    }
+
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - started).count();
+    std::cout << "Streamed " << sent_packets << " of " << source.count() << " packets in " << ms << " ms"
+              << (ok ? "" : " (client went away early)") << "." << std::endl;
+}
+
+// Sends sequences first..last, in order, nothing dropped.
+bool send_range(int fd, const PacketSource& source, int32_t first, int32_t last) {
+    unsigned char wire[64 * PACKET_SIZE];
+    size_t used = 0;
+    for (int32_t sequence = first; sequence <= last; ++sequence) {
+        encode_packet(source.packet(sequence), wire + used);
+        used += PACKET_SIZE;
+        if (used == sizeof(wire) || sequence == last) {
+            if (!send_all(fd, wire, used)) {
+                return false;
+            }
+            used = 0;
+        }
+    }
+    return true;
+}
+
+void handle_client(int fd, const ServerOptions& options, const PacketSource& source) {
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    RequestReader reader(fd);
+    const unsigned char* call_type;
+    while (reader.take(1, call_type)) {
+        size_t size = request_size(*call_type, options.legacy_only);
+        if (size == 0) {
+            std::cerr << "Unknown call type " << static_cast<int>(*call_type) << ", dropping the connection." << std::endl;
+            break;
+        }
+        if (*call_type == 1) {
+            stream_all(fd, options, source);
+            break;
+        }
+        unsigned char type = *call_type;
+        const unsigned char* body;
+        if (!reader.take(size - 1, body)) {
+            break;
+        }
+
+        if (type == CALL_TYPE_CAPABILITIES) {
+            // main.js skips 2-byte frames it doesn't know without a word; the client has to time out.
+            if (options.legacy_only) {
+                continue;
+            }
+            unsigned char capabilities = CAP_WIDE_RESEND | CAP_RANGE_RESEND;
+            if (!send_all(fd, &capabilities, 1)) {
+                break;
+            }
+            continue;
+        }
+
+        int32_t first;
+        int32_t last;
+        if (type == CALL_TYPE_RESEND) {
+            first = last = static_cast<int8_t>(body[0]); // readInt8, same as main.js
+        } else if (type == CALL_TYPE_WIDE_RESEND) {
+            first = last = get_be32(body);
+        } else {
+            first = get_be32(body);
+            last = get_be32(body + 4);
+        }
+        if (first < 1 || last > source.count() || first > last || last - first >= MAX_RANGE_PACKETS) {
+            std::cerr << "Resend asked for seq " << first;
+            if (last != first) {
+                std::cerr << "-" << last;
+            }
+            std::cerr << ", which doesn't exist. Dropping the connection." << std::endl;
+            break;
+        }
+        pause_us(options.latency_us);
+        if (!send_range(fd, source, first, last)) {
+            break;
+        }
+    }
+    close(fd);
+}
+
+int main(int argc, char** argv) {
+    ServerOptions options;
+    if (!parse_options(argc, argv, options)) {
+        return 1;
+    }
+    if (options.show_help) {
+        print_usage(argv[0]);
+        return 0;
+    }
+    std::signal(SIGPIPE, SIG_IGN);
+
+    const PacketSource source(options);
+
+    int listen_fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listen_fd == -1) {
+        std::cerr << "Error creating listening socket! " << strerror(errno) << std::endl;
+        return 1;
+    }
+    int one = 1;
+    setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    sockaddr_in addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(static_cast<uint16_t>(options.port));
+    if (bind(listen_fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0 || listen(listen_fd, 1024) < 0) {
+        std::cerr << "Couldn't listen on port " << options.port << "! " << strerror(errno) << std::endl;
+        close(listen_fd);
+        return 1;
+    }
+    std::cout << "Mock ABX server on port " << options.port << ": " << options.packet_count << " packets, "
+              << options.symbol_count << " symbols, drop rate " << options.drop_rate << ", seed " << options.seed
+              << "." << std::endl;
+
+    // One thread per connection keeps this simple; the client is what we're measuring, not us.
+    while (true) {
+        int client_fd = accept4(listen_fd, nullptr, nullptr, SOCK_CLOEXEC);
+        if (client_fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED || errno == EMFILE || errno == ENFILE) {
+                if (errno == EMFILE || errno == ENFILE) {
+                    pause_us(1000); // Out of descriptors - give the handlers a moment to finish
+                }
+                continue;
+            }
+            std::cerr << "accept failed! " << strerror(errno) << std::endl;
+            break;
+        }
+        std::thread(handle_client, client_fd, std::cref(options), std::cref(source)).detach();
+    }
+    close(listen_fd);
+    return 1;
+}
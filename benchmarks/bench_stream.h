@@ -0,0 +1,76 @@
+#ifndef ABX_BENCH_STREAM_H
+#define ABX_BENCH_STREAM_H
+
+// Shared helpers for the benchmarks: fake packet streams and a tiny timer.
+
+#include <vector>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+#include "../packet.h"
+
+namespace bench {
+
+// Writes the i-th fake packet (sequence i + 1) to `p`, PACKET_SIZE bytes in wire format.
+inline void put_packet(size_t i, unsigned char* p) {
+    static const char* symbols[] = {"MSFT", "AAPL", "AMZN", "META"};
+    const char* symbol = symbols[i % 4];
+    for (int k = 0; k < 4; ++k) p[k] = static_cast<unsigned char>(symbol[k]);
+    p[4] = (i & 1) ? 'S' : 'B';
+    uint32_t fields[3] = {static_cast<uint32_t>(i % 500 + 1),
+                          static_cast<uint32_t>(100 + i % 50),
+                          static_cast<uint32_t>(i + 1)};
+    for (int f = 0; f < 3; ++f) {
+        p[5 + f * 4] = static_cast<unsigned char>(fields[f] >> 24);
+        p[6 + f * 4] = static_cast<unsigned char>(fields[f] >> 16);
+        p[7 + f * 4] = static_cast<unsigned char>(fields[f] >> 8);
+        p[8 + f * 4] = static_cast<unsigned char>(fields[f]);
+    }
+}
+
+// Builds a stream of `count` valid packets with sequences 1..count, back to back.
+inline std::vector<char> make_stream(size_t count) {
+    std::vector<char> stream(count * PACKET_SIZE);
+    for (size_t i = 0; i < count; ++i) {
+        put_packet(i, reinterpret_cast<unsigned char*>(stream.data() + i * PACKET_SIZE));
+    }
+    return stream;
+}
+
+// Same packets as make_stream(count), but each one left out with probability `drop_rate` (never the
+// last, which the server always sends). The pick is a fixed-seed LCG, so runs are comparable.
+inline std::vector<char> make_stream_with_drops(size_t count, double drop_rate, uint64_t seed = 1) {
+    std::vector<char> stream(count * PACKET_SIZE);
+    size_t kept = 0;
+    uint64_t state = seed;
+    for (size_t i = 0; i < count; ++i) {
+        state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+        double roll = static_cast<double>(state >> 11) / 9007199254740992.0; // [0, 1)
+        if (i + 1 < count && roll < drop_rate) {
+            continue;
+        }
+        put_packet(i, reinterpret_cast<unsigned char*>(stream.data() + kept * PACKET_SIZE));
+        ++kept;
+    }
+    stream.resize(kept * PACKET_SIZE);
+    return stream;
+}
+
+// Runs `fn` once to warm up, then returns the best wall time (seconds) out of `reps` runs.
+template <typename Fn>
+double best_of(int reps, Fn fn) {
+    fn();
+    double best = 1e30;
+    for (int rep = 0; rep < reps; ++rep) {
+        auto start = std::chrono::steady_clock::now();
+        fn();
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        if (seconds < best) best = seconds;
+    }
+    return best;
+}
+
+} // namespace bench
+
+#endif // ABX_BENCH_STREAM_H
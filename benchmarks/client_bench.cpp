@@ -0,0 +1,219 @@
+// Client hot-path suite: every per-packet stage of a run, at several sizes and drop rates, with the
+// results written as JSON so runs from different commits can be diffed or plotted.
+//
+// Stages, in the order a run hits them:
+//   parse_packet    parse_packet() on every received packet
+//   view_sequence   Just the sequence of every received packet, read through a PacketView
+//   batch_decode    decode_packets() with the best decoder the CPU has
+//   framing         PacketFramer over 16 KiB recv()-sized chunks, decoding each run as the stream does
+//   store_insert    PacketStore::insert for every received packet, into a fresh store
+//   missing_scan    PacketStore::missing_sequences (Stage 4)
+//   json_emit       JsonStreamWriter over the whole store, to /dev/null (Stage 6)
+//   analytics       SymbolAnalytics::add over the whole store (--analytics, alongside json_emit)
+//
+// "packets" is the stream length; with drops, the received ones are fewer and the rest are holes.
+//
+// Build & run from the repo root:
+//   g++ -O2 -std=c++17 -pthread benchmarks/client_bench.cpp -o client_bench
+//   ./client_bench [--counts 1e3,1e5,1e7] [--drop-rates 0,0.01,0.1] [--reps N] [--label TEXT] [--json PATH]
+//
+// The JSON goes to stdout (or --json PATH); the human-readable lines go to stderr. 1e8 packets takes
+// about 6 GB of memory.
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <cstdint>
+#include <cstring>
+
+#include "../packet.h"
+#include "../packet_framer.h"
+#include "../packet_batch_decoder.h"
+#include "../packet_store.h"
+#include "../json_writer.h"
+#include "../symbol_analytics.h"
+#include "bench_stream.h"
+
+namespace {
+
+struct Result {
+    std::string stage;
+    size_t packets;      // Stream length
+    double drop_rate;
+    size_t items;        // What the stage went through: received packets, or sequences for the scan
+    double seconds;      // Best of the reps
+};
+
+// "1e3,100000" -> {1000, 100000}. Empty on anything that isn't a positive number.
+std::vector<double> parse_list(const std::string& text) {
+    std::vector<double> values;
+    std::stringstream in(text);
+    std::string item;
+    while (std::getline(in, item, ',')) {
+        char* end = nullptr;
+        double value = std::strtod(item.c_str(), &end);
+        if (item.empty() || *end != '\0' || value < 0) {
+            return std::vector<double>();
+        }
+        values.push_back(value);
+    }
+    return values;
+}
+
+// Enough escaping for a label typed on the command line.
+std::string json_string(const std::string& text) {
+    std::string quoted = "\"";
+    for (char c : text) {
+        if (c == '"' || c == '\\') {
+            quoted += '\\';
+        }
+        if (static_cast<unsigned char>(c) >= 0x20) {
+            quoted += c;
+        }
+    }
+    return quoted + "\"";
+}
+
+void write_json(std::ostream& out, const std::string& label, const std::vector<Result>& results) {
+    out << "{\n  \"benchmark\": \"client_bench\",\n  \"label\": " << json_string(label) << ",\n  \"decoder\": \""
+        << decoder_name(best_decoder()) << "\",\n  \"results\": [";
+    for (size_t i = 0; i < results.size(); ++i) {
+        const Result& r = results[i];
+        out << (i == 0 ? "\n" : ",\n") << "    {\"stage\": \"" << r.stage << "\", \"packets\": " << r.packets
+            << ", \"drop_rate\": " << r.drop_rate << ", \"items\": " << r.items << ", \"seconds\": " << r.seconds
+            << ", \"ns_per_item\": " << (r.items > 0 ? r.seconds * 1e9 / r.items : 0.0)
+            << ", \"items_per_sec\": " << (r.seconds > 0 ? r.items / r.seconds : 0.0) << "}";
+    }
+    out << "\n  ]\n}\n";
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    std::vector<double> counts = {1e3, 1e4, 1e5, 1e6};
+    std::vector<double> drop_rates = {0.0, 0.01, 0.1};
+    int reps = 3;
+    std::string label;
+    std::string json_path;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--counts" && i + 1 < argc) {
+            counts = parse_list(argv[++i]);
+        } else if (arg == "--drop-rates" && i + 1 < argc) {
+            drop_rates = parse_list(argv[++i]);
+        } else if (arg == "--reps" && i + 1 < argc) {
+            reps = std::atoi(argv[++i]);
+        } else if (arg == "--label" && i + 1 < argc) {
+            label = argv[++i];
+        } else if (arg == "--json" && i + 1 < argc) {
+            json_path = argv[++i];
+        } else {
+            std::cerr << "Usage: " << argv[0]
+                      << " [--counts 1e3,1e5] [--drop-rates 0,0.1] [--reps N] [--label TEXT] [--json PATH]" << std::endl;
+            return 1;
+        }
+    }
+    if (counts.empty() || drop_rates.empty() || reps < 1) {
+        std::cerr << "--counts and --drop-rates need comma-separated numbers, --reps a positive one." << std::endl;
+        return 1;
+    }
+
+    std::vector<Result> results;
+    int64_t sink = 0;
+    for (double count_value : counts) {
+        size_t count = static_cast<size_t>(count_value);
+        if (count < 1 || count > static_cast<size_t>(PacketStore::MAX_SEQUENCE)) {
+            std::cerr << "Skipping " << count_value << " packets: outside 1.." << PacketStore::MAX_SEQUENCE << std::endl;
+            continue;
+        }
+        // The biggest sizes take long enough that one timed run says plenty.
+        int size_reps = count >= 10000000 ? 1 : reps;
+        for (double drop_rate : drop_rates) {
+            std::vector<char> stream = bench::make_stream_with_drops(count, drop_rate > 1.0 ? 1.0 : drop_rate);
+            const unsigned char* packets = reinterpret_cast<const unsigned char*>(stream.data());
+            size_t received = stream.size() / PACKET_SIZE;
+            auto record = [&](const char* stage, size_t items, double seconds) {
+                results.push_back(Result{stage, count, drop_rate, items, seconds});
+                std::cerr << "  " << stage << " packets=" << count << " drop=" << drop_rate << ": "
+                          << (seconds > 0 ? items / seconds / 1e6 : 0.0) << " M/s ("
+                          << seconds * 1000.0 << " ms)" << std::endl;
+            };
+
+            record("parse_packet", received, bench::best_of(size_reps, [&] {
+                for (size_t i = 0; i < received; ++i) {
+                    sink += parse_packet(packets + i * PACKET_SIZE).sequence;
+                }
+            }));
+
+            // What a consumer that only needs one field pays, next to the full parse above.
+            record("view_sequence", received, bench::best_of(size_reps, [&] {
+                for (size_t i = 0; i < received; ++i) {
+                    sink += PacketView(packets + i * PACKET_SIZE).sequence();
+                }
+            }));
+
+            DecodedBatch batch;
+            record("batch_decode", received, bench::best_of(size_reps, [&] {
+                decode_packets(packets, received, batch);
+                sink += batch.count > 0 ? batch.sequence[batch.count - 1] : 0;
+            }));
+
+            const size_t chunk = 16 * 1024;
+            record("framing", received, bench::best_of(size_reps, [&] {
+                PacketFramer framer;
+                DecodedBatch decoded;
+                for (size_t offset = 0; offset < stream.size(); offset += chunk) {
+                    size_t n = stream.size() - offset < chunk ? stream.size() - offset : chunk;
+                    framer.frame_chunk(stream.data() + offset, n, [&](const unsigned char* run, size_t run_count) {
+                        decode_packets(run, run_count, decoded);
+                        sink += decoded.count;
+                    });
+                }
+            }));
+
+            // Decoded once up front so insertion is timed on its own.
+            decode_packets(packets, received, batch);
+            PacketStore store;
+            record("store_insert", received, bench::best_of(size_reps, [&] {
+                store = PacketStore();
+                for (size_t i = 0; i < batch.count; ++i) {
+                    store.insert(batch.packet(i));
+                }
+            }));
+
+            // Per sequence scanned, holes or not: the bitmap walk is what it costs.
+            record("missing_scan", count, bench::best_of(size_reps, [&] { sink += store.missing_sequences().size(); }));
+
+            record("json_emit", store.size(), bench::best_of(size_reps, [&] {
+                JsonStreamWriter writer;
+                if (!writer.open("/dev/null")) {
+                    return;
+                }
+                store.for_each([&](const Packet& packet) { writer.write_packet(packet); });
+                writer.finish();
+            }));
+
+            record("analytics", store.size(), bench::best_of(size_reps, [&] {
+                SymbolAnalytics analytics;
+                store.for_each([&](const Packet& packet) { analytics.add(packet); });
+                sink += analytics.symbol_count();
+            }));
+        }
+    }
+    std::cerr << "(checksum " << sink << ")" << std::endl;
+
+    if (json_path.empty()) {
+        write_json(std::cout, label, results);
+    } else {
+        std::ofstream out(json_path);
+        write_json(out, label, results);
+        if (!out) {
+            std::cerr << "Couldn't write " << json_path << std::endl;
+            return 1;
+        }
+    }
+    return 0;
+}
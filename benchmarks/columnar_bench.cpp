@@ -0,0 +1,131 @@
+// Output format benchmark: what a downstream job pays to read the capture back.
+//
+// Writes the same packets as output.json (JsonStreamWriter) and as a columnar file (ColumnarWriter),
+// checks that the columnar file reads back packet for packet, then times a typical scan (total
+// notional, price x quantity) over each: pulling the numbers back out of the JSON text versus using
+// the mmap'd columns directly.
+//
+// Build & run from the repo root:
+//   g++ -O2 -std=c++17 benchmarks/columnar_bench.cpp -o columnar_bench
+//   ./columnar_bench [packet_count] [directory]
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <cstdint>
+#include <cstring>
+#include <cstdio>   // remove
+
+#include "../packet.h"
+#include "../json_writer.h"
+#include "../columnar_file.h"
+#include "bench_stream.h"
+
+namespace {
+
+// Not a JSON parser, just the cheapest thing that gets the two numbers out of our own output: find
+// each key and strtol what follows. A real consumer with a real parser pays more than this.
+int64_t json_notional(const std::string& text) {
+    static const char price_key[] = "\"price\": ";
+    static const char quantity_key[] = "\"quantity\": ";
+    int64_t notional = 0;
+    const char* cursor = text.c_str();
+    while ((cursor = std::strstr(cursor, quantity_key)) != nullptr) {
+        char* end;
+        long quantity = std::strtol(cursor + sizeof(quantity_key) - 1, &end, 10);
+        cursor = std::strstr(end, price_key);
+        long price = std::strtol(cursor + sizeof(price_key) - 1, &end, 10);
+        notional += int64_t(price) * quantity;
+        cursor = end;
+    }
+    return notional;
+}
+
+int64_t columnar_notional(const ColumnarReader& reader) {
+    const int32_t* prices = reader.prices();
+    const int32_t* quantities = reader.quantities();
+    int64_t notional = 0;
+    for (size_t i = 0; i < reader.size(); ++i) {
+        notional += int64_t(prices[i]) * quantities[i];
+    }
+    return notional;
+}
+
+void report(const char* name, size_t count, double seconds) {
+    std::cout << "  " << name << ": " << count / seconds / 1e6 << " M packets/s ("
+              << seconds * 1000.0 << " ms)" << std::endl;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    size_t count = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 1000000;
+    std::string directory = argc > 2 ? argv[2] : ".";
+    std::string json_path = directory + "/columnar_bench.json";
+    std::string columnar_path = directory + "/columnar_bench.abxc";
+
+    std::vector<char> stream = bench::make_stream(count);
+    std::vector<Packet> packets(count);
+    for (size_t i = 0; i < count; ++i) {
+        packets[i] = parse_packet(reinterpret_cast<const unsigned char*>(stream.data()) + i * PACKET_SIZE);
+    }
+
+    double json_write = bench::best_of(3, [&]() {
+        JsonStreamWriter writer;
+        writer.open(json_path);
+        for (const Packet& packet : packets) {
+            writer.write_packet(packet);
+        }
+        writer.finish();
+    });
+    double columnar_write = bench::best_of(3, [&]() {
+        ColumnarWriter writer;
+        for (const Packet& packet : packets) {
+            writer.append(packet);
+        }
+        writer.finish(columnar_path);
+    });
+
+    ColumnarReader reader;
+    if (!reader.open(columnar_path) || reader.size() != count) {
+        std::cerr << "Couldn't read " << columnar_path << " back: " << std::strerror(errno) << std::endl;
+        return 1;
+    }
+    for (size_t i = 0; i < count; ++i) {
+        Packet expected = packets[i];
+        Packet actual = reader.packet(i);
+        if (expected.symbol != actual.symbol || expected.buysell_indicator != actual.buysell_indicator ||
+            expected.quantity != actual.quantity || expected.price != actual.price ||
+            expected.sequence != actual.sequence) {
+            std::cerr << "Packet " << i << " came back differently from the columnar file!" << std::endl;
+            return 1;
+        }
+    }
+
+    std::ifstream json_file(json_path);
+    std::stringstream json_text;
+    json_text << json_file.rdbuf();
+    std::string text = json_text.str();
+    std::cout << "Output for " << count << " packets: output.json is " << text.size() << " bytes, columnar is "
+              << reader.file_size() << " bytes" << std::endl;
+    report("write json    ", count, json_write);
+    report("write columnar", count, columnar_write);
+
+    int64_t json_total = 0;
+    int64_t columnar_total = 0;
+    double json_scan = bench::best_of(3, [&]() { json_total = json_notional(text); });
+    double columnar_scan = bench::best_of(3, [&]() { columnar_total = columnar_notional(reader); });
+    if (json_total != columnar_total) {
+        std::cerr << "Notional differs: json " << json_total << ", columnar " << columnar_total << std::endl;
+        return 1;
+    }
+    report("scan json     ", count, json_scan);
+    report("scan columnar ", count, columnar_scan);
+
+    std::remove(json_path.c_str());
+    std::remove(columnar_path.c_str());
+    return 0;
+}
@@ -0,0 +1,85 @@
+// Decoder benchmark: packets/sec through parse_packet() versus the batch decoders.
+//
+// Every batch decoder the CPU supports is checked against parse_packet() first, so a wrong shuffle
+// mask shows up as a loud failure rather than a fast number.
+//
+// Build & run from the repo root:
+//   g++ -O2 -std=c++17 -pthread benchmarks/decoder_bench.cpp -o decoder_bench
+//   ./decoder_bench [packet_count]
+
+#include <iostream>
+#include <vector>
+#include <cstdlib>
+#include <cstdint>
+
+#include "../packet.h"
+#include "../packet_batch_decoder.h"
+#include "bench_stream.h"
+
+namespace {
+
+bool matches_parse_packet(const std::vector<char>& stream, size_t count, DecoderKind kind) {
+    DecodedBatch batch;
+    const unsigned char* packets = reinterpret_cast<const unsigned char*>(stream.data());
+    decode_packets(packets, count, batch.prepare(count), kind);
+    for (size_t i = 0; i < count; ++i) {
+        Packet expected = parse_packet(packets + i * PACKET_SIZE);
+        Packet actual = batch.packet(i);
+        if (expected.symbol != actual.symbol || expected.buysell_indicator != actual.buysell_indicator ||
+            expected.quantity != actual.quantity || expected.price != actual.price ||
+            expected.sequence != actual.sequence) {
+            std::cerr << decoder_name(kind) << ": packet " << i << " decoded differently!" << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+void report(const char* name, size_t count, double seconds) {
+    std::cout << "  " << name << ": " << count / seconds / 1e6 << " M packets/s ("
+              << seconds * 1000.0 << " ms)" << std::endl;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    size_t count = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 10000000;
+    std::vector<char> stream = bench::make_stream(count);
+    const unsigned char* packets = reinterpret_cast<const unsigned char*>(stream.data());
+    std::cout << "Decoding " << count << " packets, best supported decoder: "
+              << decoder_name(best_decoder()) << std::endl;
+
+    std::vector<DecoderKind> kinds;
+    kinds.push_back(DecoderKind::Scalar);
+    if (best_decoder() != DecoderKind::Scalar) kinds.push_back(DecoderKind::SSE41);
+    if (best_decoder() == DecoderKind::AVX2) kinds.push_back(DecoderKind::AVX2);
+
+    // Odd count on purpose, so the leftover (non-multiple-of-8) path gets checked too.
+    size_t check_count = count < 1001 ? count : 1001;
+    for (DecoderKind kind : kinds) {
+        if (!matches_parse_packet(stream, check_count, kind)) {
+            return 1;
+        }
+    }
+
+    int64_t sink = 0;
+    report("parse_packet()  ", count, bench::best_of(3, [&] {
+        for (size_t i = 0; i < count; ++i) {
+            sink += parse_packet(packets + i * PACKET_SIZE).sequence;
+        }
+    }));
+
+    DecodedBatch batch;
+    batch.prepare(count);
+    for (DecoderKind kind : kinds) {
+        std::string name = std::string("batch ") + decoder_name(kind);
+        name.resize(16, ' ');
+        report(name.c_str(), count, bench::best_of(3, [&] {
+            decode_packets(packets, count, batch.prepare(count), kind);
+            sink += batch.sequence[count - 1];
+        }));
+    }
+
+    std::cout << "(checksum " << sink << ")" << std::endl;
+    return 0;
+}
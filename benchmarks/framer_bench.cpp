@@ -0,0 +1,95 @@
+// Framing benchmark: how many bytes/sec can we turn into packets?
+//
+// Compares the original Stage 3 loop (append to a std::vector<char>, erase each packet off the front)
+// against PacketFramer. The "network" is simulated by handing the framers fixed-size chunks of a
+// pre-built stream, so we're only measuring framing + parse, not the kernel.
+//
+// Build & run from the repo root:
+//   g++ -O2 -std=c++17 -pthread benchmarks/framer_bench.cpp -o framer_bench
+//   ./framer_bench [packet_count]
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <algorithm>
+#include <cstdlib>
+#include <cstdint>
+
+#include "../packet.h"
+#include "../packet_framer.h"
+#include "bench_stream.h"
+
+namespace {
+
+// The original loop, lifted from client.cpp as it was.
+int64_t frame_legacy(const std::vector<char>& stream, size_t chunk) {
+    std::vector<char> receive_buffer;
+    int64_t checksum = 0;
+    for (size_t off = 0; off < stream.size(); off += chunk) {
+        size_t n = std::min(chunk, stream.size() - off);
+        receive_buffer.insert(receive_buffer.end(), stream.begin() + off, stream.begin() + off + n);
+        while (receive_buffer.size() >= PACKET_SIZE) {
+            Packet packet = parse_packet(receive_buffer, 0);
+            checksum += packet.sequence;
+            receive_buffer.erase(receive_buffer.begin(), receive_buffer.begin() + PACKET_SIZE);
+        }
+    }
+    return checksum;
+}
+
+int64_t frame_with_framer(const std::vector<char>& stream, size_t chunk) {
+    // Big enough for one chunk plus a leftover partial packet, like recv() into free space would be.
+    PacketFramer framer(chunk + PACKET_SIZE);
+    int64_t checksum = 0;
+    size_t off = 0;
+    while (off < stream.size()) {
+        framer.prepare_write();
+        size_t n = std::min(std::min(chunk, framer.writable()), stream.size() - off);
+        std::memcpy(framer.write_ptr(), stream.data() + off, n); // stand-in for recv()
+        framer.commit(n);
+        off += n;
+        const unsigned char* raw_packet;
+        while (framer.next_packet(raw_packet)) {
+            Packet packet = parse_packet(raw_packet);
+            checksum += packet.sequence;
+        }
+    }
+    return checksum;
+}
+
+template <typename Fn>
+void run(const char* name, Fn fn, const std::vector<char>& stream, size_t chunk) {
+    // One warm-up pass, then time the best of three.
+    int64_t expected = fn(stream, chunk);
+    double best_seconds = 1e30;
+    for (int rep = 0; rep < 3; ++rep) {
+        auto start = std::chrono::steady_clock::now();
+        int64_t checksum = fn(stream, chunk);
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        if (checksum != expected) {
+            std::cerr << name << ": checksum mismatch!" << std::endl;
+        }
+        best_seconds = std::min(best_seconds, seconds);
+    }
+    double mb_per_sec = stream.size() / best_seconds / (1024.0 * 1024.0);
+    std::cout << "  " << name << " chunk=" << chunk << " bytes: "
+              << mb_per_sec << " MiB/s (" << best_seconds * 1000.0 << " ms)" << std::endl;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    size_t count = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 1000000;
+    std::vector<char> stream = bench::make_stream(count);
+    std::cout << "Framing " << count << " packets (" << stream.size() << " bytes)" << std::endl;
+
+    // 1 KiB is what the old temp_buffer read per recv(); the bigger ones are what a busy socket
+    // hands back when a burst is sitting in the kernel buffer.
+    const size_t chunks[] = {1024, 16 * 1024, 256 * 1024};
+    for (size_t chunk : chunks) {
+        run("legacy vector erase", frame_legacy, stream, chunk);
+        run("PacketFramer       ", frame_with_framer, stream, chunk);
+    }
+    return 0;
+}
@@ -0,0 +1,168 @@
+// Order book benchmark: price-level updates per second through OrderBookEngine, against the same
+// books kept in node-based std::maps (what the offline rebuilds from output.json use).
+//
+// The updates walk each symbol's price around a drifting mid, so most of them land within a few
+// levels of the top like a real feed, with the odd one further out and about one in four clearing
+// a level. Both versions get the same updates and have to end up with the same books.
+//
+// Build & run from the repo root:
+//   g++ -O2 -std=c++17 benchmarks/order_book_bench.cpp -o order_book_bench
+//   ./order_book_bench [update_count] [symbol_count]
+
+#include <iostream>
+#include <map>
+#include <functional>
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <cstdint>
+#include <cstring>
+#include <cstdio>   // snprintf
+
+#include "../packet.h"
+#include "../order_book.h"
+#include "../symbol_table.h"
+#include "bench_stream.h"
+
+namespace {
+
+// The old way: one std::map per side per symbol, best price at begin().
+struct MapBook {
+    std::map<int32_t, int32_t, std::greater<int32_t>> bids;
+    std::map<int32_t, int32_t> asks;
+
+    template <typename Side>
+    static void set(Side& side, int32_t price, int32_t quantity) {
+        if (quantity <= 0) {
+            side.erase(price);
+        } else {
+            side[price] = quantity;
+        }
+    }
+
+    void apply(const Packet& packet) {
+        if (packet.buysell_indicator == 'B') {
+            set(bids, packet.price, packet.quantity);
+        } else if (packet.buysell_indicator == 'S') {
+            set(asks, packet.price, packet.quantity);
+        }
+    }
+};
+
+struct MapBookEngine {
+    SymbolTable symbols;
+    std::vector<MapBook> books;
+
+    void apply(const Packet& packet) {
+        uint32_t id = symbols.intern(packet.symbol);
+        if (id >= books.size()) {
+            books.resize(id + 1);
+        }
+        books[id].apply(packet);
+    }
+};
+
+// `count` updates over `symbols` symbols, sequences 1..count. Fixed-seed LCG, so runs are comparable.
+std::vector<Packet> make_updates(size_t count, size_t symbols) {
+    std::vector<Packet> updates(count);
+    std::vector<int32_t> mids(symbols, 10000);
+    uint64_t state = 1;
+    auto next = [&state]() {
+        state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+        return static_cast<uint32_t>(state >> 33);
+    };
+    for (size_t i = 0; i < count; ++i) {
+        size_t s = next() % symbols;
+        Packet& p = updates[i];
+        std::memset(&p, 0, sizeof(p));
+        char code[5];
+        std::snprintf(code, sizeof(code), "S%03zu", s % 1000);
+        std::memcpy(&p.symbol, code, 4);
+        uint32_t roll = next();
+        mids[s] += static_cast<int32_t>(roll % 3) - 1;
+        bool bid = (roll >> 2) & 1;
+        // Mostly within 8 ticks of the touch, one in sixteen anywhere in the next 200.
+        int32_t distance = ((roll >> 3) & 15) == 0 ? static_cast<int32_t>((roll >> 7) % 200)
+                                                     : static_cast<int32_t>((roll >> 7) % 8);
+        p.buysell_indicator = bid ? 'B' : 'S';
+        p.price = bid ? mids[s] - 1 - distance : mids[s] + 1 + distance;
+        p.quantity = ((roll >> 16) & 3) == 0 ? 0 : static_cast<int32_t>(1 + (roll >> 19) % 500);
+        p.sequence = static_cast<int32_t>(i + 1);
+    }
+    return updates;
+}
+
+// Books from the two engines match level for level.
+bool same_books(const OrderBookEngine& flat, const MapBookEngine& maps) {
+    if (flat.symbol_count() != maps.books.size()) {
+        return false;
+    }
+    for (uint32_t id = 0; id < flat.symbol_count(); ++id) {
+        const OrderBook& book = flat.book(id);
+        const MapBook& expected = maps.books[id];
+        if (book.bids().depth() != expected.bids.size() || book.asks().depth() != expected.asks.size()) {
+            return false;
+        }
+        size_t i = 0;
+        for (const auto& level : expected.bids) {
+            if (book.bids().level(i).price != level.first || book.bids().level(i).quantity != level.second) {
+                return false;
+            }
+            ++i;
+        }
+        i = 0;
+        for (const auto& level : expected.asks) {
+            if (book.asks().level(i).price != level.first || book.asks().level(i).quantity != level.second) {
+                return false;
+            }
+            ++i;
+        }
+    }
+    return true;
+}
+
+void report(const char* name, size_t count, double seconds) {
+    std::cout << "  " << name << ": " << count / seconds / 1e6 << " M updates/s ("
+              << seconds * 1e9 / count << " ns each)" << std::endl;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    size_t count = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 10000000;
+    size_t symbols = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 50;
+    if (count < 1 || symbols < 1) {
+        std::cerr << "Usage: " << argv[0] << " [update_count] [symbol_count]" << std::endl;
+        return 1;
+    }
+    std::vector<Packet> updates = make_updates(count, symbols);
+
+    OrderBookEngine flat;
+    double flat_seconds = bench::best_of(3, [&]() {
+        flat = OrderBookEngine();
+        for (const Packet& packet : updates) {
+            flat.apply(packet);
+        }
+    });
+    MapBookEngine maps;
+    double map_seconds = bench::best_of(3, [&]() {
+        maps = MapBookEngine();
+        for (const Packet& packet : updates) {
+            maps.apply(packet);
+        }
+    });
+    if (!same_books(flat, maps)) {
+        std::cerr << "The flat books and the std::map books came out differently!" << std::endl;
+        return 1;
+    }
+
+    size_t levels = 0;
+    for (uint32_t id = 0; id < flat.symbol_count(); ++id) {
+        levels += flat.book(id).bids().depth() + flat.book(id).asks().depth();
+    }
+    std::cout << count << " updates over " << flat.symbol_count() << " symbols, " << levels
+              << " levels at the end:" << std::endl;
+    report("flat arrays", count, flat_seconds);
+    report("std::map   ", count, map_seconds);
+    return 0;
+}
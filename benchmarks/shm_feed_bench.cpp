@@ -0,0 +1,171 @@
+// Shared-memory feed benchmark: a publisher process and a subscriber process on the same ring.
+//
+// The subscriber is a fork()ed child attached with ShmFeedSubscriber, the way a downstream process
+// would be. Two runs:
+//   burst   the publisher writes every packet as fast as it can; the subscriber reports how many it
+//           got and how many it lost to being lapped (a small ring makes that easy to see)
+//   paced   one packet every --gap-ns, each stamped with its publish time in a side table both
+//           processes share, so the subscriber can report publish-to-receive latency
+//
+// Latency needs the two processes on different cores; on a single core it measures the scheduler.
+//
+// Build & run from the repo root:
+//   g++ -O2 -std=c++17 benchmarks/shm_feed_bench.cpp -o shm_feed_bench
+//   ./shm_feed_bench [packet_count] [slots] [gap_ns] [path]
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <cstdint>
+#include <cstring>
+#include <cerrno>
+
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "../packet.h"
+#include "../shm_feed.h"
+#include "../metrics.h"   // monotonic_ns, LatencyHistogram
+#include "bench_stream.h"
+
+namespace {
+
+// What the child reports back through the shared side table.
+struct ChildReport {
+    uint64_t received;
+    uint64_t lost;
+    uint64_t out_of_order;
+    uint64_t p50_ns;
+    uint64_t p99_ns;
+    uint64_t max_ns;
+};
+
+// Reads until Finished. Spins, yielding to the scheduler every so often so a publisher sharing the
+// core still gets to run. `publish_ns` (may be null) holds each packet's publish time by sequence.
+void subscribe(const std::string& path, const uint64_t* publish_ns, ChildReport& report) {
+    ShmFeedSubscriber feed;
+    while (!feed.open(path)) {
+        sched_yield(); // The parent creates it; we may be early
+    }
+    LatencyHistogram latency;
+    Packet packet;
+    int32_t last_sequence = 0;
+    uint64_t empty_polls = 0;
+    std::memset(&report, 0, sizeof(report));
+    for (;;) {
+        ShmFeedSubscriber::Result result = feed.poll(packet);
+        if (result == ShmFeedSubscriber::Finished) {
+            break;
+        }
+        if (result == ShmFeedSubscriber::Empty) {
+            if (++empty_polls % 64 == 0) {
+                sched_yield();
+            }
+            continue;
+        }
+        uint64_t now_ns = monotonic_ns();
+        ++report.received;
+        if (packet.sequence <= last_sequence) {
+            ++report.out_of_order;
+        }
+        last_sequence = packet.sequence;
+        if (publish_ns != nullptr) {
+            latency.record(now_ns - publish_ns[packet.sequence - 1]);
+        }
+    }
+    report.lost = feed.lost();
+    report.p50_ns = latency.percentile(50.0);
+    report.p99_ns = latency.percentile(99.0);
+    report.max_ns = latency.max();
+}
+
+// One publisher / subscriber run. False if something went wrong with the processes themselves.
+bool run(const char* name, const std::string& path, const std::vector<Packet>& packets, size_t slots,
+         uint64_t gap_ns) {
+    size_t count = packets.size();
+    // Side table: publish times, then the child's report. Shared with the child, not part of the feed.
+    size_t table_size = count * sizeof(uint64_t) + sizeof(ChildReport);
+    void* table = mmap(nullptr, table_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (table == MAP_FAILED) {
+        std::cerr << "mmap failed: " << std::strerror(errno) << std::endl;
+        return false;
+    }
+    uint64_t* publish_ns = static_cast<uint64_t*>(table);
+    ChildReport* report = reinterpret_cast<ChildReport*>(publish_ns + count);
+
+    ShmFeedPublisher feed;
+    if (!feed.create(path, slots)) {
+        std::cerr << "Couldn't create " << path << ": " << std::strerror(errno) << std::endl;
+        munmap(table, table_size);
+        return false;
+    }
+    pid_t child = fork();
+    if (child == 0) {
+        subscribe(path, gap_ns > 0 ? publish_ns : nullptr, *report);
+        _exit(0);
+    }
+    usleep(20000); // Let the subscriber attach before the first packet
+
+    uint64_t started_ns = monotonic_ns();
+    for (size_t i = 0; i < count; ++i) {
+        if (gap_ns > 0) {
+            uint64_t due_ns = started_ns + i * gap_ns;
+            while (monotonic_ns() < due_ns) {
+            }
+            publish_ns[i] = monotonic_ns();
+        }
+        feed.publish(packets[i]);
+    }
+    double seconds = (monotonic_ns() - started_ns) / 1e9;
+    feed.finish();
+    int status = 0;
+    waitpid(child, &status, 0);
+
+    std::cout << "  " << name << ": published " << count << " in " << seconds * 1000.0 << " ms ("
+              << count / seconds / 1e6 << " M/s); subscriber got " << report->received << ", lost "
+              << report->lost << (report->out_of_order > 0 ? ", OUT OF ORDER " : "")
+              << (report->out_of_order > 0 ? std::to_string(report->out_of_order) : "");
+    if (gap_ns > 0) {
+        std::cout << "; latency p50 " << report->p50_ns << " ns, p99 " << report->p99_ns << " ns, max "
+                  << report->max_ns << " ns";
+    }
+    std::cout << std::endl;
+    bool ok = report->out_of_order == 0 && report->received + report->lost == count;
+    munmap(table, table_size);
+    unlink(path.c_str());
+    return ok;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    size_t count = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 1000000;
+    size_t slots = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : ShmFeedPublisher::DEFAULT_CAPACITY;
+    uint64_t gap_ns = argc > 3 ? std::strtoull(argv[3], nullptr, 10) : 2000;
+    std::string path = argc > 4 ? argv[4] : "/dev/shm/abx_shm_feed_bench";
+    if (count < 1 || slots < 2) {
+        std::cerr << "Usage: " << argv[0] << " [packet_count] [slots] [gap_ns] [path]" << std::endl;
+        return 1;
+    }
+
+    std::vector<char> stream = bench::make_stream(count);
+    std::vector<Packet> packets(count);
+    for (size_t i = 0; i < count; ++i) {
+        packets[i] = parse_packet(reinterpret_cast<const unsigned char*>(stream.data()) + i * PACKET_SIZE);
+    }
+
+    std::cout << count << " packets through a " << slots << "-slot ring at " << path << ":" << std::endl;
+    bool ok = run("burst", path, packets, slots, 0);
+    // Paced runs take count x gap_ns; cap them so the default doesn't take minutes.
+    size_t paced = count < 200000 ? count : 200000;
+    std::vector<Packet> paced_packets(packets.begin(), packets.begin() + static_cast<std::ptrdiff_t>(paced));
+    ok = run("paced", path, paced_packets, slots, gap_ns) && ok;
+    if (!ok) {
+        std::cerr << "The subscriber's count doesn't add up (or came out of order)!" << std::endl;
+        return 1;
+    }
+    return 0;
+}
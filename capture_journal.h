@@ -0,0 +1,269 @@
+#ifndef ABX_CAPTURE_JOURNAL_H
+#define ABX_CAPTURE_JOURNAL_H
+
+#include <string>
+#include <vector>
+#include <functional>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>  // memcmp
+#include <cerrno>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "packet.h"
+
+// CaptureJournal is an append-only log of every packet the client has received, so a run that gets
+// killed halfway can pick up where it left off instead of starting over.
+//
+// File layout (all big-endian):
+//
+//     offset 0   "ABXJ"
+//            4   uint16 version (1)
+//            6   uint16 frame size (17)
+//            8   int32  highest sequence of a stream that ran to the end, 0 until one has
+//           12   uint32 reserved
+//           16   17-byte packets, exactly as they came off the wire, in arrival order
+//
+// Packets are buffered and written out on commit() (once per burst or resent packet), so a crash
+// loses at most what hadn't been committed. Whether those writes are also forced to disk is the sync
+// policy: Never leaves it to the kernel (fine if only the process dies), Always syncs on every
+// commit, and Interval syncs at most every `interval_ms`.
+//
+// Replaying keeps whatever whole frames are there and cuts off a half-written one at the end.
+// Frames can repeat (a resumed run streams again); the later copy is the same packet anyway.
+class CaptureJournal {
+public:
+    enum class SyncPolicy { Never, Interval, Always };
+
+    typedef std::function<void(const Packet&)> PacketHandler;
+
+    static const size_t HEADER_SIZE = 16;
+    static const size_t BUFFER_SIZE = 64 * 1024;
+
+    CaptureJournal()
+        : fd_(-1),
+          used_(0),
+          error_(0),
+          sync_policy_(SyncPolicy::Interval),
+          sync_interval_ms_(100),
+          last_sync_(Clock::now()),
+          replayed_(0),
+          stream_max_sequence_(0),
+          buffer_(BUFFER_SIZE) {}
+
+    ~CaptureJournal() { close_journal(); }
+
+    CaptureJournal(const CaptureJournal&) = delete;
+    CaptureJournal& operator=(const CaptureJournal&) = delete;
+
+    void set_sync_policy(SyncPolicy policy, uint64_t interval_ms) {
+        sync_policy_ = policy;
+        sync_interval_ms_ = interval_ms;
+    }
+
+    // Opens the journal at `path`. With `resume`, an existing journal is replayed first (each packet
+    // goes to `on_packet`) and new packets are appended after it; otherwise, or if there's no file
+    // yet, it starts out empty. False with errno set on failure - EINVAL if the file exists but
+    // isn't a journal we can read, so it never gets clobbered by accident.
+    bool open(const std::string& path, bool resume, const PacketHandler& on_packet) {
+        if (resume) {
+            fd_ = ::open(path.c_str(), O_RDWR | O_CLOEXEC);
+            if (fd_ != -1) {
+                return replay(on_packet);
+            }
+            if (errno != ENOENT) {
+                return false;
+            }
+        }
+        fd_ = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (fd_ == -1) {
+            return false;
+        }
+        unsigned char header[HEADER_SIZE];
+        encode_header(0, header);
+        return write_all(header, HEADER_SIZE) && sync();
+    }
+
+    // Queues a packet. Nothing reaches the file until commit().
+    void append(const Packet& packet) {
+        if (fd_ == -1) {
+            return;
+        }
+        if (BUFFER_SIZE - used_ < PACKET_SIZE) {
+            write_buffer();
+        }
+        encode_packet(packet, buffer_.data() + used_);
+        used_ += PACKET_SIZE;
+    }
+
+    // Writes out everything appended so far and syncs if the policy says so. False if the journal
+    // has failed at any point (it stops writing after the first error).
+    bool commit() {
+        if (fd_ == -1 || !write_buffer()) {
+            return false;
+        }
+        if (sync_policy_ == SyncPolicy::Always ||
+            (sync_policy_ == SyncPolicy::Interval &&
+             Clock::now() - last_sync_ >= std::chrono::milliseconds(sync_interval_ms_))) {
+            return sync();
+        }
+        return true;
+    }
+
+    // Records that the stream ran to the end with `max_sequence` as its last packet, so a resumed run
+    // knows it doesn't have to stream again. Always synced, whatever the policy.
+    bool mark_stream_complete(int32_t max_sequence) {
+        if (fd_ == -1 || !write_buffer()) {
+            return false;
+        }
+        unsigned char header[HEADER_SIZE];
+        encode_header(max_sequence, header);
+        if (!fail_if(pwrite(fd_, header, HEADER_SIZE, 0) != static_cast<ssize_t>(HEADER_SIZE))) {
+            return false;
+        }
+        stream_max_sequence_ = max_sequence;
+        return fdatasync_checked();
+    }
+
+    // Flushes, syncs (unless the policy is Never) and closes. Safe to call twice.
+    bool close_journal() {
+        if (fd_ == -1) {
+            return error_ == 0;
+        }
+        bool ok = write_buffer() && (sync_policy_ == SyncPolicy::Never || sync());
+        if (close(fd_) != 0 && ok) {
+            error_ = errno;
+            ok = false;
+        }
+        fd_ = -1;
+        return ok;
+    }
+
+    bool ok() const { return error_ == 0; }
+    int error() const { return error_; }
+
+    // From the replayed file: how many packets it held, and the stream's last sequence if the stream
+    // had finished (0 if not).
+    size_t replayed() const { return replayed_; }
+    int32_t stream_max_sequence() const { return stream_max_sequence_; }
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    static const uint16_t VERSION = 1;
+
+    static void encode_header(int32_t stream_max_sequence, unsigned char* out) {
+        std::memcpy(out, "ABXJ", 4);
+        out[4] = 0;
+        out[5] = VERSION;
+        out[6] = 0;
+        out[7] = static_cast<unsigned char>(PACKET_SIZE);
+        uint32_t max = static_cast<uint32_t>(stream_max_sequence);
+        out[8] = static_cast<unsigned char>(max >> 24);
+        out[9] = static_cast<unsigned char>(max >> 16);
+        out[10] = static_cast<unsigned char>(max >> 8);
+        out[11] = static_cast<unsigned char>(max);
+        out[12] = out[13] = out[14] = out[15] = 0;
+    }
+
+    bool replay(const PacketHandler& on_packet) {
+        unsigned char header[HEADER_SIZE];
+        if (pread(fd_, header, HEADER_SIZE, 0) != static_cast<ssize_t>(HEADER_SIZE) ||
+            std::memcmp(header, "ABXJ", 4) != 0 || header[4] != 0 || header[5] != VERSION || header[6] != 0 ||
+            header[7] != PACKET_SIZE) {
+            close(fd_);
+            fd_ = -1;
+            errno = EINVAL;
+            return false;
+        }
+        stream_max_sequence_ = static_cast<int32_t>((uint32_t(header[8]) << 24) | (uint32_t(header[9]) << 16) |
+                                                    (uint32_t(header[10]) << 8) | header[11]);
+
+        // Read in big chunks; a frame can straddle two of them.
+        off_t offset = HEADER_SIZE;
+        size_t carried = 0;
+        while (true) {
+            ssize_t got = pread(fd_, buffer_.data() + carried, BUFFER_SIZE - carried, offset);
+            if (got < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                return fail_if(true);
+            }
+            if (got == 0) {
+                break;
+            }
+            offset += got;
+            size_t available = carried + static_cast<size_t>(got);
+            size_t whole = available / PACKET_SIZE * PACKET_SIZE;
+            for (size_t i = 0; i < whole; i += PACKET_SIZE) {
+                on_packet(parse_packet(buffer_.data() + i));
+                ++replayed_;
+            }
+            carried = available - whole;
+            std::memmove(buffer_.data(), buffer_.data() + whole, carried);
+        }
+
+        // A frame only half written when the last run died: drop it so new ones line up again.
+        off_t end = static_cast<off_t>(HEADER_SIZE + replayed_ * PACKET_SIZE);
+        if (carried > 0 && ftruncate(fd_, end) != 0) {
+            return fail_if(true);
+        }
+        return fail_if(lseek(fd_, end, SEEK_SET) == -1);
+    }
+
+    bool write_buffer() {
+        if (error_ != 0) {
+            used_ = 0;
+            return false;
+        }
+        bool ok = write_all(buffer_.data(), used_);
+        used_ = 0;
+        return ok;
+    }
+
+    bool write_all(const unsigned char* data, size_t size) {
+        size_t offset = 0;
+        while (offset < size) {
+            ssize_t written = ::write(fd_, data + offset, size - offset);
+            if (written < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                return fail_if(true);
+            }
+            offset += static_cast<size_t>(written);
+        }
+        return true;
+    }
+
+    bool sync() {
+        last_sync_ = Clock::now();
+        return fdatasync_checked();
+    }
+
+    bool fdatasync_checked() { return fail_if(fdatasync(fd_) != 0); }
+
+    // Remembers the first errno. Returns !failed so it can be returned directly.
+    bool fail_if(bool failed) {
+        if (failed && error_ == 0) {
+            error_ = errno;
+        }
+        return !failed;
+    }
+
+    int fd_;
+    size_t used_;
+    int error_;
+    SyncPolicy sync_policy_;
+    uint64_t sync_interval_ms_;
+    Clock::time_point last_sync_;
+    size_t replayed_;
+    int32_t stream_max_sequence_;
+    std::vector<unsigned char> buffer_;
+};
+
+#endif // ABX_CAPTURE_JOURNAL_H
@@ -1,450 +1,732 @@
 #include <iostream>
 #include <string>
 #include <vector>
-#include <array>    // Handy for fixed-size buffers
-#include <map>      // Great for storing packets by sequence number, keeps them sorted!
-#include <algorithm> // Useful for string trimming later
-#include <fstream>  // Need this to write the final JSON file
 #include <cstring>  // For memset, strerror, and memcpy if needed
 #include <cerrno>   // So we can check errno when socket calls fail
+#include <cstdlib>  // strtol for the command-line options
+#include <cstdio>   // sscanf for --thread-cpus
+#include <memory>   // unique_ptr for the optional io_uring backend
 
-// Alright, socket programming headers. Standard stuff for Linux/macOS.
-#include <sys/socket.h>     // The core socket functions (socket, connect, send, recv, setsockopt)
+// Alright, socket programming headers. The sockets themselves live in the session/engine headers now.
 #include <netinet/in.h>     // Structures for internet addresses (sockaddr_in, htons)
 #include <arpa/inet.h>      // Functions for IP address conversion (inet_pton)
-#include <unistd.h>         // For closing the socket file descriptor (close)
-#include <sys/time.h>       // Gotta include this for struct timeval needed for SO_RCVTIMEO
-
-// No external JSON library here, we're building that string by hand.
-
-// Let's define what a packet looks like once we pull it off the wire.
-struct Packet {
-    std::string symbol;          // Like "MSFT" or "AAPL"
-    char buysell_indicator;      // Should be 'B' or 'S'
-    int32_t quantity;            // How many shares
-    int32_t price;               // The price level
-    int32_t sequence;            // The packet's unique sequence number
-
-    // Little helper to print packet details, good for debugging!
-    void print() const {
-        std::cout << "  -> Seq: " << sequence
-                  << ", Symbol: " << symbol
-                  << ", Side: " << buysell_indicator
-                  << ", Qty: " << quantity
-                  << ", Price: " << price << std::endl;
-    }
-};
 
-// The size of each packet is fixed, makes things easier.
-const size_t PACKET_SIZE = 17; // 4 + 1 + 4 + 4 + 4 bytes
+// No external JSON library here, json_writer.h formats it by hand.
+
+#include "packet.h"         // Packet, PACKET_SIZE and parse_packet()
+#include "packet_framer.h"  // Turns the byte stream into whole packets without shuffling memory
+#include "packet_batch_decoder.h" // Decodes a whole run of packets at once (SIMD when the CPU has it)
+#include "packet_store.h"   // Sequence-indexed packet array with a "which ones do we have" bitmap
+#include "json_writer.h"    // Streams output.json out as packets become final
+#include "columnar_file.h"  // Optional mmap-able binary copy of the output
+#include "order_book.h"     // Optional per-symbol price-level books rebuilt from the packets
+#include "symbol_analytics.h" // Optional per-symbol VWAP / volume / range, worked out while writing
+#include "shm_feed.h"       // Optional shared-memory ring for local consumers of the packets
+#include "event_loop.h"     // epoll + timer wheel that drives every connection from one thread
+#include "stream_session.h" // Stages 1-3 (connect, request, receive) as a non-blocking state machine
+#include "resend_engine.h"  // Fetches missing packets over several concurrent connections
+#include "resend_pipeline.h" // ...or over one connection with the requests pipelined
+#include "capture_journal.h" // Append-only log of received packets, for resuming a killed run
+#include "io_uring_transport.h" // Optional io_uring version of the stream + resend phases
+#include "threaded_stream.h" // Optional network / decode / output threads for the stream phase
+#include "metrics.h"        // Per-stage latency histograms for the run summary
+#include "logger.h"         // Asynchronous logging, so progress messages don't cost a syscall each
+#include "completion_policy.h" // When to stop waiting on the stream or a resend
+#include "gap_tracker.h"    // Spots dropped sequences while the stream is still arriving
+#include "session_manager.h" // Collects from several servers at once with --endpoint
+
 // Server details - standard localhost and port 3000.
 const char* SERVER_HOST_IP = "127.0.0.1"; // Using IP directly for native connect
 const int SERVER_PORT = 3000;            // Port number
-// Setting a timeout so we don't hang forever if the server stops talking.
+// Deadline for each network operation (connect, stream going quiet, a single resend) so we don't
+// hang forever if the server stops talking. With adaptive timeouts (the default) this is only the
+// upper bound; the actual waits are derived from what the connection has been doing.
 const int RECEIVE_TIMEOUT_SEC = 5;       // 5 seconds should be reasonable
+// How many resend connections we keep open at once unless told otherwise.
+const size_t DEFAULT_RESEND_CONCURRENCY = 16;
+// How far behind the newest sequence a hole has to fall before we stop hoping it shows up late and
+// ask for it again, while the stream is still running.
+const int32_t DEFAULT_REORDER_WINDOW = 16;
+
+// Knobs you can turn from the command line.
+struct ClientOptions {
+    size_t resend_concurrency = DEFAULT_RESEND_CONCURRENCY;
+    bool use_io_uring = false;
+    bool show_help = false;
+    std::string metrics_json_path; // Empty = just print the summary
+    LogLevel log_level = LogLevel::Info;
+    CompletionPolicy::Config completion;
+    bool early_resend = true;
+    int32_t reorder_window = DEFAULT_REORDER_WINDOW;
+    ResendProtocol resend_protocol = ResendProtocol::Auto;
+    bool persistent_resend = false;
+    size_t pipeline_depth = ResendPipeline::DEFAULT_DEPTH;
+    std::string journal_path;      // Empty = no journal
+    bool resume = false;
+    CaptureJournal::SyncPolicy journal_sync = CaptureJournal::SyncPolicy::Interval;
+    uint64_t journal_sync_ms = 100;
+    std::string columnar_path;     // Empty = output.json only
+    size_t order_book_depth = 0;   // 0 = don't rebuild the books
+    std::string analytics_path;    // Empty = no per-symbol summary
+    std::string shm_path;          // Empty = no shared-memory feed
+    size_t shm_slots = ShmFeedPublisher::DEFAULT_CAPACITY;
+    bool threaded = false;
+    ThreadedStream::Config threads;
+    std::vector<Endpoint> endpoints; // Empty = just SERVER_HOST_IP:SERVER_PORT, written to output.json
+};
 
-// Function to take those raw bytes and turn them into our Packet struct.
-// Gotta pay attention to the big-endian stuff here!
-Packet parse_packet(const std::vector<char>& raw_data, size_t offset) {
-    Packet packet;
-    // Using unsigned char pointer helps avoid any weird signedness issues with raw bytes.
-    const unsigned char* data = reinterpret_cast<const unsigned char*>(raw_data.data() + offset);
-
-    // Pulling out the pieces based on the spec...
-    // Symbol (4 bytes ASCII)
-    // Just grab the bytes for now, we'll trim spaces/nulls when formatting JSON.
-    packet.symbol.assign(reinterpret_cast<const char*>(data), 4);
-
-    // Buy/Sell Indicator (1 byte ASCII)
-    packet.buysell_indicator = data[4]; // Simple enough
-
-    // Quantity (4 bytes int32, Big Endian)
-    // This is the manual way to handle Big Endian - shifting bytes into place.
-    packet.quantity = (static_cast<int32_t>(data[5]) << 24) |
-                      (static_cast<int32_t>(data[6]) << 16) |
-                      (static_cast<int32_t>(data[7]) << 8) |
-                       static_cast<int32_t>(data[8]);
-
-    // Price (4 bytes int32, Big Endian)
-    packet.price = (static_cast<int32_t>(data[9]) << 24) |
-                   (static_cast<int32_t>(data[10]) << 16) |
-                   (static_cast<int32_t>(data[11]) << 8) |
-                    static_cast<int32_t>(data[12]);
-
-    // Packet Sequence (4 bytes int32, Big Endian)
-    packet.sequence = (static_cast<int32_t>(data[13]) << 24) |
-                      (static_cast<int32_t>(data[14]) << 16) |
-                      (static_cast<int32_t>(data[15]) << 8) |
-                       static_cast<int32_t>(data[16]);
-
-    return packet;
+void print_usage(const char* program) {
+    std::cout << "Usage: " << program << " [options]\n"
+              << "  --endpoint HOST:PORT     Collect from this server into output_HOST_PORT.json; repeat for more,\n"
+              << "                           all collected at once (default: one run against "
+              << SERVER_HOST_IP << ":" << SERVER_PORT << ")\n"
+              << "  --resend-concurrency N   Max resend connections open at the same time (default "
+              << DEFAULT_RESEND_CONCURRENCY << ")\n"
+              << "  --io-uring               Use the io_uring backend if the kernel supports it (falls back to epoll)\n"
+              << "  --threaded               Receive, decode and write the stream on three threads of their own\n"
+              << "  --thread-cpus N,D,O      With --threaded, pin the network, decode and output threads to these CPUs (-1 = any)\n"
+              << "  --metrics-json PATH      Also write the stage latency summary to PATH as JSON\n"
+              << "  --log-level LEVEL        debug, info, warn, error or off (default info; debug prints every packet)\n"
+              << "  --fixed-timeouts         Always wait the full " << RECEIVE_TIMEOUT_SEC
+              << " s for the stream and each resend, no retries\n"
+              << "  --idle-jitter-multiple K Stream is done after K x (typical gap + 4 x jitter) of silence (default "
+              << CompletionPolicy::Config().jitter_multiple << ")\n"
+              << "  --min-idle-ms N          Never call the stream done after less than N ms of silence (default "
+              << CompletionPolicy::Config().min_idle_ms << ")\n"
+              << "  --resend-retries N       Extra attempts for a resend that times out or fails (default "
+              << CompletionPolicy::Config().max_retries << ")\n"
+              << "  --reorder-window N       Re-request a hole once the stream is N sequences past it (default "
+              << DEFAULT_REORDER_WINDOW << ")\n"
+              << "  --no-early-resend        Wait for the stream to finish before asking for any resends\n"
+              << "  --resend-protocol P      auto, legacy, wide or range (default auto: ask the server once the\n"
+              << "                           1-byte Call Type 2 isn't enough)\n"
+              << "  --persistent-resend      Send every resend request down one connection instead of one each\n"
+              << "  --pipeline-depth N       With --persistent-resend, max packets asked for but not back yet (default "
+              << ResendPipeline::DEFAULT_DEPTH << ")\n"
+              << "  --columnar PATH          Also write the packets to PATH as columns that can be mmap'd (see columnar_file.h)\n"
+              << "  --analytics PATH         Write per-symbol VWAP, buy/sell volume and high/low to PATH as JSON\n"
+              << "  --shm-publish PATH       Publish packets, in order, to a shared-memory ring at PATH (say /dev/shm/abx)\n"
+              << "  --shm-slots N            Slots in that ring, rounded up to a power of two (default "
+              << ShmFeedPublisher::DEFAULT_CAPACITY << ")\n"
+              << "  --order-book N           Rebuild each symbol's book from the packets and log its top N levels\n"
+              << "  --journal PATH           Log every received packet to PATH as it arrives\n"
+              << "  --resume                 Replay the --journal from an earlier run and only fetch what it's missing\n"
+              << "  --journal-sync S         never, always, or a number of ms between syncs to disk (default 100)\n"
+              << "  --help                   Show this message" << std::endl;
 }
 
-int main() {
-    // This map will hold all the packets we successfully receive, keyed by sequence number.
-    // std::map is awesome here because it keeps everything sorted by key (sequence)!
-    std::map<int32_t, Packet> received_packets;
-
-    int initial_socket = -1; // Our socket file descriptor for the first connection
-    struct sockaddr_in initial_server_addr; // Where the server lives
-
-    try {
-        // --- Stage 1 & 2: Connect and Ask for the Whole Stream ---
+// Returns false if the arguments don't make sense (usage has already been printed by then).
+bool parse_options(int argc, char** argv, ClientOptions& options) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--help") {
+            options.show_help = true;
+        } else if (arg == "--io-uring") {
+            options.use_io_uring = true;
+        } else if (arg == "--metrics-json" && i + 1 < argc) {
+            options.metrics_json_path = argv[++i];
+        } else if (arg == "--log-level" && i + 1 < argc) {
+            std::string level = argv[++i];
+            if (level == "debug") options.log_level = LogLevel::Debug;
+            else if (level == "info") options.log_level = LogLevel::Info;
+            else if (level == "warn") options.log_level = LogLevel::Warn;
+            else if (level == "error") options.log_level = LogLevel::Error;
+            else if (level == "off") options.log_level = LogLevel::Off;
+            else {
+                std::cerr << "Unknown log level '" << level << "'." << std::endl;
+                return false;
+            }
+        } else if (arg == "--endpoint" && i + 1 < argc) {
+            Endpoint endpoint;
+            if (!parse_endpoint(argv[++i], endpoint)) {
+                std::cerr << "--endpoint needs an IPv4 HOST:PORT, like 127.0.0.1:3000." << std::endl;
+                return false;
+            }
+            options.endpoints.push_back(endpoint);
+        } else if (arg == "--threaded") {
+            options.threaded = true;
+        } else if (arg == "--thread-cpus" && i + 1 < argc) {
+            int cpus[3];
+            char trailing;
+            if (std::sscanf(argv[++i], "%d,%d,%d%c", &cpus[0], &cpus[1], &cpus[2], &trailing) != 3) {
+                std::cerr << "--thread-cpus needs three CPU numbers, like 2,3,4 (-1 for any)." << std::endl;
+                return false;
+            }
+            options.threads.network_cpu = cpus[0];
+            options.threads.decode_cpu = cpus[1];
+            options.threads.output_cpu = cpus[2];
+        } else if (arg == "--fixed-timeouts") {
+            options.completion.adaptive = false;
+        } else if (arg == "--idle-jitter-multiple" && i + 1 < argc) {
+            const char* text = argv[++i];
+            char* end = nullptr;
+            double value = std::strtod(text, &end);
+            if (end == text || *end != '\0' || !(value > 0.0 && value <= 1000.0)) {
+                std::cerr << "--idle-jitter-multiple needs a number above 0 and at most 1000." << std::endl;
+                return false;
+            }
+            options.completion.jitter_multiple = value;
+        } else if (arg == "--min-idle-ms" && i + 1 < argc) {
+            const char* text = argv[++i];
+            char* end = nullptr;
+            long value = std::strtol(text, &end, 10);
+            if (end == text || *end != '\0' || value < 1) {
+                std::cerr << "--min-idle-ms needs a positive number." << std::endl;
+                return false;
+            }
+            options.completion.min_idle_ms = static_cast<uint64_t>(value);
+        } else if (arg == "--resend-retries" && i + 1 < argc) {
+            const char* text = argv[++i];
+            char* end = nullptr;
+            long value = std::strtol(text, &end, 10);
+            if (end == text || *end != '\0' || value < 0) {
+                std::cerr << "--resend-retries needs a number that isn't negative." << std::endl;
+                return false;
+            }
+            options.completion.max_retries = static_cast<int>(value);
+        } else if (arg == "--resend-protocol" && i + 1 < argc) {
+            std::string protocol = argv[++i];
+            if (protocol == "auto") options.resend_protocol = ResendProtocol::Auto;
+            else if (protocol == "legacy") options.resend_protocol = ResendProtocol::Legacy;
+            else if (protocol == "wide") options.resend_protocol = ResendProtocol::Wide;
+            else if (protocol == "range") options.resend_protocol = ResendProtocol::Range;
+            else {
+                std::cerr << "Unknown resend protocol '" << protocol << "'." << std::endl;
+                return false;
+            }
+        } else if (arg == "--columnar" && i + 1 < argc) {
+            options.columnar_path = argv[++i];
+        } else if (arg == "--shm-publish" && i + 1 < argc) {
+            options.shm_path = argv[++i];
+        } else if (arg == "--shm-slots" && i + 1 < argc) {
+            const char* text = argv[++i];
+            char* end = nullptr;
+            long value = std::strtol(text, &end, 10);
+            if (end == text || *end != '\0' || value < 2) {
+                std::cerr << "--shm-slots needs a number of at least 2 (it gets rounded up to a power of two)." << std::endl;
+                return false;
+            }
+            options.shm_slots = static_cast<size_t>(value);
+        } else if (arg == "--analytics" && i + 1 < argc) {
+            options.analytics_path = argv[++i];
+        } else if (arg == "--order-book" && i + 1 < argc) {
+            const char* text = argv[++i];
+            char* end = nullptr;
+            long value = std::strtol(text, &end, 10);
+            if (end == text || *end != '\0' || value < 1) {
+                std::cerr << "--order-book needs a positive number of levels." << std::endl;
+                return false;
+            }
+            options.order_book_depth = static_cast<size_t>(value);
+        } else if (arg == "--journal" && i + 1 < argc) {
+            options.journal_path = argv[++i];
+        } else if (arg == "--resume") {
+            options.resume = true;
+        } else if (arg == "--journal-sync" && i + 1 < argc) {
+            std::string sync = argv[++i];
+            if (sync == "never") {
+                options.journal_sync = CaptureJournal::SyncPolicy::Never;
+            } else if (sync == "always") {
+                options.journal_sync = CaptureJournal::SyncPolicy::Always;
+            } else {
+                char* end = nullptr;
+                long value = std::strtol(sync.c_str(), &end, 10);
+                if (sync.empty() || *end != '\0' || value < 1) {
+                    std::cerr << "--journal-sync needs never, always or a positive number of ms." << std::endl;
+                    return false;
+                }
+                options.journal_sync = CaptureJournal::SyncPolicy::Interval;
+                options.journal_sync_ms = static_cast<uint64_t>(value);
+            }
+        } else if (arg == "--persistent-resend") {
+            options.persistent_resend = true;
+        } else if (arg == "--pipeline-depth" && i + 1 < argc) {
+            const char* text = argv[++i];
+            char* end = nullptr;
+            long value = std::strtol(text, &end, 10);
+            if (end == text || *end != '\0' || value < 1) {
+                std::cerr << "--pipeline-depth needs a positive number." << std::endl;
+                return false;
+            }
+            options.pipeline_depth = static_cast<size_t>(value);
+        } else if (arg == "--no-early-resend") {
+            options.early_resend = false;
+        } else if (arg == "--reorder-window" && i + 1 < argc) {
+            const char* text = argv[++i];
+            char* end = nullptr;
+            long value = std::strtol(text, &end, 10);
+            if (end == text || *end != '\0' || value < 0 || value > PacketStore::MAX_SEQUENCE) {
+                std::cerr << "--reorder-window needs a number between 0 and " << PacketStore::MAX_SEQUENCE << "."
+                          << std::endl;
+                return false;
+            }
+            options.reorder_window = static_cast<int32_t>(value);
+        } else if (arg == "--resend-concurrency" && i + 1 < argc) {
+            const char* text = argv[++i];
+            char* end = nullptr;
+            long value = std::strtol(text, &end, 10);
+            if (end == text || *end != '\0' || value < 1) {
+                std::cerr << "--resend-concurrency needs a positive number." << std::endl;
+                return false;
+            }
+            options.resend_concurrency = static_cast<size_t>(value);
+        } else {
+            print_usage(argv[0]);
+            return false;
+        }
+    }
+    if (options.resume && options.journal_path.empty()) {
+        std::cerr << "--resume needs a --journal to resume from." << std::endl;
+        return false;
+    }
+    if (!options.endpoints.empty() && (!options.journal_path.empty() || !options.columnar_path.empty() ||
+                                       options.order_book_depth > 0 || !options.analytics_path.empty() ||
+                                       !options.shm_path.empty() || options.threaded || options.use_io_uring)) {
+        std::cerr << "--endpoint runs every session on the event loop, so it doesn't go with --journal, "
+                     "--columnar, --order-book, --analytics, --shm-publish, --threaded or --io-uring." << std::endl;
+        return false;
+    }
+    return true;
+}
 
-        // Step 1: Get a socket file descriptor
-        initial_socket = socket(AF_INET, SOCK_STREAM, 0);
-        if (initial_socket == -1) {
-            std::cerr << "Error creating initial socket! " << strerror(errno) << std::endl;
-            return 1; // Can't do much without a socket
+// Replays the packets in sequence order through an OrderBookEngine and logs each symbol's top
+// `depth` levels a side, best first.
+void log_order_books(const PacketStore& packets, size_t depth) {
+    OrderBookEngine books;
+    uint64_t started_ns = monotonic_ns();
+    packets.for_each([&](const Packet& packet) { books.apply(packet); });
+    double elapsed_ms = (monotonic_ns() - started_ns) / 1e6;
+    log_info("Order books: ", packets.size(), " updates over ", books.symbol_count(), " symbols in ", elapsed_ms,
+             " ms", (books.rejected() > 0 ? " (" + std::to_string(books.rejected()) + " with no side)" : std::string()),
+             ".");
+    for (uint32_t id = 0; id < books.symbol_count(); ++id) {
+        const OrderBook& book = books.book(id);
+        log_info("  ", books.symbol_name(id), ": ", book.bids().depth(), " bid levels, ", book.asks().depth(),
+                 " ask levels", (book.crossed() ? " (crossed)" : ""));
+        for (size_t i = 0; i < depth && (i < book.bids().depth() || i < book.asks().depth()); ++i) {
+            std::string bid = i < book.bids().depth()
+                ? std::to_string(book.bids().level(i).quantity) + " @ " + std::to_string(book.bids().level(i).price)
+                : "-";
+            std::string ask = i < book.asks().depth()
+                ? std::to_string(book.asks().level(i).quantity) + " @ " + std::to_string(book.asks().level(i).price)
+                : "-";
+            log_info("    ", i + 1, ". bid ", bid, " | ask ", ask);
         }
+    }
+}
 
-        // Let's set a receive timeout right away so we don't block forever.
-        struct timeval timeout;
-        timeout.tv_sec = RECEIVE_TIMEOUT_SEC; // Our chosen timeout
-        timeout.tv_usec = 0;
+int main(int argc, char** argv) {
+    ClientOptions options;
+    if (!parse_options(argc, argv, options)) {
+        return 1;
+    }
+    if (options.show_help) {
+        print_usage(argv[0]);
+        return 0;
+    }
+    set_log_level(options.log_level);
 
-        if (setsockopt(initial_socket, SOL_SOCKET, SO_RCVTIMEO, (const char*)&timeout, sizeof timeout) < 0) {
-            // It's usually okay if this fails, just means reads might block indefinitely if the server misbehaves.
-            std::cerr << "Warning: Couldn't set receive timeout on initial socket. " << strerror(errno) << std::endl;
-        } else {
-             std::cout << "Set initial socket receive timeout to " << RECEIVE_TIMEOUT_SEC << " seconds." << std::endl;
-        }
+    // This store will hold all the packets we successfully receive, indexed by sequence number.
+    // Sequences are dense and start at 1, so a flat array + bitmap keeps them sorted for free.
+    PacketStore received_packets;
+
+    // Where the time goes: connect, first byte, decode, resend round trips and JSON output.
+    RunMetrics metrics;
 
+    struct sockaddr_in server_addr; // Where the server lives
 
-        // Step 2: Fill in the server's address details
-        std::memset(&initial_server_addr, 0, sizeof(initial_server_addr)); // Clear it out first
-        initial_server_addr.sin_family = AF_INET; // We're using IPv4
+    try {
+        // Fill in the server's address details once - every connection we make uses the same ones.
+        std::memset(&server_addr, 0, sizeof(server_addr)); // Clear it out first
+        server_addr.sin_family = AF_INET; // We're using IPv4
         // Convert the port number to network byte order - important!
-        initial_server_addr.sin_port = htons(SERVER_PORT);
+        server_addr.sin_port = htons(SERVER_PORT);
 
         // Convert the human-readable IP address string to the binary format the struct needs.
-        if (inet_pton(AF_INET, SERVER_HOST_IP, &initial_server_addr.sin_addr) <= 0) {
-            std::cerr << "Oops! Invalid address or address not supported: " << SERVER_HOST_IP << std::endl;
-            close(initial_socket); // Clean up the socket we created
+        if (inet_pton(AF_INET, SERVER_HOST_IP, &server_addr.sin_addr) <= 0) {
+            log_error("Oops! Invalid address or address not supported: ", SERVER_HOST_IP);
             return 1;
         }
 
-        // Step 3: Time to connect!
-        std::cout << "Attempting connection to " << SERVER_HOST_IP << ":" << SERVER_PORT << " for the initial stream..." << std::endl;
-        if (connect(initial_socket, (struct sockaddr *)&initial_server_addr, sizeof(initial_server_addr)) < 0) {
-            std::cerr << "Connection failed! " << strerror(errno) << std::endl;
-            close(initial_socket);
+        // One event loop runs every connection from here on: the initial stream and all the resends.
+        // Each operation gets its own deadline, so nothing blocks waiting on a single slow socket.
+        EventLoop loop;
+        if (!loop.valid()) {
             return 1;
         }
-        std::cout << "Successfully connected for the initial stream!" << std::endl;
+        const int timeout_ms = RECEIVE_TIMEOUT_SEC * 1000;
+        // The fixed timeout is the ceiling; the policy decides how much of it we actually wait.
+        options.completion.max_idle_ms = static_cast<uint64_t>(timeout_ms);
+        options.completion.max_resend_ms = static_cast<uint64_t>(timeout_ms);
+        if (options.completion.min_idle_ms > options.completion.max_idle_ms) {
+            options.completion.min_idle_ms = options.completion.max_idle_ms;
+        }
+        CompletionPolicy completion(options.completion);
+
+        // Several endpoints: each gets a full session of its own, all sharing this loop.
+        if (!options.endpoints.empty()) {
+            SessionManager::Settings settings;
+            settings.connect_timeout_ms = timeout_ms;
+            settings.completion = options.completion;
+            settings.resend_concurrency = options.resend_concurrency;
+            settings.resend_protocol = options.resend_protocol;
+            settings.persistent_resend = options.persistent_resend;
+            settings.pipeline_depth = options.pipeline_depth;
+            settings.early_resend = options.early_resend;
+            settings.reorder_window = options.reorder_window;
+            SessionManager manager(loop, settings, metrics);
+            for (const Endpoint& endpoint : options.endpoints) {
+                manager.add(endpoint);
+            }
+            bool all_ok = manager.run();
+            log_flush();
+            metrics.print(std::cout);
+            if (!options.metrics_json_path.empty() && !metrics.write_json(options.metrics_json_path)) {
+                log_error("Couldn't write the metrics summary to ", options.metrics_json_path, ".");
+            }
+            return all_ok ? 0 : 1;
+        }
 
-        // Now, send the request to get all packets. The spec says it's just 1 byte with value 1.
-        unsigned char request_payload = 1; // Value 1 for Stream All Packets
-        ssize_t bytes_sent = send(initial_socket, &request_payload, 1, 0); // Flags usually 0 for TCP
+        // Optional io_uring backend. If the kernel can't do it we just stay on the epoll path.
+        std::unique_ptr<UringTransport> uring;
+        if (options.use_io_uring) {
+            uring.reset(new UringTransport());
+            uring->set_metrics(&metrics);
+            if (uring->ok()) {
+                log_info("Using the io_uring backend.");
+            } else {
+                log_error("io_uring backend not available (", uring->unavailable_reason(), "), falling back to epoll.");
+                uring.reset();
+            }
+        }
 
-        if (bytes_sent == -1) {
-            std::cerr << "Error sending 'Stream All Packets' request! " << strerror(errno) << std::endl;
-            close(initial_socket);
+        // output.json gets written as we go: once sequences 1..N are all in, they can't change any
+        // more, so they go straight to the file instead of waiting for every resend to finish.
+        JsonStreamWriter json_writer;
+        if (!json_writer.open("output.json")) {
+            log_error("Boo! Couldn't open output.json for writing. ", strerror(errno));
             return 1;
-        } else if (bytes_sent == 0) {
-             std::cerr << "Connection closed by peer before sending the initial request?" << std::endl;
-             close(initial_socket);
-             return 1;
-        } else if (bytes_sent < 1) {
-             // This shouldn't really happen for 1 byte on a good connection, but good to check.
-             std::cerr << "Warning: Sent " << bytes_sent << " bytes instead of 1 for the initial request." << std::endl;
-             close(initial_socket); // Treat unexpected send as an error
-             return 1;
-        } else { // bytes_sent == 1
-            std::cout << "Sent 'Stream All Packets' request (1 byte)." << std::endl;
         }
-
-
-        // --- Stage 3: Receive and Process the Data Stream ---
-        // We need a buffer to collect data as it comes in, since TCP is a stream and data might be chunked.
-        std::vector<char> receive_buffer;
-        // A temporary buffer to read chunks from the socket into before appending to the main buffer.
-        std::array<char, 1024> temp_buffer;
-
-        std::cout << "Receiving initial data stream..." << std::endl;
-
-        ssize_t bytes_read;
-        // Loop to keep reading data until the server closes the connection (recv returns 0),
-        // an error occurs (-1 with non-timeout errno), or our timeout hits (-1 with EAGAIN/EWOULDBLOCK).
-        while (true) {
-            bytes_read = recv(initial_socket, temp_buffer.data(), temp_buffer.size(), 0);
-
-            if (bytes_read > 0) {
-                // Got some data! Append it to our collection buffer.
-                receive_buffer.insert(receive_buffer.end(), temp_buffer.begin(), temp_buffer.begin() + bytes_read);
-
-                // Now, let's see if we have any complete packets in our buffer.
-                while (receive_buffer.size() >= PACKET_SIZE) {
-                    // Yes! We have at least one full packet. Parse the first one.
-                    Packet packet = parse_packet(receive_buffer, 0);
-
-                    // Store it in our map. The sequence number is the key.
-                    received_packets[packet.sequence] = packet;
-                    // Optional: See the packet details as we get them.
-                    // packet.print();
-
-                    // Remove the bytes we just processed from the front of the buffer.
-                    receive_buffer.erase(receive_buffer.begin(), receive_buffer.begin() + PACKET_SIZE);
-                    // The inner while loop continues to check if there's *another* full packet right after this one.
-                }
-            } else if (bytes_read == 0) {
-                // recv returning 0 means the server closed the connection gracefully.
-                std::cout << "Server closed the initial connection gracefully." << std::endl;
-                break; // We're done with the initial stream
-            } else { // bytes_read == -1
-                // An error or timeout occurred. Check errno.
-                if (errno == EAGAIN || errno == EWOULDBLOCK) {
-                    // This is the timeout we set! The server stopped sending data within the time limit.
-                    std::cerr << "Receive timeout reached for initial data stream. Proceeding with received data." << std::endl;
-                     // Break the loop here. We'll process any complete packets we got before the timeout.
-                     break;
-                } else {
-                    // A different kind of error happened during receiving.
-                    std::cerr << "A non-timeout error occurred during initial receiving: " << strerror(errno) << std::endl;
-                    // This might mean the connection broke unexpectedly.
-                    // For this test, we'll proceed with the data received up to this point.
-                    break; // Exit receive loop
-                }
+        PrefixCursor json_cursor;
+        // Per-symbol analytics and the shared-memory feed ride along with the JSON: each packet goes
+        // to them as it becomes final, in sequence order.
+        std::unique_ptr<SymbolAnalytics> analytics;
+        if (!options.analytics_path.empty()) {
+            analytics.reset(new SymbolAnalytics());
+        }
+        std::unique_ptr<ShmFeedPublisher> shm_feed;
+        if (!options.shm_path.empty()) {
+            shm_feed.reset(new ShmFeedPublisher());
+            if (!shm_feed->create(options.shm_path, options.shm_slots)) {
+                log_error("Couldn't create the shared-memory feed ", options.shm_path, ". ", strerror(errno));
+                json_writer.finish();
+                return 1;
             }
+            log_info("Publishing packets to ", options.shm_path, " (", shm_feed->capacity(), " slots).");
         }
-
-        // Done with the initial connection. Close the socket file descriptor.
-        close(initial_socket);
-        initial_socket = -1; // Mark as closed so we don't try to close it again.
-
-        std::cout << "Finished the initial data stream phase. Collected " << received_packets.size() << " packets so far." << std::endl;
-        // Note: If a timeout happened, we might not have received all packets from the initial stream.
-
-        // --- Stage 4 & 5: Find Missing Packets and Ask for Resends ---
-
-        // Find the highest sequence number we received. The problem guarantees the last one isn't missed in the *full* set.
-        int32_t max_sequence = 0;
-        if (!received_packets.empty()) {
-            max_sequence = received_packets.rbegin()->first; // rbegin() points to the last element (highest key) in the sorted map
+        auto on_final = [&](const Packet& packet) {
+            if (analytics) analytics->add(packet);
+            if (shm_feed) shm_feed->publish(packet);
+        };
+        ThreadedStream* output_stage = nullptr; // While a threaded stream runs, its output thread does the writing
+        auto emit_json_prefix = [&]() {
+            if (output_stage != nullptr) {
+                json_cursor.advance(received_packets, [&](const Packet& packet) {
+                    on_final(packet);
+                    output_stage->publish(packet);
+                });
+                return;
+            }
+            uint64_t started_ns = monotonic_ns();
+            size_t written = json_cursor.advance(received_packets, [&](const Packet& packet) {
+                on_final(packet);
+                json_writer.write_packet(packet);
+            });
+            if (written > 0) {
+                json_writer.flush();
+                metrics.json_emit.record((monotonic_ns() - started_ns) / written, written);
+            }
+        };
+
+        // Optional write-ahead journal: every packet goes in as it arrives, so a run that dies can be
+        // resumed. With --resume, whatever an earlier run caught is back in the store before we start.
+        std::unique_ptr<CaptureJournal> journal;
+        if (!options.journal_path.empty()) {
+            journal.reset(new CaptureJournal());
+            journal->set_sync_policy(options.journal_sync, options.journal_sync_ms);
+            if (!journal->open(options.journal_path, options.resume,
+                               [&](const Packet& packet) { received_packets.insert(packet); })) {
+                log_error("Couldn't open the journal ", options.journal_path, ". ",
+                          (errno == EINVAL ? "It isn't a capture journal." : strerror(errno)));
+                json_writer.finish();
+                return 1;
+            }
+            if (journal->replayed() > 0) {
+                log_info("Replayed ", journal->replayed(), " packets from ", options.journal_path, " (",
+                         received_packets.size(), " distinct).");
+                emit_json_prefix();
+            }
         }
-        std::cout << "Highest sequence number found in initial stream: " << max_sequence << std::endl;
-
-        // Build a list of all the sequence numbers we *should* have, but didn't get.
-        std::vector<int32_t> missing_sequences;
-        for (int32_t i = 1; i <= max_sequence; ++i) {
-            if (received_packets.find(i) == received_packets.end()) {
-                // If 'i' isn't a key in our map, it's missing!
-                missing_sequences.push_back(i);
-                // std::cout << "Hmm, sequence " << i << " seems to be missing." << std::endl; // Can get chatty if many are missing
+        bool journal_failed = false;
+        auto journal_commit = [&]() {
+            if (journal && !journal->commit() && !journal_failed) {
+                journal_failed = true; // Say it once; collection carries on without it
+                log_error("Writing to the journal failed, carrying on without it. ", strerror(journal->error()));
+            }
+        };
+
+        ResendEngine::PacketHandler store_packet = [&](const Packet& resent_packet) {
+            // Add/update this packet in our main collection.
+            bool already_had = received_packets.contains(resent_packet.sequence);
+            if (!received_packets.insert(resent_packet)) {
+                log_warn("  Warning: Resent packet has out-of-range sequence ", resent_packet.sequence, ", dropping it.");
+            } else if (journal && !already_had) { // Ranges bring back some we had; no need to log those twice
+                journal->append(resent_packet);
+                journal_commit();
             }
+            emit_json_prefix();
+        };
+
+        // On the epoll path resends share the loop with the stream, so holes can be chased while the
+        // rest of the stream is still arriving. The io_uring transport runs its phases one after the
+        // other, so there everything waits for Stage 4.
+        ResendEngine resend_engine(loop, server_addr, options.resend_concurrency, completion, store_packet);
+        resend_engine.set_metrics(&metrics);
+        resend_engine.set_protocol(options.resend_protocol);
+        std::unique_ptr<ResendPipeline> pipeline;
+        if (options.persistent_resend) {
+            pipeline.reset(new ResendPipeline(loop, server_addr, options.pipeline_depth, completion, store_packet));
+            pipeline->set_metrics(&metrics);
+            pipeline->set_protocol(options.resend_protocol);
         }
-        std::cout << "Identified " << missing_sequences.size() << " missing sequences that need resending." << std::endl;
-
-        // Time to go fetch those missing packets, one by one.
-        for (int32_t seq_to_resend : missing_sequences) {
-            std::cout << "Requesting resend for sequence: " << seq_to_resend << std::endl;
-
-            int resend_socket = -1; // A new socket for each resend request
-            struct sockaddr_in resend_server_addr; // Server address again
-
-            try {
-                // Step 1: Need a brand new connection for this resend.
-                resend_socket = socket(AF_INET, SOCK_STREAM, 0);
-                if (resend_socket == -1) {
-                    std::cerr << "  Error creating resend socket for seq " << seq_to_resend << "! " << strerror(errno) << std::endl;
-                    continue; // Skip this one and try the next missing seq
+        auto submit_resends = [&](const std::vector<int32_t>& sequences) {
+            if (pipeline) {
+                pipeline->submit(sequences);
+            } else {
+                resend_engine.submit(sequences);
+            }
+        };
+        // Early resends run on the event loop, so not while the store is being filled from another thread.
+        bool early_resend = options.early_resend && !uring && !options.threaded;
+        GapTracker gaps(options.reorder_window);
+        std::vector<int32_t> due_sequences;
+
+        // --- Stages 1, 2 & 3: Connect, Ask for the Whole Stream, and Receive It ---
+        // The transport frames and decodes each burst as it arrives; we just file the packets away.
+        StreamSession::BatchHandler store_batch = [&](const DecodedBatch& decoded) {
+            for (size_t i = 0; i < decoded.count; ++i) {
+                // Store it at its sequence number.
+                bool already_had = journal && received_packets.contains(decoded.sequence[i]);
+                if (!received_packets.insert(decoded.packet(i))) {
+                    log_warn("Warning: Ignoring packet with out-of-range sequence ", decoded.sequence[i], ".");
+                } else if (journal && !already_had) { // A resumed run streams what it replayed again
+                    journal->append(decoded.packet(i));
                 }
-
-                // Set the receive timeout for this resend socket too.
-                // Use the same timeout for consistency.
-                if (setsockopt(resend_socket, SOL_SOCKET, SO_RCVTIMEO, (const char*)&timeout, sizeof timeout) < 0) {
-                    std::cerr << "  Warning: Could not set receive timeout on resend socket for seq " << seq_to_resend << ". " << strerror(errno) << std::endl;
-                } else {
-                     std::cout << "  Set resend socket receive timeout to " << RECEIVE_TIMEOUT_SEC << " seconds." << std::endl;
+                // Optional: See the packet details as we get them (--log-level debug).
+                if (log_enabled(LogLevel::Debug)) {
+                    log_debug("  -> ", decoded.packet(i).describe());
                 }
-
-
-                // Step 2: Server address details are the same.
-                std::memset(&resend_server_addr, 0, sizeof(resend_server_addr));
-                resend_server_addr.sin_family = AF_INET;
-                resend_server_addr.sin_port = htons(SERVER_PORT);
-
-                if (inet_pton(AF_INET, SERVER_HOST_IP, &resend_server_addr.sin_addr) <= 0) {
-                    std::cerr << "  Invalid address/ Address not supported for resend: " << SERVER_HOST_IP << std::endl;
-                    close(resend_socket);
-                    continue;
+            }
+            journal_commit();
+            emit_json_prefix();
+            if (early_resend) {
+                due_sequences.clear();
+                gaps.observe(received_packets, due_sequences);
+                if (!due_sequences.empty()) {
+                    log_debug("  Stream is past ", due_sequences.size(), " holes, requesting them now.");
+                    submit_resends(due_sequences);
                 }
-
-                // Connect for this resend request.
-                std::cout << "  Connecting for resend request..." << std::endl;
-                if (connect(resend_socket, (struct sockaddr *)&resend_server_addr, sizeof(resend_server_addr)) < 0) {
-                    std::cerr << "  Resend connection failed for seq " << seq_to_resend << "! " << strerror(errno) << std::endl;
-                    close(resend_socket);
-                    continue;
+            }
+        };
+
+        StreamSession::Status stream_status;
+        size_t stream_bytes;
+        if (journal && journal->stream_max_sequence() > 0) {
+            // The stream has nothing left to tell us; holes get filled with resends below.
+            log_info("The journal already has a complete stream (up to seq ", journal->stream_max_sequence(),
+                     "), skipping it.");
+            stream_status = StreamSession::Completed;
+            stream_bytes = 0;
+        } else if (options.threaded) {
+            log_info("Attempting connection to ", SERVER_HOST_IP, ":", SERVER_PORT, " for the initial stream (",
+                     decoder_name(best_decoder()), " decoder, network / decode / output threads)...");
+            ThreadedStream stream(server_addr, timeout_ms, completion, options.threads);
+            stream.set_metrics(&metrics);
+            output_stage = &stream;
+            ThreadedStream::StreamResult result = stream.run(store_batch, [&](const Packet* packets, size_t count, bool caught_up) {
+                uint64_t started_ns = monotonic_ns();
+                for (size_t i = 0; i < count; ++i) {
+                    json_writer.write_packet(packets[i]);
                 }
-                std::cout << "  Successfully connected for resend." << std::endl;
-
-                // Now, build and send the resend request payload.
-                // Spec says it's 2 bytes: Call Type 2 (Resend) + the sequence number (1 byte).
-                // Note: The server reads the sequence number as an Int8 (1 byte).
-                // If sequence numbers go above 127/255, the server might misinterpret them.
-                // Assuming for this test they stay within 1-byte range based on sample data.
-                 if (seq_to_resend < 0 || seq_to_resend > 255) {
-                      std::cerr << "  Warning: Sequence number " << seq_to_resend << " is outside the usual 1-byte range (0-255) for the resend payload. The server might have trouble with this." << std::endl;
-                 }
-                unsigned char resend_payload[2] = {2, static_cast<unsigned char>(seq_to_resend)}; // Value 2 for Resend Packet
-
-                // Send the 2-byte request.
-                ssize_t bytes_sent_resend = send(resend_socket, resend_payload, 2, 0);
-
-                if (bytes_sent_resend == -1) {
-                    std::cerr << "  Error sending resend request for seq " << seq_to_resend << "! " << strerror(errno) << std::endl;
-                     close(resend_socket);
-                     continue;
-                } else if (bytes_sent_resend == 2) {
-                     std::cout << "  Sent resend request payload." << std::endl;
-                 } else {
-                     std::cerr << "  Warning: Sent " << bytes_sent_resend << " bytes instead of 2 for resend request for seq " << seq_to_resend << "." << std::endl;
-                     close(resend_socket); // Treat unexpected send as error
-                     continue;
-                 }
-
-
-                // Now, we expect exactly ONE packet (17 bytes) back from the server for this resend.
-                std::vector<char> resent_packet_data(PACKET_SIZE); // Buffer just for this single packet
-                size_t total_bytes_received = 0;
-                ssize_t current_bytes_read;
-
-                // Loop carefully to make sure we get all 17 bytes, handling partial reads and the timeout.
-                while (total_bytes_received < PACKET_SIZE) {
-                    current_bytes_read = recv(resend_socket,
-                                              // Read into the buffer starting from where we left off
-                                              resent_packet_data.data() + total_bytes_received,
-                                              // Only ask for the bytes we still need
-                                              PACKET_SIZE - total_bytes_received,
-                                              0);
-
-                    if (current_bytes_read == -1) {
-                        // Error or timeout on this receive call.
-                        if (errno == EAGAIN || errno == EWOULDBLOCK) {
-                             std::cerr << "  Receive timeout hit while getting resent packet for seq " << seq_to_resend << ". Didn't get the full packet." << std::endl;
-                             // Indicate failure to get the complete packet.
-                             total_bytes_received = 0;
-                        } else {
-                             // A different receive error.
-                             std::cerr << "  Error receiving resent packet for seq " << seq_to_resend << "! " << strerror(errno) << std::endl;
-                             total_bytes_received = 0; // Indicate failure
-                        }
-                        break; // Exit the inner while loop for this packet
-                    } else if (current_bytes_read == 0) {
-                        // Connection closed by server unexpectedly before sending the whole packet?
-                        std::cerr << "  Server closed connection prematurely while getting resent packet for seq " << seq_to_resend << ". Expected " << PACKET_SIZE << " bytes, but only got " << total_bytes_received << " so far." << std::endl;
-                        total_bytes_received = 0; // Indicate failure
-                        break; // Exit the inner while loop
-                    } else {
-                        // Got some bytes, update the total.
-                        total_bytes_received += current_bytes_read;
-                    }
+                if (caught_up) {
+                    json_writer.flush();
                 }
-
-                // If we successfully got all 17 bytes...
-                if (total_bytes_received == PACKET_SIZE) {
-                     std::cout << "  Got the resent packet (" << total_bytes_received << " bytes)." << std::endl;
-
-                    // Parse those 17 bytes into a Packet struct.
-                    Packet resent_packet = parse_packet(resent_packet_data, 0);
-
-                    // Quick check: Is this the packet we actually asked for?
-                    if (resent_packet.sequence != seq_to_resend) {
-                        std::cerr << "  Warning: Requested seq " << seq_to_resend << " but received packet has seq " << resent_packet.sequence << ". Data might be mixed up or corrupted." << std::endl;
-                        // We'll still store it by its *reported* sequence, but this is suspicious.
-                    }
-
-                    // Add/update this packet in our main collection.
-                    received_packets[resent_packet.sequence] = resent_packet;
-                    std::cout << "  Successfully added/updated sequence: " << resent_packet.sequence << " in our collection." << std::endl;
-                    // Optional: print the resent packet details.
-                    // resent_packet.print();
-
-                } // else: An error or timeout happened while receiving the resent packet, already handled/logged.
-
-
-            } catch (const std::exception& e) {
-                 // Catch any unexpected exceptions during the resend process for this sequence.
-                std::cerr << "  An unexpected issue came up during resend for seq " << seq_to_resend << ": " << e.what() << std::endl;
+                metrics.json_emit.record((monotonic_ns() - started_ns) / count, count);
+            });
+            output_stage = nullptr;
+            stream_status = result.status;
+            stream_bytes = result.bytes_received;
+        } else if (uring) {
+            log_info("Attempting connection to ", SERVER_HOST_IP, ":", SERVER_PORT,
+                     " for the initial stream (", decoder_name(best_decoder()), " decoder)...");
+            UringTransport::StreamResult result = uring->stream(server_addr, timeout_ms, completion, store_batch);
+            stream_status = result.status;
+            stream_bytes = result.bytes_received;
+        } else {
+            log_info("Attempting connection to ", SERVER_HOST_IP, ":", SERVER_PORT,
+                     " for the initial stream (", decoder_name(best_decoder()), " decoder)...");
+            StreamSession stream(loop, server_addr, timeout_ms, completion, store_batch);
+            stream.set_metrics(&metrics);
+            if (!stream.start()) {
+                return 1;
             }
-
-             // IMPORTANT: Close this resend connection! The spec says it's the client's job for Call Type 2.
-             // This needs to happen outside the inner try-catch to ensure it runs even if an exception happened,
-             // as long as the socket was successfully created before the exception.
-             if (resend_socket != -1) { // Check if the socket was valid to begin with
-                  close(resend_socket);
-                  resend_socket = -1; // Mark it as closed
-                  std::cout << "  Closed connection after resend." << std::endl;
-             }
+            loop.run_until([&]() { return stream.finished(); });
+            stream_status = stream.status();
+            stream_bytes = stream.bytes_received();
+        }
+        if (stream_status != StreamSession::Completed && stream_bytes == 0) {
+            // Never got anything at all (connection refused, connect timed out and the like) - nothing
+            // to work with.
+            // Still leave a well-formed (empty) array behind rather than a half-open one.
+            json_writer.finish();
+            return 1;
+        }
+        if (journal && stream_status == StreamSession::Completed && stream_bytes > 0) {
+            // The last packet always makes it into a complete stream, so this is the real end.
+            journal->mark_stream_complete(received_packets.max_sequence());
+            journal_commit();
         }
-        std::cout << "Finished trying to fetch missing packets. Total packets collected now: " << received_packets.size() << std::endl;
-
-        // --- Stage 6: Build and Write the Final JSON Output ---
-        std::cout << "Okay, all packets collected (hopefully!). Let's build that JSON file." << std::endl;
 
-        std::string json_output_string = "[\n"; // JSON array starts here
+        log_info("Finished the initial data stream phase. Collected ", received_packets.size(), " packets so far.");
+        // Note: If a timeout happened, we might not have received all packets from the initial stream.
 
-        bool first_packet = true;
-        // Iterate through our map. It's already sorted by sequence number, which is exactly what we need for the JSON array order.
-        for (const auto& pair : received_packets) {
-            const Packet& packet = pair.second; // The actual packet data
+        // --- Stage 4 & 5: Find Missing Packets and Ask for Resends ---
 
-            // Add a comma and newline before adding the next object, unless it's the very first one.
-            if (!first_packet) {
-                json_output_string += ",\n";
+        // Find the highest sequence number we received. The problem guarantees the last one isn't missed in the *full* set.
+        int32_t max_sequence = received_packets.max_sequence(); // 0 if we got nothing at all
+        log_info("Highest sequence number found in initial stream: ", max_sequence);
+
+        // Build a list of all the sequence numbers we *should* have, but didn't get, leaving out the
+        // ones already requested while the stream was running.
+        // The store scans its bitmap 64 sequences at a time, so this is cheap even for long streams.
+        std::vector<int32_t> missing_sequences = gaps.remaining(received_packets);
+        size_t early_requests = gaps.requested_count();
+        log_info("Identified ", missing_sequences.size(), " missing sequences that need resending (",
+                 early_requests, " more already requested during the stream).");
+
+        // Time to go fetch those missing packets. Each one still needs its own connection, but the
+        // resend engine keeps several of them in flight at once instead of going one by one.
+        if (!missing_sequences.empty() || early_requests > 0) {
+            if (pipeline) {
+                log_info("Requesting resends over one connection, up to ", options.pipeline_depth, " at a time...");
+            } else {
+                log_info("Requesting resends with up to ", options.resend_concurrency, " connections in flight...");
             }
-            first_packet = false; // After the first one, this will always be false.
-
-            // Start of a JSON object for this packet, add some indentation for readability ("pretty printing").
-            json_output_string += "    {\n"; // Indent 4 spaces
 
-            // Add the key-value pairs for the packet.
-            // Remember to put quotes around keys and string values! Numbers don't get quotes.
-            // Also, trim any trailing spaces/nulls from the symbol string.
-            std::string symbol_str = packet.symbol;
-            // Find the position of the last character that is NOT a space or a null terminator.
-            size_t last_char_pos = symbol_str.find_last_not_of(" \0");
-            if (std::string::npos != last_char_pos) {
-                // If we found a non-whitespace/non-null character, trim the string up to that point.
-                symbol_str = symbol_str.substr(0, last_char_pos + 1);
+            ResendEngine::Report resend_report;
+            ResendProtocol protocol_used;
+            if (pipeline) {
+                // Runs on the epoll loop even with --io-uring: it's one socket, there's nothing to batch.
+                pipeline->submit(missing_sequences);
+                loop.run_until([&]() { return pipeline->idle(); });
+                resend_report = pipeline->report();
+                protocol_used = pipeline->protocol();
+            } else if (uring) {
+                // The io_uring path doesn't negotiate by itself; let the engine ask on the loop first.
+                if (resend_engine.needs_probe(missing_sequences)) {
+                    resend_engine.probe();
+                    loop.run_until([&]() { return resend_engine.idle(); });
+                }
+                resend_report = uring->resend(server_addr, missing_sequences, options.resend_concurrency,
+                                              resend_engine.protocol(), completion, store_packet);
+                protocol_used = resend_engine.protocol();
             } else {
-                // If the string was all spaces or nulls, make it an empty string for JSON.
-                symbol_str.clear();
+                resend_engine.submit(missing_sequences); // Early ones may still be in flight too
+                loop.run_until([&]() { return resend_engine.idle(); });
+                resend_report = resend_engine.report();
+                protocol_used = resend_engine.protocol();
             }
 
-            json_output_string += "        \"symbol\": \"" + symbol_str + "\",\n"; // Symbol is a string
-            // Indicator is a single character, represent it as a string in JSON.
-            json_output_string += "        \"buysell_indicator\": \"" + std::string(1, packet.buysell_indicator) + "\",\n";
-            // Quantity, price, and sequence are numbers, use std::to_string to convert.
-            json_output_string += "        \"quantity\": " + std::to_string(packet.quantity) + ",\n";
-            json_output_string += "        \"price\": " + std::to_string(packet.price) + ",\n";
-            json_output_string += "        \"packetSequence\": " + std::to_string(packet.sequence) + "\n"; // No comma after the last field in the object
-
-            // End of the JSON object for this packet.
-            json_output_string += "    }";
+            // Ranges can bring back packets we already had, so count from the store rather than the report.
+            size_t asked_for = missing_sequences.size() + early_requests;
+            size_t still_missing = received_packets.missing_sequences().size();
+            // A wrong resent packet can raise the max sequence and with it the holes counted, so clamp.
+            size_t recovered = still_missing < asked_for ? asked_for - still_missing : 0;
+            log_info("Recovered ", recovered, " of ", asked_for, " missing packets in ",
+                     resend_report.wall_seconds * 1000.0, " ms using ", resend_report.requests, " ",
+                     resend_protocol_name(protocol_used), " requests (peak ", resend_report.peak_in_flight,
+                     (pipeline ? " packets outstanding, " : " connections in flight, "), resend_report.retries,
+                     " retries, ", still_missing, " failed).");
+            if (protocol_used == ResendProtocol::Legacy && max_sequence > LEGACY_MAX_SEQUENCE) {
+                log_warn("  Warning: Sequence numbers go up to ", max_sequence, ", but the 1-byte resend payload is read as "
+                         "an Int8 (up to ", LEGACY_MAX_SEQUENCE, "). Resends above that were probably answered with "
+                         "the wrong packets.");
+            }
+        }
+        log_info("Finished trying to fetch missing packets. Total packets collected now: ", received_packets.size());
+        if (journal && !journal->close_journal() && !journal_failed) {
+            log_error("Closing the journal failed. ", strerror(journal->error()));
         }
 
-        json_output_string += "\n]\n"; // End of the JSON array
-
-        // Write the whole JSON string to the output file.
-        std::ofstream output_file("output.json");
-        if (output_file.is_open()) {
-            output_file << json_output_string;
-            output_file.close();
-            std::cout << "Success! Output written to output.json" << std::endl;
+        // --- Stage 6: Finish the JSON Output ---
+        log_info("Okay, all packets collected (hopefully!). Let's finish that JSON file.");
+
+        // Everything up to the first hole that never got filled is in the file already. The rest
+        // goes out in sequence order too, just with the unrecoverable ones left out.
+        size_t written_before = json_writer.packets_written();
+        uint64_t started_ns = monotonic_ns();
+        json_cursor.finish(received_packets, [&](const Packet& packet) {
+            on_final(packet);
+            json_writer.write_packet(packet);
+        });
+        if (shm_feed) {
+            shm_feed->finish();
+            log_info("Shared-memory feed ", options.shm_path, " finished after ", shm_feed->published(), " packets.");
+        }
+        bool json_ok = json_writer.finish();
+        size_t written = json_writer.packets_written() - written_before;
+        if (written > 0) {
+            metrics.json_emit.record((monotonic_ns() - started_ns) / written, written);
+        }
+        if (json_ok) {
+            log_info("Success! Output written to output.json");
         } else {
-            std::cerr << "Boo! Couldn't open output.json for writing. " << strerror(errno) << std::endl;
+            log_error("Boo! Couldn't write output.json. ", strerror(errno));
             return 1; // Indicate failure
         }
+        if (!options.columnar_path.empty()) {
+            // Same packets, same order; columns need the final count up front, so this one goes at the end.
+            ColumnarWriter columnar;
+            received_packets.for_each([&](const Packet& packet) { columnar.append(packet); });
+            if (!columnar.finish(options.columnar_path)) {
+                log_error("Couldn't write ", options.columnar_path, ". ", strerror(errno));
+                return 1;
+            }
+            log_info("Columnar copy written to ", options.columnar_path, " (", columnar.size(), " packets, ",
+                     columnar.symbol_count(), " symbols).");
+        }
+        if (analytics) {
+            if (!analytics->write_json(options.analytics_path)) {
+                log_error("Couldn't write the analytics summary to ", options.analytics_path, ". ", strerror(errno));
+                return 1;
+            }
+            log_info("Analytics for ", analytics->symbol_count(), " symbols written to ", options.analytics_path, ".");
+        }
+        if (options.order_book_depth > 0) {
+            log_order_books(received_packets, options.order_book_depth);
+        }
+
+        // --- Run Summary ---
+        log_flush(); // Everything queued so far goes out before we write to stdout directly
+        metrics.print(std::cout);
+        if (!options.metrics_json_path.empty() && !metrics.write_json(options.metrics_json_path)) {
+            log_error("Couldn't write the metrics summary to ", options.metrics_json_path, ".");
+        }
 
     } catch (const std::exception& e) {
         // Catch any major exceptions that somehow slipped through (unlikely with careful error handling).
-        std::cerr << "An unexpected critical error occurred: " << e.what() << std::endl;
-         // Just in case, try to close the initial socket if it was somehow left open.
-        if (initial_socket != -1) {
-             close(initial_socket);
-        }
+        log_error("An unexpected critical error occurred: ", e.what());
+        // Any sockets still open get closed by the session/engine destructors on the way out.
         return 1; // Indicate failure
     }
 
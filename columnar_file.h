@@ -0,0 +1,316 @@
+#ifndef ABX_COLUMNAR_FILE_H
+#define ABX_COLUMNAR_FILE_H
+
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <climits>  // IOV_MAX
+#include <cstddef>
+#include <cstdint>
+#include <cstring>  // memcpy, memcmp
+#include <cerrno>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "packet.h"
+#include "symbol_table.h"
+
+// A column-oriented binary copy of output.json: the same packets in the same order, but laid out so
+// a reader can mmap the file and use the columns as plain arrays, with nothing to parse.
+//
+// File layout. Integers are in the writer's byte order (little-endian on anything we run on), and
+// `byte_order` lets a reader on the other kind notice and refuse:
+//
+//     offset 0   ColumnarHeader (72 bytes)
+//            -   symbols:   symbol_count raw 4-byte codes, as in Packet::symbol
+//            -   sequence:  int32[count]
+//            -   price:     int32[count]
+//            -   quantity:  int32[count]
+//            -   side:      char[count], 'B' or 'S'
+//            -   symbol id: uint16[count], index into symbols
+//
+// Every section starts on a COLUMNAR_ALIGNMENT boundary at the offset the header gives for it, so the
+// columns can be read (and vectorised over) in place.
+
+const size_t COLUMNAR_ALIGNMENT = 64;
+const uint16_t COLUMNAR_VERSION = 1;
+const uint32_t COLUMNAR_BYTE_ORDER = 0x01020304;
+const size_t COLUMNAR_MAX_SYMBOLS = 65536; // Symbol ids are uint16
+
+struct ColumnarHeader {
+    char magic[4];             // "ABXC"
+    uint16_t version;          // COLUMNAR_VERSION
+    uint16_t header_size;      // sizeof(ColumnarHeader)
+    uint32_t byte_order;       // COLUMNAR_BYTE_ORDER as the writer saw it
+    uint32_t symbol_count;
+    uint64_t count;            // Packets
+    uint64_t symbols_offset;
+    uint64_t sequence_offset;
+    uint64_t price_offset;
+    uint64_t quantity_offset;
+    uint64_t side_offset;
+    uint64_t symbol_id_offset;
+};
+
+static_assert(sizeof(ColumnarHeader) == 72, "ColumnarHeader layout changed - bump COLUMNAR_VERSION");
+
+// ColumnarWriter collects packets into columns as they're appended (14 bytes each, plus the symbol
+// dictionary) and writes the whole file in finish(), since the header needs the final count.
+class ColumnarWriter {
+public:
+    ColumnarWriter() : too_many_symbols_(false) {}
+
+    // Packets have to come in the order they should appear in the file.
+    void append(const Packet& packet) {
+        uint32_t id = symbols_.intern(packet.symbol);
+        if (id >= COLUMNAR_MAX_SYMBOLS) {
+            too_many_symbols_ = true;
+            return;
+        }
+        sequence_.push_back(packet.sequence);
+        price_.push_back(packet.price);
+        quantity_.push_back(packet.quantity);
+        side_.push_back(packet.buysell_indicator);
+        symbol_id_.push_back(static_cast<uint16_t>(id));
+    }
+
+    // Writes everything appended so far to `path` (created or truncated). False with errno set on
+    // failure; EOVERFLOW if there were more distinct symbols than a uint16 id can tell apart.
+    bool finish(const std::string& path) const {
+        if (too_many_symbols_) {
+            errno = EOVERFLOW;
+            return false;
+        }
+        size_t count = sequence_.size();
+        std::vector<uint32_t> codes(symbols_.size());
+        for (size_t id = 0; id < codes.size(); ++id) {
+            codes[id] = symbols_.code_of(static_cast<uint32_t>(id));
+        }
+
+        ColumnarHeader header = {};
+        std::memcpy(header.magic, "ABXC", 4);
+        header.version = COLUMNAR_VERSION;
+        header.header_size = sizeof(ColumnarHeader);
+        header.byte_order = COLUMNAR_BYTE_ORDER;
+        header.symbol_count = static_cast<uint32_t>(codes.size());
+        header.count = count;
+
+        // Each section, then enough zeroes to bring the next one up to the alignment.
+        static const unsigned char padding[COLUMNAR_ALIGNMENT] = {};
+        std::vector<iovec> parts;
+        uint64_t offset = 0;
+        auto add = [&](const void* data, size_t size) {
+            parts.push_back(iovec{const_cast<void*>(data), size});
+            offset += size;
+            size_t pad = static_cast<size_t>((COLUMNAR_ALIGNMENT - offset % COLUMNAR_ALIGNMENT) % COLUMNAR_ALIGNMENT);
+            if (pad > 0) {
+                parts.push_back(iovec{const_cast<unsigned char*>(padding), pad});
+                offset += pad;
+            }
+            return offset;
+        };
+        header.symbols_offset = add(&header, sizeof(header));
+        header.sequence_offset = add(codes.data(), codes.size() * sizeof(uint32_t));
+        header.price_offset = add(sequence_.data(), count * sizeof(int32_t));
+        header.quantity_offset = add(price_.data(), count * sizeof(int32_t));
+        header.side_offset = add(quantity_.data(), count * sizeof(int32_t));
+        header.symbol_id_offset = add(side_.data(), count);
+        add(symbol_id_.data(), count * sizeof(uint16_t));
+
+        int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (fd == -1) {
+            return false;
+        }
+        bool ok = write_parts(fd, parts);
+        int saved = errno;
+        if (close(fd) != 0 && ok) {
+            return false;
+        }
+        errno = saved;
+        return ok;
+    }
+
+    size_t size() const { return sequence_.size(); }
+    size_t symbol_count() const { return symbols_.size(); }
+
+private:
+    // writev() until everything is out, picking up after short writes.
+    static bool write_parts(int fd, std::vector<iovec>& parts) {
+        size_t next = 0;
+        while (next < parts.size()) {
+            int batch = static_cast<int>(std::min<size_t>(parts.size() - next, IOV_MAX));
+            ssize_t written = writev(fd, parts.data() + next, batch);
+            if (written < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                return false;
+            }
+            size_t left = static_cast<size_t>(written);
+            while (next < parts.size() && left >= parts[next].iov_len) {
+                left -= parts[next].iov_len;
+                ++next;
+            }
+            if (left > 0) {
+                parts[next].iov_base = static_cast<char*>(parts[next].iov_base) + left;
+                parts[next].iov_len -= left;
+            }
+        }
+        return true;
+    }
+
+    SymbolTable symbols_;
+    std::vector<int32_t> sequence_;
+    std::vector<int32_t> price_;
+    std::vector<int32_t> quantity_;
+    std::vector<char> side_;
+    std::vector<uint16_t> symbol_id_;
+    bool too_many_symbols_;
+};
+
+// ColumnarReader maps a file written by ColumnarWriter and hands out its columns as arrays pointing
+// straight into the mapping. Nothing is copied or parsed; pages come in as the columns are touched.
+//
+//     ColumnarReader reader;
+//     if (reader.open("output.abxc")) {
+//         int64_t notional = 0;
+//         for (size_t i = 0; i < reader.size(); ++i) {
+//             notional += int64_t(reader.prices()[i]) * reader.quantities()[i];
+//         }
+//     }
+class ColumnarReader {
+public:
+    ColumnarReader() : base_(nullptr), length_(0), header_(nullptr) {}
+    ~ColumnarReader() { close_file(); }
+
+    ColumnarReader(const ColumnarReader&) = delete;
+    ColumnarReader& operator=(const ColumnarReader&) = delete;
+
+    // Maps `path` read-only. False with errno set on failure - EINVAL if it isn't a columnar file this
+    // reader understands (wrong magic, version or byte order, or sections that run past the end).
+    bool open(const std::string& path) {
+        close_file();
+        int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd == -1) {
+            return false;
+        }
+        struct stat info;
+        if (fstat(fd, &info) != 0) {
+            int saved = errno;
+            close(fd);
+            errno = saved;
+            return false;
+        }
+        length_ = static_cast<size_t>(info.st_size);
+        if (length_ < sizeof(ColumnarHeader)) {
+            close(fd);
+            errno = EINVAL;
+            return false;
+        }
+        void* mapped = mmap(nullptr, length_, PROT_READ, MAP_PRIVATE, fd, 0);
+        int saved = errno;
+        close(fd); // The mapping keeps the file alive
+        if (mapped == MAP_FAILED) {
+            length_ = 0;
+            errno = saved;
+            return false;
+        }
+        base_ = static_cast<const unsigned char*>(mapped);
+        header_ = reinterpret_cast<const ColumnarHeader*>(base_);
+        if (!valid()) {
+            close_file();
+            errno = EINVAL;
+            return false;
+        }
+        // The usual scan is front to back over a column or two.
+        madvise(const_cast<unsigned char*>(base_), length_, MADV_SEQUENTIAL);
+        return true;
+    }
+
+    void close_file() {
+        if (base_ != nullptr) {
+            munmap(const_cast<unsigned char*>(base_), length_);
+        }
+        base_ = nullptr;
+        length_ = 0;
+        header_ = nullptr;
+    }
+
+    size_t size() const { return header_ ? static_cast<size_t>(header_->count) : 0; }
+    size_t symbol_count() const { return header_ ? header_->symbol_count : 0; }
+    size_t file_size() const { return length_; }
+
+    // The columns, size() entries each, in sequence order.
+    const int32_t* sequences() const { return column<int32_t>(header_->sequence_offset); }
+    const int32_t* prices() const { return column<int32_t>(header_->price_offset); }
+    const int32_t* quantities() const { return column<int32_t>(header_->quantity_offset); }
+    const char* sides() const { return column<char>(header_->side_offset); }
+    const uint16_t* symbol_ids() const { return column<uint16_t>(header_->symbol_id_offset); }
+
+    // The symbol dictionary: raw 4-byte code (Packet::symbol) and trimmed name for an id. An id the
+    // dictionary doesn't have (a damaged file) comes back as four spaces rather than a read past it.
+    uint32_t symbol_code(uint16_t id) const {
+        if (id >= header_->symbol_count) {
+            return ::symbol_code("    ");
+        }
+        return column<uint32_t>(header_->symbols_offset)[id];
+    }
+    std::string symbol_name(uint16_t id) const {
+        uint32_t code = symbol_code(id);
+        const char* bytes = reinterpret_cast<const char*>(&code);
+        size_t length = 4;
+        while (length > 0 && bytes[length - 1] == ' ') {
+            --length;
+        }
+        return std::string(bytes, length);
+    }
+
+    // Row `i` put back together, for code that wants whole packets.
+    Packet packet(size_t i) const {
+        Packet packet = {};
+        packet.symbol = symbol_code(symbol_ids()[i]);
+        packet.quantity = quantities()[i];
+        packet.price = prices()[i];
+        packet.sequence = sequences()[i];
+        packet.buysell_indicator = sides()[i];
+        return packet;
+    }
+
+private:
+    template <typename T>
+    const T* column(uint64_t offset) const { return reinterpret_cast<const T*>(base_ + offset); }
+
+    bool valid() const {
+        const ColumnarHeader& h = *header_;
+        if (std::memcmp(h.magic, "ABXC", 4) != 0 || h.version != COLUMNAR_VERSION ||
+            h.header_size != sizeof(ColumnarHeader) || h.byte_order != COLUMNAR_BYTE_ORDER ||
+            h.symbol_count > COLUMNAR_MAX_SYMBOLS || h.count > length_) {
+            return false;
+        }
+        uint64_t count = h.count;
+        if (!section_fits(h.symbols_offset, uint64_t(h.symbol_count) * sizeof(uint32_t)) ||
+            !section_fits(h.sequence_offset, count * sizeof(int32_t)) ||
+            !section_fits(h.price_offset, count * sizeof(int32_t)) ||
+            !section_fits(h.quantity_offset, count * sizeof(int32_t)) ||
+            !section_fits(h.side_offset, count) ||
+            !section_fits(h.symbol_id_offset, count * sizeof(uint16_t))) {
+            return false;
+        }
+        return true;
+    }
+
+    bool section_fits(uint64_t offset, uint64_t size) const {
+        return offset % COLUMNAR_ALIGNMENT == 0 && offset >= sizeof(ColumnarHeader) && offset <= length_ &&
+               size <= length_ - offset;
+    }
+
+    const unsigned char* base_;
+    size_t length_;
+    const ColumnarHeader* header_;
+};
+
+#endif // ABX_COLUMNAR_FILE_H
@@ -0,0 +1,130 @@
+#ifndef ABX_COMPLETION_POLICY_H
+#define ABX_COMPLETION_POLICY_H
+
+#include <cstdint>
+
+#include "metrics.h" // monotonic_ns()
+
+// CompletionPolicy decides how long to wait before giving up on the stream or on a resend, based on
+// what the connection has actually been doing instead of a flat 5 seconds.
+//
+// - Stream: we keep an EWMA of the gap between bursts and of how much that gap varies (same
+//   smoothing as TCP's RTT estimator, RFC 6298). The stream is declared finished once it's been
+//   quiet for `jitter_multiple` times (mean gap + 4 x deviation). On loopback that bottoms out at
+//   min_idle_ms; on a bursty WAN link it stretches out by itself.
+// - Resends: every resend round trip (connect -> packet back) feeds a second estimator, seeded from
+//   the stream's connect time. A resend's deadline is the usual RTO (srtt + 4 x rttvar), doubled for
+//   each retry, and a resend that times out or fails gets `max_retries` more attempts.
+//
+// Everything is clamped to [min, max], with max being the old fixed timeout, so the adaptive policy
+// never waits longer than the fixed one did. With `adaptive` off it behaves exactly like the fixed
+// timeouts: max idle, max resend deadline, no retries.
+class CompletionPolicy {
+public:
+    struct Config {
+        bool adaptive = true;
+        double jitter_multiple = 8.0;
+        uint64_t min_idle_ms = 50;
+        uint64_t max_idle_ms = 5000;
+        uint64_t min_resend_ms = 20;
+        uint64_t max_resend_ms = 5000;
+        int max_retries = 3;
+    };
+
+    explicit CompletionPolicy(const Config& config)
+        : config_(config),
+          last_arrival_us_(0),
+          gap_samples_(0),
+          gap_mean_us_(0.0),
+          gap_dev_us_(0.0),
+          rtt_samples_(0),
+          srtt_us_(0.0),
+          rttvar_us_(0.0) {}
+
+    const Config& config() const { return config_; }
+
+    // --- Stream side ---
+
+    // Call whenever stream data shows up.
+    void on_stream_data() {
+        uint64_t now_us = monotonic_ns() / 1000;
+        if (last_arrival_us_ != 0) {
+            smooth(static_cast<double>(now_us - last_arrival_us_), gap_samples_, gap_mean_us_, gap_dev_us_);
+        }
+        last_arrival_us_ = now_us;
+    }
+
+    // How long the stream may stay quiet before we call it done.
+    uint64_t idle_timeout_ms() const {
+        if (!config_.adaptive || gap_samples_ < MIN_GAP_SAMPLES) {
+            return config_.max_idle_ms; // Not enough to go on yet
+        }
+        double wait_us = config_.jitter_multiple * (gap_mean_us_ + 4.0 * gap_dev_us_);
+        return clamp_ms(wait_us, config_.min_idle_ms, config_.max_idle_ms);
+    }
+
+    // --- Resend side ---
+
+    // A connect round trip (SYN -> SYN/ACK) seeds the resend estimator before any resend has finished:
+    // a resend is a connect plus one request/response, so about two of those.
+    void on_connect_rtt(uint64_t rtt_ns) {
+        if (rtt_samples_ == 0) {
+            on_resend_rtt(2 * rtt_ns);
+        }
+    }
+
+    void on_resend_rtt(uint64_t rtt_ns) {
+        smooth(static_cast<double>(rtt_ns) / 1000.0, rtt_samples_, srtt_us_, rttvar_us_);
+    }
+
+    // Deadline for the given attempt (0 = first try).
+    uint64_t resend_timeout_ms(int attempt) const {
+        if (!config_.adaptive || rtt_samples_ == 0) {
+            return config_.max_resend_ms;
+        }
+        double rto_us = srtt_us_ + 4.0 * rttvar_us_;
+        for (int i = 0; i < attempt; ++i) {
+            rto_us *= 2.0; // Exponential backoff
+        }
+        return clamp_ms(rto_us, config_.min_resend_ms, config_.max_resend_ms);
+    }
+
+    // Whether a resend that just failed on `attempt` gets another go.
+    bool should_retry(int attempt) const { return config_.adaptive && attempt < config_.max_retries; }
+
+private:
+    static const uint64_t MIN_GAP_SAMPLES = 4;
+
+    // RFC 6298 smoothing: first sample sets the mean, then mean moves 1/8 and deviation 1/4 of the way.
+    static void smooth(double sample, uint64_t& samples, double& mean, double& dev) {
+        if (samples == 0) {
+            mean = sample;
+            dev = sample / 2.0;
+        } else {
+            double diff = sample > mean ? sample - mean : mean - sample;
+            dev += (diff - dev) / 4.0;
+            mean += (sample - mean) / 8.0;
+        }
+        ++samples;
+    }
+
+    static uint64_t clamp_ms(double us, uint64_t min_ms, uint64_t max_ms) {
+        uint64_t ms = static_cast<uint64_t>(us / 1000.0 + 0.999);
+        if (ms < min_ms) return min_ms;
+        if (ms > max_ms) return max_ms;
+        return ms;
+    }
+
+    Config config_;
+
+    uint64_t last_arrival_us_;
+    uint64_t gap_samples_;
+    double gap_mean_us_;
+    double gap_dev_us_;
+
+    uint64_t rtt_samples_;
+    double srtt_us_;
+    double rttvar_us_;
+};
+
+#endif // ABX_COMPLETION_POLICY_H
@@ -0,0 +1,159 @@
+#ifndef ABX_EVENT_LOOP_H
+#define ABX_EVENT_LOOP_H
+
+#include <vector>
+#include <memory>
+#include <functional>
+#include <chrono>
+#include <cstdint>
+#include <cstring>  // strerror, memset
+#include <cerrno>
+
+#include <sys/epoll.h>      // Linux only
+#include <unistd.h>
+
+#include "timer_wheel.h"
+#include "logger.h"
+
+// EventLoop is the single-threaded core that drives every socket the client has open: the initial
+// stream connection and all the resend connections.
+//
+// Sockets are registered edge-triggered, so a handler gets called once per "something new happened"
+// and is expected to read/write until it hits EAGAIN. Deadlines live in a TimerWheel instead of in
+// SO_RCVTIMEO, so a socket that's gone quiet only ever holds up its own operation - everyone else
+// keeps getting serviced, and the loop sleeps exactly until the next thing is due.
+class EventLoop {
+public:
+    typedef std::function<void(uint32_t events)> IoHandler;
+    typedef TimerWheel::TimerId TimerId;
+
+    EventLoop() : epoll_fd_(epoll_create1(EPOLL_CLOEXEC)), started_(Clock::now()), timers_(0) {
+        if (epoll_fd_ == -1) {
+            log_error("Error creating epoll instance! ", strerror(errno));
+        }
+    }
+
+    ~EventLoop() {
+        if (epoll_fd_ != -1) {
+            close(epoll_fd_);
+        }
+    }
+
+    EventLoop(const EventLoop&) = delete;
+    EventLoop& operator=(const EventLoop&) = delete;
+
+    bool valid() const { return epoll_fd_ != -1; }
+
+    // Starts watching `fd` for `events` (EPOLLIN/EPOLLOUT/...; EPOLLET is added for you).
+    bool add(int fd, uint32_t events, IoHandler handler) {
+        if (fd < 0) {
+            return false;
+        }
+        if (static_cast<size_t>(fd) >= handlers_.size()) {
+            handlers_.resize(static_cast<size_t>(fd) + 1);
+        }
+        Registration& registration = handlers_[fd];
+        ++registration.generation;
+        registration.handler = std::make_shared<IoHandler>(std::move(handler));
+        if (!control(EPOLL_CTL_ADD, fd, events)) {
+            registration.handler.reset();
+            return false;
+        }
+        return true;
+    }
+
+    // Changes which events `fd` is watched for (it has to be registered already).
+    bool modify(int fd, uint32_t events) {
+        if (fd < 0 || static_cast<size_t>(fd) >= handlers_.size() || !handlers_[fd].handler) {
+            return false;
+        }
+        return control(EPOLL_CTL_MOD, fd, events);
+    }
+
+    // Stops watching `fd`. Call this before closing it. Safe from inside the fd's own handler.
+    void remove(int fd) {
+        if (fd < 0 || static_cast<size_t>(fd) >= handlers_.size() || !handlers_[fd].handler) {
+            return;
+        }
+        epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, fd, nullptr);
+        handlers_[fd].handler.reset();
+        ++handlers_[fd].generation; // Events already fetched for the old registration get ignored
+    }
+
+    // Milliseconds since the loop was created - the clock all timers run on.
+    uint64_t now_ms() const {
+        return static_cast<uint64_t>(
+            std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - started_).count());
+    }
+
+    TimerId run_after(uint64_t delay_ms, std::function<void()> callback) {
+        return timers_.schedule(now_ms() + delay_ms, std::move(callback));
+    }
+
+    void cancel(TimerId id) { timers_.cancel(id); }
+
+    // Waits for I/O (at most `max_wait_ms`, or until the next timer if that's sooner; -1 = no cap),
+    // then runs whatever handlers and timers are due.
+    void run_once(int max_wait_ms = -1) {
+        int64_t wait = timers_.next_timeout_ms(now_ms());
+        if (max_wait_ms >= 0 && (wait < 0 || wait > max_wait_ms)) {
+            wait = max_wait_ms;
+        }
+
+        epoll_event events[64];
+        int ready = epoll_wait(epoll_fd_, events, 64, static_cast<int>(wait));
+        if (ready == -1 && errno != EINTR) {
+            log_error("epoll_wait failed! ", strerror(errno));
+        }
+        for (int i = 0; i < ready; ++i) {
+            int fd = static_cast<int>(events[i].data.u64 & 0xffffffffu);
+            uint32_t generation = static_cast<uint32_t>(events[i].data.u64 >> 32);
+            if (static_cast<size_t>(fd) >= handlers_.size() || handlers_[fd].generation != generation) {
+                continue; // Removed (and maybe re-added) by an earlier handler in this batch
+            }
+            // Hold our own reference: the handler is allowed to remove itself while running.
+            std::shared_ptr<IoHandler> handler = handlers_[fd].handler;
+            if (handler) {
+                (*handler)(events[i].events);
+            }
+        }
+        timers_.advance(now_ms());
+    }
+
+    // Keeps turning the loop until `done()` says we're finished.
+    void run_until(const std::function<bool()>& done) {
+        while (!done()) {
+            if (!valid()) {
+                return;
+            }
+            run_once();
+        }
+    }
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    struct Registration {
+        uint32_t generation = 0;
+        std::shared_ptr<IoHandler> handler;
+    };
+
+    bool control(int operation, int fd, uint32_t events) {
+        epoll_event event;
+        std::memset(&event, 0, sizeof(event));
+        event.events = events | EPOLLET;
+        event.data.u64 = (static_cast<uint64_t>(handlers_[fd].generation) << 32) | static_cast<uint32_t>(fd);
+        if (epoll_ctl(epoll_fd_, operation, fd, &event) == -1) {
+            log_error("epoll_ctl failed for fd ", fd, "! ", strerror(errno));
+            return false;
+        }
+        return true;
+    }
+
+    int epoll_fd_;
+    Clock::time_point started_;
+    TimerWheel timers_;
+    std::vector<Registration> handlers_; // Indexed by fd
+};
+
+#endif // ABX_EVENT_LOOP_H
@@ -0,0 +1,79 @@
+#ifndef ABX_GAP_TRACKER_H
+#define ABX_GAP_TRACKER_H
+
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+#include "packet_store.h"
+
+// GapTracker spots holes in the sequence while the stream is still coming in, so resends can start
+// right away instead of after the stream closes.
+//
+// Every time a burst has been stored, observe() looks at the sequences that have fallen at least
+// `reorder_window` behind the highest one seen. Anything back there that still isn't in the store
+// is taken to be dropped and handed out (once) to be re-requested. The window is how much
+// out-of-order arrival we tolerate before giving up on a packet showing up by itself; the stream is
+// a single TCP connection, so a small one is plenty.
+//
+// Each sequence is looked at once, so the total cost over a whole stream is linear in its length.
+class GapTracker {
+public:
+    explicit GapTracker(int32_t reorder_window)
+        : window_(reorder_window < 0 ? 0 : reorder_window), scanned_(0), requested_count_(0) {}
+
+    // Appends to `due` every newly confirmed hole. Call after each burst has gone into the store.
+    void observe(const PacketStore& store, std::vector<int32_t>& due) {
+        int32_t limit = store.max_sequence() - window_;
+        if (scanned_ < store.contiguous_prefix()) {
+            scanned_ = store.contiguous_prefix(); // Nothing missing below here
+        }
+        for (int32_t sequence = scanned_ + 1; sequence <= limit; ++sequence) {
+            if (!store.contains(sequence)) {
+                mark_requested(sequence);
+                due.push_back(sequence);
+            }
+        }
+        if (limit > scanned_) {
+            scanned_ = limit;
+        }
+    }
+
+    // Everything the store is still missing that hasn't already been handed out by observe().
+    std::vector<int32_t> remaining(const PacketStore& store) const {
+        std::vector<int32_t> missing = store.missing_sequences();
+        size_t kept = 0;
+        for (int32_t sequence : missing) {
+            if (!requested(sequence)) {
+                missing[kept++] = sequence;
+            }
+        }
+        missing.resize(kept);
+        return missing;
+    }
+
+    bool requested(int32_t sequence) const {
+        size_t index = static_cast<size_t>(sequence);
+        return index < requested_.size() && requested_[index];
+    }
+
+    // How many sequences observe() has handed out so far.
+    size_t requested_count() const { return requested_count_; }
+
+private:
+    void mark_requested(int32_t sequence) {
+        size_t index = static_cast<size_t>(sequence);
+        if (index >= requested_.size()) {
+            requested_.resize(index + 1 + index / 2, false);
+        }
+        requested_[index] = true;
+        ++requested_count_;
+    }
+
+    int32_t window_;
+    int32_t scanned_;              // Every sequence up to here has been dealt with
+    std::vector<bool> requested_;  // Indexed by sequence
+    size_t requested_count_;
+};
+
+#endif // ABX_GAP_TRACKER_H
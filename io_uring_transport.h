@@ -0,0 +1,769 @@
+#ifndef ABX_IO_URING_TRANSPORT_H
+#define ABX_IO_URING_TRANSPORT_H
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>  // strerror, memset
+#include <cerrno>
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <unistd.h>
+
+#include "packet.h"
+#include "packet_framer.h"
+#include "packet_batch_decoder.h"
+#include "stream_session.h"  // StreamSession::Status and BatchHandler, so both transports report the same way
+#include "completion_policy.h"
+#include "resend_protocol.h"
+#include "resend_engine.h"   // ResendEngine::Report and PacketHandler, same reason
+#include "metrics.h"
+#include "logger.h"
+
+// io_uring is talked to with raw syscalls (no liburing needed). If the headers are too old to know
+// about multishot recv, the backend compiles down to a stub that always says "not available".
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <signal.h>   // _NSIG for the getevents argument
+#endif
+#endif
+
+#if defined(IORING_RECV_MULTISHOT) && defined(IORING_ENTER_EXT_ARG)
+#define ABX_HAVE_IO_URING 1
+#else
+#define ABX_HAVE_IO_URING 0
+#endif
+
+// UringTransport is an optional second way to run the stream and resend phases, using io_uring
+// instead of one syscall per connect/send/recv.
+//
+// - The stream connection submits connect + send as one linked batch, then a single multishot recv
+//   that keeps completing for as long as the server keeps talking.
+// - That recv picks its destination from a provided buffer ring we registered up front, so the kernel
+//   writes straight into our buffers and the framer decodes packets right out of them
+//   (PacketFramer::frame_chunk) - only a packet split across two buffers ever gets copied.
+// - Resends submit connect -> send -> recv as a linked chain per request, for as many requests as
+//   are allowed in flight, all in one io_uring_enter. The request format is whatever the caller
+//   settled on (ResendEngine does the capabilities probe); a range is received with one recv.
+// Deadlines are enforced by waiting with a timeout and cancelling whatever overran. They come from the
+// same CompletionPolicy as the epoll path, as do resend retries.
+//
+// ok() says whether the kernel has everything we need (io_uring itself, buffer rings, multishot recv).
+// When it doesn't, the caller just sticks with the epoll path.
+class UringTransport {
+public:
+    struct StreamResult {
+        StreamSession::Status status = StreamSession::NotStarted;
+        size_t bytes_received = 0;
+        size_t packets_received = 0;
+    };
+
+#if ABX_HAVE_IO_URING
+    UringTransport() : ring_fd_(-1), sq_ring_(nullptr), cq_ring_(nullptr), sqes_(nullptr),
+                       sq_ring_size_(0), cq_ring_size_(0), sqes_size_(0),
+                       buffer_ring_(nullptr), buffer_ring_size_(0), sqe_tail_(0) {
+        init();
+    }
+
+    ~UringTransport() {
+        if (buffer_ring_ != nullptr) {
+            munmap(buffer_ring_, buffer_ring_size_);
+        }
+        if (sqes_ != nullptr) munmap(sqes_, sqes_size_);
+        if (cq_ring_ != nullptr && cq_ring_ != sq_ring_) munmap(cq_ring_, cq_ring_size_);
+        if (sq_ring_ != nullptr) munmap(sq_ring_, sq_ring_size_);
+        if (ring_fd_ != -1) close(ring_fd_);
+    }
+#else
+    UringTransport() : unavailable_reason_("this build doesn't have io_uring headers") {}
+#endif
+
+    UringTransport(const UringTransport&) = delete;
+    UringTransport& operator=(const UringTransport&) = delete;
+
+    bool ok() const { return unavailable_reason_.empty(); }
+    const std::string& unavailable_reason() const { return unavailable_reason_; }
+
+    // Optional: where to record the same stage latencies the epoll path records.
+    void set_metrics(RunMetrics* metrics) { metrics_ = metrics; }
+
+#if ABX_HAVE_IO_URING
+    // Stages 1-3 over io_uring. Same contract as StreamSession: on_batch gets every decoded burst.
+    StreamResult stream(const sockaddr_in& server_addr, int connect_timeout_ms, CompletionPolicy& policy,
+                        const StreamSession::BatchHandler& on_batch) {
+        StreamResult result;
+        server_addr_ = server_addr;
+        int socket_fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (socket_fd == -1) {
+            log_error("Error creating initial socket! ", strerror(errno));
+            result.status = StreamSession::Failed;
+            return result;
+        }
+
+        // The spec says the request is just 1 byte with value 1 (Stream All Packets).
+        static const unsigned char request_payload = 1;
+        io_uring_sqe* sqe = get_sqe();
+        prep_connect(sqe, socket_fd, tag(0, OP_CONNECT));
+        sqe->flags |= IOSQE_IO_LINK; // Only send once the connect worked
+        sqe = get_sqe();
+        prep_send(sqe, socket_fd, &request_payload, 1, tag(0, OP_SEND));
+        int outstanding = 2;
+        uint64_t connect_started_ns = monotonic_ns();
+        uint64_t request_sent_ns = 0;
+
+        PacketFramer framer;
+        DecodedBatch decoded;
+        result.status = StreamSession::Connecting;
+        bool cancelled = false;
+        Clock::time_point deadline = Clock::now() + std::chrono::milliseconds(connect_timeout_ms);
+        Clock::time_point last_data;
+
+        while (outstanding > 0) {
+            int wait_ms = cancelled ? -1 : remaining_ms(deadline);
+            int ret = submit_and_wait(1, wait_ms);
+            if (ret < 0 && ret != -ETIME && ret != -EINTR) {
+                log_error("io_uring_enter failed during the stream! ", strerror(-ret));
+                result.status = StreamSession::Failed;
+                break;
+            }
+            bool saw_data = false;
+            for_each_cqe([&](const io_uring_cqe& cqe) {
+                switch (cqe.user_data & 0xff) {
+                    case OP_CONNECT:
+                        --outstanding;
+                        if (cqe.res < 0) {
+                            if (!cancelled) {
+                                log_error("Connection failed! ", strerror(-cqe.res));
+                                result.status = StreamSession::Failed;
+                            }
+                        } else {
+                            if (metrics_ != nullptr) {
+                                metrics_->connect.record(monotonic_ns() - connect_started_ns);
+                            }
+                            policy.on_connect_rtt(monotonic_ns() - connect_started_ns);
+                            log_info("Successfully connected for the initial stream!");
+                        }
+                        break;
+                    case OP_SEND:
+                        --outstanding;
+                        if (cqe.res == 1) {
+                            request_sent_ns = monotonic_ns();
+                            log_info("Sent 'Stream All Packets' request (1 byte).");
+                            result.status = StreamSession::Streaming;
+                            prep_multishot_recv(get_sqe(), socket_fd, tag(0, OP_RECV));
+                            ++outstanding;
+                            deadline = Clock::now() + std::chrono::milliseconds(policy.idle_timeout_ms());
+                        } else if (result.status == StreamSession::Connecting) {
+                            log_error("Error sending 'Stream All Packets' request! ",
+                                      (cqe.res < 0 ? strerror(-cqe.res) : "short send"));
+                            result.status = StreamSession::Failed;
+                        }
+                        break;
+                    case OP_RECV:
+                        if (!(cqe.flags & IORING_CQE_F_MORE)) {
+                            --outstanding; // The multishot recv is finished, one way or another
+                        }
+                        if (cqe.res > 0) {
+                            saw_data = true;
+                            policy.on_stream_data();
+                            if (result.bytes_received == 0 && metrics_ != nullptr) {
+                                metrics_->first_byte.record(monotonic_ns() - request_sent_ns);
+                            }
+                            result.bytes_received += static_cast<size_t>(cqe.res);
+                            uint16_t buffer_id = static_cast<uint16_t>(cqe.flags >> IORING_CQE_BUFFER_SHIFT);
+                            framer.frame_chunk(buffer(buffer_id), static_cast<size_t>(cqe.res),
+                                               [&](const unsigned char* packets, size_t count) {
+                                uint64_t decode_started_ns = metrics_ != nullptr ? monotonic_ns() : 0;
+                                decode_packets(packets, count, decoded);
+                                if (metrics_ != nullptr) {
+                                    metrics_->decode.record((monotonic_ns() - decode_started_ns) / count, count);
+                                }
+                                result.packets_received += count;
+                                on_batch(decoded);
+                            });
+                            recycle_buffer(buffer_id);
+                            if (!(cqe.flags & IORING_CQE_F_MORE) && !cancelled) {
+                                // Kernel stopped the multishot (e.g. we ran low on buffers) - re-arm it.
+                                prep_multishot_recv(get_sqe(), socket_fd, tag(0, OP_RECV));
+                                ++outstanding;
+                            }
+                        } else if (cqe.res == 0) {
+                            // recv returning 0 means the server closed the connection gracefully.
+                            log_info("Server closed the initial connection gracefully.");
+                            if (framer.pending_bytes() > 0) {
+                                log_warn("Warning: ", framer.pending_bytes(),
+                                         " trailing bytes didn't make up a whole packet, ignoring them.");
+                            }
+                            result.status = StreamSession::Completed;
+                        } else if (cqe.res == -ENOBUFS && !cancelled) {
+                            prep_multishot_recv(get_sqe(), socket_fd, tag(0, OP_RECV));
+                            ++outstanding;
+                        } else if (!cancelled) {
+                            log_error("A non-timeout error occurred during initial receiving: ", strerror(-cqe.res));
+                            result.status = StreamSession::Failed;
+                        }
+                        break;
+                    default: // OP_CANCEL
+                        --outstanding;
+                        break;
+                }
+            });
+            if (saw_data) {
+                last_data = Clock::now();
+            }
+            if (result.status == StreamSession::Streaming && last_data != Clock::time_point()) {
+                // Re-read every round: the policy may have tightened since the last burst.
+                deadline = last_data + std::chrono::milliseconds(policy.idle_timeout_ms());
+            }
+
+            if (!cancelled && outstanding > 0 && Clock::now() >= deadline) {
+                if (result.status == StreamSession::Connecting) {
+                    log_error("Connection attempt timed out after ", connect_timeout_ms, " ms.");
+                } else {
+                    log_error("Receive timeout reached for initial data stream (quiet for ",
+                              policy.idle_timeout_ms(), " ms). Proceeding with received data.");
+                }
+                result.status = StreamSession::TimedOut;
+                prep_cancel_fd(get_sqe(), socket_fd, tag(0, OP_CANCEL));
+                ++outstanding;
+                cancelled = true;
+            }
+        }
+        close(socket_fd);
+        return result;
+    }
+
+    // Stage 5 over io_uring. Same contract as ResendEngine: on_packet gets every packet that comes back.
+    ResendEngine::Report resend(const sockaddr_in& server_addr, const std::vector<int32_t>& sequences,
+                                size_t max_in_flight, ResendProtocol protocol, CompletionPolicy& policy,
+                                const ResendEngine::PacketHandler& on_packet) {
+        ResendEngine::Report report;
+        auto started = Clock::now();
+        server_addr_ = server_addr;
+
+        std::vector<ResendSlot> slots(max_in_flight == 0 ? 1 : max_in_flight);
+        if (protocol == ResendProtocol::Auto) {
+            protocol = ResendProtocol::Legacy;
+        }
+        std::deque<ResendRequest> queue;
+        plan_resend_requests(protocol, sequences, queue);
+        size_t in_flight = 0;
+        int other_outstanding = 0; // closes and cancels
+
+        while (!queue.empty() || in_flight > 0 || other_outstanding > 0) {
+            // Fill every free slot with a connect -> send -> recv chain.
+            for (size_t s = 0; s < slots.size() && !queue.empty(); ++s) {
+                if (slots[s].busy) {
+                    continue;
+                }
+                if (sq_space() < 3) {
+                    break; // Submission queue is full for this round
+                }
+                const ResendRequest& next = queue.front();
+                if (start_resend(slots[s], static_cast<uint32_t>(s), protocol, next,
+                                 policy.resend_timeout_ms(next.attempt))) {
+                    ++in_flight;
+                    ++report.requests;
+                } else {
+                    give_up(next, report);
+                }
+                queue.pop_front();
+            }
+            if (in_flight > report.peak_in_flight) {
+                report.peak_in_flight = in_flight;
+            }
+            if (in_flight == 0 && other_outstanding == 0 && queue.empty()) {
+                break;
+            }
+
+            int ret = submit_and_wait(1, nearest_deadline_ms(slots));
+            if (ret < 0 && ret != -ETIME && ret != -EINTR) {
+                log_error("  io_uring_enter failed during resends! ", strerror(-ret));
+                break;
+            }
+
+            for_each_cqe([&](const io_uring_cqe& cqe) {
+                uint32_t s = static_cast<uint32_t>(cqe.user_data >> 8);
+                int op = static_cast<int>(cqe.user_data & 0xff);
+                if (op == OP_CLOSE || op == OP_CANCEL) {
+                    --other_outstanding;
+                    return;
+                }
+                ResendSlot& slot = slots[s];
+                --slot.outstanding;
+                if (op == OP_CONNECT && cqe.res < 0 && cqe.res != -ECANCELED) {
+                    slot.error = cqe.res;
+                } else if (op == OP_CONNECT && cqe.res == 0) {
+                    if (metrics_ != nullptr) {
+                        metrics_->connect.record(monotonic_ns() - slot.started_ns);
+                    }
+                } else if (op == OP_SEND && cqe.res < 0 && cqe.res != -ECANCELED && slot.error == 0) {
+                    slot.error = cqe.res;
+                } else if (op == OP_RECV) {
+                    slot.received = cqe.res;
+                }
+                if (slot.outstanding == 0) {
+                    if (!finish_resend(slot, report, policy, on_packet)) {
+                        // Only what didn't arrive gets asked for again.
+                        ResendRequest rest = slot.request;
+                        rest.first += slot.delivered;
+                        if (policy.should_retry(rest.attempt)) {
+                            ++rest.attempt;
+                            queue.push_front(rest);
+                            ++report.retries;
+                        } else {
+                            give_up(rest, report);
+                        }
+                    }
+                    // IMPORTANT: The spec says closing the resend connection is the client's job for Call Type 2.
+                    // Batched into the next submit instead of costing its own syscall.
+                    io_uring_sqe* close_sqe = get_sqe();
+                    if (close_sqe != nullptr) {
+                        prep_close(close_sqe, slot.fd, tag(s, OP_CLOSE));
+                        ++other_outstanding;
+                    } else {
+                        close(slot.fd);
+                    }
+                    slot.fd = -1;
+                    slot.busy = false;
+                    --in_flight;
+                }
+            });
+
+            // Anybody overrun their deadline? Cancel everything on that socket; the chain's CQEs
+            // will come back as cancelled and finish the slot off.
+            auto now = Clock::now();
+            for (size_t s = 0; s < slots.size(); ++s) {
+                ResendSlot& slot = slots[s];
+                if (slot.busy && !slot.timed_out && now >= slot.deadline) {
+                    io_uring_sqe* cancel_sqe = get_sqe();
+                    if (cancel_sqe == nullptr) {
+                        continue; // Try again next round
+                    }
+                    if (policy.should_retry(slot.request.attempt)) {
+                        log_warn("  Resend for ", describe_request(slot.request), " timed out after ", slot.timeout_ms,
+                                 " ms, retrying.");
+                    } else {
+                        log_error("  Resend for ", describe_request(slot.request), " timed out after ", slot.timeout_ms,
+                                  " ms.");
+                    }
+                    slot.timed_out = true;
+                    prep_cancel_fd(cancel_sqe, slot.fd, tag(static_cast<uint32_t>(s), OP_CANCEL));
+                    ++other_outstanding;
+                }
+            }
+        }
+
+        report.wall_seconds = std::chrono::duration<double>(Clock::now() - started).count();
+        return report;
+    }
+#else
+    StreamResult stream(const sockaddr_in&, int, CompletionPolicy&, const StreamSession::BatchHandler&) {
+        StreamResult result;
+        result.status = StreamSession::Failed;
+        return result;
+    }
+
+    ResendEngine::Report resend(const sockaddr_in&, const std::vector<int32_t>& sequences, size_t, ResendProtocol,
+                                CompletionPolicy&, const ResendEngine::PacketHandler&) {
+        ResendEngine::Report report;
+        report.failed = sequences;
+        return report;
+    }
+#endif
+
+private:
+    std::string unavailable_reason_;
+    RunMetrics* metrics_ = nullptr;
+
+#if ABX_HAVE_IO_URING
+    typedef std::chrono::steady_clock Clock;
+
+    static const unsigned RING_ENTRIES = 256;
+    static const unsigned BUFFER_COUNT = 64;          // Must be a power of two (it's a ring)
+    static const unsigned BUFFER_SIZE = 16 * 1024;
+    static const uint16_t BUFFER_GROUP = 0;
+
+    enum Op { OP_CONNECT = 1, OP_SEND, OP_RECV, OP_CLOSE, OP_CANCEL };
+
+    struct ResendSlot {
+        bool busy = false;
+        bool timed_out = false;
+        int fd = -1;
+        ResendRequest request = {0, 0, 0};
+        int32_t delivered = 0;
+        uint64_t timeout_ms = 0;
+        int outstanding = 0;
+        int error = 0;
+        int received = 0;
+        unsigned char wire[MAX_RESEND_REQUEST_SIZE];
+        size_t wire_size = 0;
+        std::vector<unsigned char> response;   // PACKET_SIZE per sequence in the request
+        Clock::time_point deadline;
+        uint64_t started_ns = 0;
+    };
+
+    static uint64_t tag(uint32_t slot, Op op) { return (static_cast<uint64_t>(slot) << 8) | op; }
+
+    static int remaining_ms(Clock::time_point deadline) {
+        auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - Clock::now()).count();
+        return left < 0 ? 0 : static_cast<int>(left) + 1;
+    }
+
+    int nearest_deadline_ms(const std::vector<ResendSlot>& slots) const {
+        int wait = -1;
+        for (const ResendSlot& slot : slots) {
+            if (slot.busy && !slot.timed_out) {
+                int left = remaining_ms(slot.deadline);
+                if (wait < 0 || left < wait) wait = left;
+            }
+        }
+        return wait;
+    }
+
+    // --- Ring setup ---
+
+    void init() {
+        io_uring_params params;
+        std::memset(&params, 0, sizeof(params));
+        ring_fd_ = static_cast<int>(syscall(__NR_io_uring_setup, RING_ENTRIES, &params));
+        if (ring_fd_ < 0) {
+            unavailable_reason_ = std::string("io_uring_setup failed: ") + strerror(errno);
+            ring_fd_ = -1;
+            return;
+        }
+        if (!(params.features & IORING_FEAT_EXT_ARG)) {
+            unavailable_reason_ = "kernel can't wait on io_uring with a timeout (needs 5.11+)";
+            return;
+        }
+
+        sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cq_ring_size_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        bool single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+        if (single_mmap && cq_ring_size_ > sq_ring_size_) {
+            sq_ring_size_ = cq_ring_size_;
+        }
+        sq_ring_ = map(sq_ring_size_, IORING_OFF_SQ_RING);
+        cq_ring_ = single_mmap ? sq_ring_ : map(cq_ring_size_, IORING_OFF_CQ_RING);
+        sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+        sqes_ = static_cast<io_uring_sqe*>(map(sqes_size_, IORING_OFF_SQES));
+        if (sq_ring_ == nullptr || cq_ring_ == nullptr || sqes_ == nullptr) {
+            unavailable_reason_ = std::string("mmap of io_uring rings failed: ") + strerror(errno);
+            return;
+        }
+
+        char* sq = static_cast<char*>(sq_ring_);
+        sq_head_ = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+        sq_tail_ = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+        sq_mask_ = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+        sq_entries_ = params.sq_entries;
+        sq_array_ = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+        char* cq = static_cast<char*>(cq_ring_);
+        cq_head_ = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+        cq_tail_ = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+        cq_mask_ = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+        cqes_ = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+        sqe_tail_ = *sq_tail_;
+
+        if (!probe_ops()) {
+            return;
+        }
+        setup_buffer_ring();
+    }
+
+    void* map(size_t size, off_t offset) {
+        void* ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd_, offset);
+        return ptr == MAP_FAILED ? nullptr : ptr;
+    }
+
+    // Checks every opcode we use. Multishot recv has no probe bit of its own; it arrived in 6.0
+    // together with IORING_OP_SEND_ZC, so that's what we look for.
+    bool probe_ops() {
+        const unsigned op_count = 256;
+        std::vector<char> storage(sizeof(io_uring_probe) + op_count * sizeof(io_uring_probe_op), 0);
+        io_uring_probe* probe = reinterpret_cast<io_uring_probe*>(storage.data());
+        if (syscall(__NR_io_uring_register, ring_fd_, IORING_REGISTER_PROBE, probe, op_count) < 0) {
+            unavailable_reason_ = std::string("io_uring probe failed: ") + strerror(errno);
+            return false;
+        }
+        const int needed[] = {IORING_OP_CONNECT, IORING_OP_SEND, IORING_OP_RECV, IORING_OP_CLOSE,
+                              IORING_OP_ASYNC_CANCEL, IORING_OP_SEND_ZC};
+        for (int op : needed) {
+            if (op > probe->last_op || !(probe->ops[op].flags & IO_URING_OP_SUPPORTED)) {
+                unavailable_reason_ = "kernel io_uring is missing an operation we need (multishot recv wants 6.0+)";
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Registers BUFFER_COUNT x BUFFER_SIZE receive buffers as a provided buffer ring, so the stream's
+    // multishot recv can pick a buffer per completion without us handing one over each time.
+    void setup_buffer_ring() {
+        buffer_ring_size_ = BUFFER_COUNT * sizeof(io_uring_buf);
+        void* ring = mmap(nullptr, buffer_ring_size_, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (ring == MAP_FAILED) {
+            unavailable_reason_ = std::string("couldn't allocate the buffer ring: ") + strerror(errno);
+            return;
+        }
+        buffer_ring_ = static_cast<io_uring_buf*>(ring);
+        buffers_.assign(static_cast<size_t>(BUFFER_COUNT) * BUFFER_SIZE, 0);
+
+        io_uring_buf_reg registration;
+        std::memset(&registration, 0, sizeof(registration));
+        registration.ring_addr = reinterpret_cast<uint64_t>(buffer_ring_);
+        registration.ring_entries = BUFFER_COUNT;
+        registration.bgid = BUFFER_GROUP;
+        if (syscall(__NR_io_uring_register, ring_fd_, IORING_REGISTER_PBUF_RING, &registration, 1) < 0) {
+            unavailable_reason_ = std::string("kernel doesn't support provided buffer rings (needs 5.19+): ") + strerror(errno);
+            return;
+        }
+        // The ring's tail lives in the first entry's reserved field.
+        buffer_ring_tail_ = &buffer_ring_[0].resv;
+        buffer_tail_ = 0;
+        for (uint16_t id = 0; id < BUFFER_COUNT; ++id) {
+            add_buffer(id);
+        }
+        publish_buffers();
+    }
+
+    char* buffer(uint16_t id) { return buffers_.data() + static_cast<size_t>(id) * BUFFER_SIZE; }
+
+    void add_buffer(uint16_t id) {
+        io_uring_buf& entry = buffer_ring_[buffer_tail_ & (BUFFER_COUNT - 1)];
+        entry.addr = reinterpret_cast<uint64_t>(buffer(id));
+        entry.len = BUFFER_SIZE;
+        entry.bid = id;
+        ++buffer_tail_;
+    }
+
+    void publish_buffers() { __atomic_store_n(buffer_ring_tail_, buffer_tail_, __ATOMIC_RELEASE); }
+
+    // Hands a buffer back to the kernel once we've framed everything out of it.
+    void recycle_buffer(uint16_t id) {
+        add_buffer(id);
+        publish_buffers();
+    }
+
+    // --- Submission / completion ---
+
+    unsigned sq_space() const { return sq_entries_ - (sqe_tail_ - __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE)); }
+
+    io_uring_sqe* get_sqe() {
+        if (sq_space() == 0) {
+            return nullptr;
+        }
+        unsigned index = sqe_tail_ & sq_mask_;
+        io_uring_sqe* sqe = &sqes_[index];
+        std::memset(sqe, 0, sizeof(*sqe));
+        sq_array_[index] = index;
+        ++sqe_tail_;
+        return sqe;
+    }
+
+    // Submits everything queued and waits for at least `wait_nr` completions, or `timeout_ms`
+    // (-1 = no timeout). Returns the io_uring_enter result, or -errno.
+    int submit_and_wait(unsigned wait_nr, int timeout_ms) {
+        __atomic_store_n(sq_tail_, sqe_tail_, __ATOMIC_RELEASE);
+        unsigned to_submit = sqe_tail_ - __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE);
+        unsigned flags = wait_nr > 0 ? IORING_ENTER_GETEVENTS : 0;
+        __kernel_timespec timeout;
+        io_uring_getevents_arg arg;
+        std::memset(&arg, 0, sizeof(arg));
+        void* argp = nullptr;
+        size_t argsz = 0;
+        if (timeout_ms >= 0) {
+            timeout.tv_sec = timeout_ms / 1000;
+            timeout.tv_nsec = static_cast<long long>(timeout_ms % 1000) * 1000000;
+            arg.sigmask_sz = _NSIG / 8;
+            arg.ts = reinterpret_cast<uint64_t>(&timeout);
+            flags |= IORING_ENTER_EXT_ARG;
+            argp = &arg;
+            argsz = sizeof(arg);
+        }
+        long ret = syscall(__NR_io_uring_enter, ring_fd_, to_submit, wait_nr, flags, argp, argsz);
+        return ret < 0 ? -errno : static_cast<int>(ret);
+    }
+
+    template <typename Fn>
+    void for_each_cqe(Fn fn) {
+        unsigned head = *cq_head_;
+        unsigned tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+        while (head != tail) {
+            io_uring_cqe cqe = cqes_[head & cq_mask_];
+            ++head;
+            __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE); // Free the slot before running the handler
+            fn(cqe);
+            tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+        }
+    }
+
+    void prep_connect(io_uring_sqe* sqe, int fd, uint64_t user_data) {
+        sqe->opcode = IORING_OP_CONNECT;
+        sqe->fd = fd;
+        sqe->addr = reinterpret_cast<uint64_t>(&server_addr_);
+        sqe->off = sizeof(server_addr_); // addrlen rides in the offset field
+        sqe->user_data = user_data;
+    }
+
+    void prep_send(io_uring_sqe* sqe, int fd, const void* data, unsigned length, uint64_t user_data) {
+        sqe->opcode = IORING_OP_SEND;
+        sqe->fd = fd;
+        sqe->addr = reinterpret_cast<uint64_t>(data);
+        sqe->len = length;
+        sqe->msg_flags = MSG_NOSIGNAL;
+        sqe->user_data = user_data;
+    }
+
+    void prep_recv(io_uring_sqe* sqe, int fd, void* data, unsigned length, uint64_t user_data) {
+        sqe->opcode = IORING_OP_RECV;
+        sqe->fd = fd;
+        sqe->addr = reinterpret_cast<uint64_t>(data);
+        sqe->len = length;
+        sqe->msg_flags = MSG_WAITALL;
+        sqe->user_data = user_data;
+    }
+
+    void prep_multishot_recv(io_uring_sqe* sqe, int fd, uint64_t user_data) {
+        sqe->opcode = IORING_OP_RECV;
+        sqe->fd = fd;
+        sqe->flags = IOSQE_BUFFER_SELECT;
+        sqe->buf_group = BUFFER_GROUP;
+        sqe->ioprio = IORING_RECV_MULTISHOT;
+        sqe->user_data = user_data;
+    }
+
+    void prep_close(io_uring_sqe* sqe, int fd, uint64_t user_data) {
+        sqe->opcode = IORING_OP_CLOSE;
+        sqe->fd = fd;
+        sqe->user_data = user_data;
+    }
+
+    void prep_cancel_fd(io_uring_sqe* sqe, int fd, uint64_t user_data) {
+        sqe->opcode = IORING_OP_ASYNC_CANCEL;
+        sqe->fd = fd;
+        sqe->cancel_flags = IORING_ASYNC_CANCEL_FD | IORING_ASYNC_CANCEL_ALL;
+        sqe->user_data = user_data;
+    }
+
+    // --- Resend chains ---
+
+    bool start_resend(ResendSlot& slot, uint32_t index, ResendProtocol protocol, const ResendRequest& request,
+                      uint64_t timeout_ms) {
+        slot.fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (slot.fd == -1) {
+            log_error("  Error creating resend socket for ", describe_request(request), "! ", strerror(errno));
+            return false;
+        }
+        slot.busy = true;
+        slot.timed_out = false;
+        slot.request = request;
+        slot.delivered = 0;
+        slot.timeout_ms = timeout_ms;
+        slot.error = 0;
+        slot.received = 0;
+        slot.wire_size = encode_resend_request(protocol, request, slot.wire);
+        slot.response.resize(static_cast<size_t>(request.count()) * PACKET_SIZE);
+        slot.deadline = Clock::now() + std::chrono::milliseconds(timeout_ms);
+        slot.started_ns = monotonic_ns();
+
+        io_uring_sqe* sqe = get_sqe();
+        prep_connect(sqe, slot.fd, tag(index, OP_CONNECT));
+        sqe->flags |= IOSQE_IO_LINK;
+        sqe = get_sqe();
+        prep_send(sqe, slot.fd, slot.wire, static_cast<unsigned>(slot.wire_size), tag(index, OP_SEND));
+        sqe->flags |= IOSQE_IO_LINK;
+        // We expect one packet (17 bytes) per sequence asked for; MSG_WAITALL has the kernel collect all of it.
+        prep_recv(get_sqe(), slot.fd, slot.response.data(), static_cast<unsigned>(slot.response.size()),
+                  tag(index, OP_RECV));
+        slot.outstanding = 3;
+        return true;
+    }
+
+    // True if every packet of the request came back. On false the caller decides between a retry and
+    // giving up; slot.delivered says how many did make it.
+    bool finish_resend(ResendSlot& slot, ResendEngine::Report& report, CompletionPolicy& policy,
+                       const ResendEngine::PacketHandler& on_packet) {
+        int32_t whole = slot.received > 0 ? static_cast<int32_t>(static_cast<size_t>(slot.received) / PACKET_SIZE) : 0;
+        if (whole > 0) {
+            uint64_t round_trip_ns = monotonic_ns() - slot.started_ns;
+            if (slot.request.count() == 1) {
+                policy.on_resend_rtt(round_trip_ns); // A range's time says more about its length than the link
+            }
+            if (metrics_ != nullptr) {
+                metrics_->resend_rtt.record(round_trip_ns);
+            }
+        }
+        for (int32_t i = 0; i < whole; ++i) {
+            Packet packet = parse_packet(slot.response.data() + static_cast<size_t>(i) * PACKET_SIZE);
+            // Quick check: Is this the packet we actually asked for?
+            int32_t expected = slot.request.first + i;
+            if (packet.sequence != expected) {
+                log_warn("  Warning: Requested seq ", expected, " but received packet has seq ",
+                         packet.sequence, ". Data might be mixed up or corrupted.");
+            }
+            ++report.recovered;
+            on_packet(packet);
+        }
+        slot.delivered = whole;
+        if (whole == slot.request.count()) {
+            return true;
+        }
+        if (slot.timed_out) {
+            return false; // Already reported when we cancelled it
+        }
+        if (slot.error != 0) {
+            log_error("  Resend connection failed for ", describe_request(slot.request), "! ", strerror(-slot.error));
+        } else if (slot.received < 0) {
+            log_error("  Error receiving resent packet for ", describe_request(slot.request), "! ",
+                      strerror(-slot.received));
+        } else {
+            log_error("  Server closed connection prematurely while getting resent packet for ",
+                      describe_request(slot.request), ". Expected ", slot.response.size(), " bytes, but only got ", slot.received, ".");
+        }
+        return false;
+    }
+
+    static void give_up(const ResendRequest& request, ResendEngine::Report& report) {
+        for (int32_t sequence = request.first; sequence <= request.last; ++sequence) {
+            report.failed.push_back(sequence);
+        }
+    }
+
+    int ring_fd_;
+    void* sq_ring_;
+    void* cq_ring_;
+    io_uring_sqe* sqes_;
+    size_t sq_ring_size_;
+    size_t cq_ring_size_;
+    size_t sqes_size_;
+
+    unsigned* sq_head_ = nullptr;
+    unsigned* sq_tail_ = nullptr;
+    unsigned* sq_array_ = nullptr;
+    unsigned sq_mask_ = 0;
+    unsigned sq_entries_ = 0;
+    unsigned* cq_head_ = nullptr;
+    unsigned* cq_tail_ = nullptr;
+    unsigned cq_mask_ = 0;
+    io_uring_cqe* cqes_ = nullptr;
+
+    io_uring_buf* buffer_ring_;
+    size_t buffer_ring_size_;
+    uint16_t* buffer_ring_tail_ = nullptr;
+    uint16_t buffer_tail_ = 0;
+    std::vector<char> buffers_;
+
+    unsigned sqe_tail_;
+    sockaddr_in server_addr_;
+#endif
+};
+
+#endif // ABX_IO_URING_TRANSPORT_H
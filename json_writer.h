@@ -0,0 +1,187 @@
+#ifndef ABX_JSON_WRITER_H
+#define ABX_JSON_WRITER_H
+
+#include <array>
+#include <charconv> // to_chars
+#include <string>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>  // memcpy
+#include <cerrno>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "packet.h"
+#include "symbol_table.h"
+
+// The constant text in front of one field's value in output.json, built at compile time from the
+// schema: the separator (the object's opening brace for the first field, a comma otherwise), the
+// indented "key": , and the opening quote when the value is a string.
+template <typename Schema, typename Field>
+struct JsonKeyLine {
+    static constexpr bool first = Schema::template offset_of<Field>() == 0;
+    static constexpr bool quoted = Field::type != WireType::Int32BE;
+    static constexpr size_t name_length = std::char_traits<char>::length(Field::json_name);
+    static constexpr size_t length = (first ? 5 : 1) + 10 + name_length + 3 + (quoted ? 1 : 0);
+
+    static constexpr std::array<char, length> make() {
+        std::array<char, length> line = {};
+        const char* head = first ? "    {\n        \"" : ",\n        \"";
+        size_t n = 0;
+        for (size_t i = 0; head[i] != '\0'; ++i) line[n++] = head[i];
+        for (size_t i = 0; i < name_length; ++i) line[n++] = Field::json_name[i];
+        line[n++] = '"';
+        line[n++] = ':';
+        line[n++] = ' ';
+        if (quoted) line[n++] = '"';
+        return line;
+    }
+
+    static constexpr std::array<char, length> text = make();
+};
+
+// Upper bound on one object's size, separator included: every key line, plus 11 bytes for any value
+// (an int32 at its longest; a symbol and its closing quote are 5, a side 2), plus ",\n" and "\n    }".
+template <typename... Fields>
+constexpr size_t json_object_bound(WireSchema<Fields...>*) {
+    return (0 + ... + (JsonKeyLine<WireSchema<Fields...>, Fields>::length + 11)) + 2 + 6;
+}
+
+// JsonStreamWriter writes output.json one packet at a time instead of building the whole document
+// in a std::string first.
+//
+// Packets are formatted straight into one fixed buffer (numbers via std::to_chars, no temporaries)
+// and the buffer goes to the file whenever it fills up or the caller calls flush(). Memory use stays
+// at BUFFER_SIZE no matter how long the capture is, and the file grows while resends are still
+// running. The bytes are exactly what the old Stage 6 string produced: "[\n", pretty-printed objects
+// separated by ",\n", then "\n]\n".
+class JsonStreamWriter {
+public:
+    static const size_t BUFFER_SIZE = 64 * 1024;
+
+    JsonStreamWriter() : fd_(-1), used_(0), packets_written_(0), error_(0), buffer_(BUFFER_SIZE) {}
+    ~JsonStreamWriter() {
+        if (fd_ != -1) {
+            close(fd_);
+        }
+    }
+
+    JsonStreamWriter(const JsonStreamWriter&) = delete;
+    JsonStreamWriter& operator=(const JsonStreamWriter&) = delete;
+
+    // Creates (or truncates) the file and writes the opening bracket. False with errno set on failure.
+    bool open(const std::string& path) {
+        fd_ = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (fd_ == -1) {
+            return false;
+        }
+        append("[\n", 2); // JSON array starts here
+        return true;
+    }
+
+    void write_packet(const Packet& packet) {
+        // Worst case for one object is well under this (see the static_assert below).
+        if (BUFFER_SIZE - used_ < MAX_OBJECT_SIZE) {
+            flush();
+        }
+        if (packets_written_ > 0) {
+            put(",\n", 2);
+        }
+        // One "key": value line per PacketWire field, in wire order; the fold unrolls at compile time
+        // and each key line (with the separator before it) is a constant built from the schema.
+        PacketWire::for_each_field(packet, [this](auto field, auto value) {
+            typedef JsonKeyLine<PacketWire, decltype(field)> Key;
+            put(Key::text.data(), Key::text.size());
+            append_value(std::integral_constant<WireType, decltype(field)::type>(), value);
+        });
+        put("\n    }", 6);
+        ++packets_written_;
+    }
+
+    // Pushes whatever is buffered out to the file. False if any write so far has failed.
+    bool flush() {
+        size_t offset = 0;
+        while (error_ == 0 && offset < used_) {
+            ssize_t written = ::write(fd_, buffer_.data() + offset, used_ - offset);
+            if (written < 0) {
+                if (errno != EINTR) {
+                    error_ = errno;
+                }
+                continue;
+            }
+            offset += static_cast<size_t>(written);
+        }
+        used_ = 0;
+        return error_ == 0;
+    }
+
+    // Closes the array and the file. False (with errno set) if anything along the way failed.
+    bool finish() {
+        append("\n]\n", 3); // End of the JSON array
+        bool ok = flush();
+        if (close(fd_) != 0 && ok) {
+            error_ = errno;
+            ok = false;
+        }
+        fd_ = -1;
+        if (!ok) {
+            errno = error_;
+        }
+        return ok;
+    }
+
+    size_t packets_written() const { return packets_written_; }
+
+private:
+    static const size_t MAX_OBJECT_SIZE = 256;
+    static_assert(json_object_bound(static_cast<PacketWire*>(nullptr)) <= MAX_OBJECT_SIZE,
+                  "A packet's JSON object might not fit in MAX_OBJECT_SIZE any more");
+
+    template <size_t N>
+    void append_literal(const char (&text)[N]) { append(text, N - 1); }
+
+    // Inside write_packet(), which has already made room for a whole object.
+    void put(const char* data, size_t size) {
+        std::memcpy(buffer_.data() + used_, data, size);
+        used_ += size;
+    }
+
+    void append(const char* data, size_t size) {
+        if (BUFFER_SIZE - used_ < size) {
+            flush();
+        }
+        std::memcpy(buffer_.data() + used_, data, size);
+        used_ += size;
+    }
+
+    // Field values, by wire type: the symbol as its trimmed name, the side as a 1-char string. The
+    // opening quote of a string is already part of its key line. Like put(), these don't check for room.
+    void append_value(std::integral_constant<WireType, WireType::Ascii4>, uint32_t code) {
+        const std::string& symbol = symbols_.name(code); // Already trimmed
+        put(symbol.data(), symbol.size());
+        put("\"", 1);
+    }
+
+    void append_value(std::integral_constant<WireType, WireType::Char>, char value) {
+        char closed[2] = {value, '"'};
+        put(closed, 2);
+    }
+
+    void append_value(std::integral_constant<WireType, WireType::Int32BE>, int32_t value) { append_int(value); }
+
+    void append_int(int32_t value) {
+        char* first = buffer_.data() + used_;
+        used_ = static_cast<size_t>(std::to_chars(first, buffer_.data() + BUFFER_SIZE, value).ptr - buffer_.data());
+    }
+
+    int fd_;
+    size_t used_;
+    size_t packets_written_;
+    int error_;
+    std::vector<char> buffer_;
+    SymbolTable symbols_;
+};
+
+#endif // ABX_JSON_WRITER_H
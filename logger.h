@@ -0,0 +1,332 @@
+#ifndef ABX_LOGGER_H
+#define ABX_LOGGER_H
+
+#include <atomic>
+#include <charconv> // to_chars
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>   // snprintf for doubles
+#include <cstring>  // memcpy, strlen
+#include <cerrno>
+
+#include <unistd.h>
+
+#include "spsc_ring.h"
+
+// Asynchronous logging for everything the client prints.
+//
+// Every `std::cout << ... << std::endl` used to be a formatted write plus a flush, i.e. a syscall per
+// line, right in the middle of the receive and resend paths. Now a log call only copies its raw
+// arguments (numbers as numbers, strings as bytes) into a fixed-size record and pushes that onto the
+// calling thread's own SpscRing - no locks, no formatting, no syscalls. A background thread drains
+// the rings, does the number-to-text work, and writes everything out in big chunks.
+//
+// Debug and Info go to stdout, Warn and Error to stderr, same split as the old cout/cerr. Lines keep
+// their order (per thread) even across the two streams. Call log_flush() before writing to
+// std::cout directly so the two don't interleave; anything still queued at exit is written out when
+// the logger shuts down.
+
+enum class LogLevel { Debug = 0, Info, Warn, Error, Off };
+
+namespace abx_detail {
+
+// One queued log line: the level plus the arguments, each stored as a type tag and its raw bytes.
+struct LogRecord {
+    static const size_t PAYLOAD_SIZE = 248;
+
+    uint8_t level;
+    uint8_t truncated;
+    uint16_t size;
+    char payload[PAYLOAD_SIZE];
+};
+
+enum LogArgTag : uint8_t { ARG_SIGNED, ARG_UNSIGNED, ARG_DOUBLE, ARG_CHAR, ARG_TEXT };
+
+class LogRecordBuilder {
+public:
+    explicit LogRecordBuilder(LogRecord& record) : record_(record) {
+        record_.size = 0;
+        record_.truncated = 0;
+    }
+
+    void add(const char* text) { add_text(text != nullptr ? text : "(null)", text != nullptr ? std::strlen(text) : 6); }
+    void add(char* text) { add(static_cast<const char*>(text)); }
+    void add(const std::string& text) { add_text(text.data(), text.size()); }
+    void add(char c) { add_tagged(ARG_CHAR, &c, 1); }
+    void add(bool value) { add(value ? "true" : "false"); }
+    void add(double value) { add_tagged(ARG_DOUBLE, &value, sizeof(value)); }
+    void add(float value) { add(static_cast<double>(value)); }
+
+    template <typename T>
+    typename std::enable_if<std::is_integral<T>::value && std::is_signed<T>::value>::type add(T value) {
+        int64_t wide = value;
+        add_tagged(ARG_SIGNED, &wide, sizeof(wide));
+    }
+
+    template <typename T>
+    typename std::enable_if<std::is_integral<T>::value && !std::is_signed<T>::value>::type add(T value) {
+        uint64_t wide = value;
+        add_tagged(ARG_UNSIGNED, &wide, sizeof(wide));
+    }
+
+private:
+    void add_tagged(LogArgTag tag, const void* data, size_t size) {
+        if (LogRecord::PAYLOAD_SIZE - record_.size < size + 1) {
+            record_.truncated = 1;
+            return;
+        }
+        record_.payload[record_.size] = static_cast<char>(tag);
+        std::memcpy(record_.payload + record_.size + 1, data, size);
+        record_.size = static_cast<uint16_t>(record_.size + 1 + size);
+    }
+
+    void add_text(const char* text, size_t length) {
+        size_t room = LogRecord::PAYLOAD_SIZE - record_.size;
+        if (room < 3) {
+            record_.truncated = 1;
+            return;
+        }
+        if (length > room - 3) {
+            length = room - 3;
+            record_.truncated = 1;
+        }
+        uint16_t length16 = static_cast<uint16_t>(length);
+        record_.payload[record_.size] = static_cast<char>(ARG_TEXT);
+        std::memcpy(record_.payload + record_.size + 1, &length16, 2);
+        std::memcpy(record_.payload + record_.size + 3, text, length);
+        record_.size = static_cast<uint16_t>(record_.size + 3 + length);
+    }
+
+    LogRecord& record_;
+};
+
+} // namespace abx_detail
+
+class Logger {
+public:
+    static const size_t RING_CAPACITY = 4096; // Records per thread (~1 MiB)
+
+    static Logger& instance() {
+        static Logger logger;
+        return logger;
+    }
+
+    ~Logger() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        wake_.notify_one();
+        flusher_.join();
+    }
+
+    Logger(const Logger&) = delete;
+    Logger& operator=(const Logger&) = delete;
+
+    void set_level(LogLevel level) { level_.store(static_cast<int>(level), std::memory_order_relaxed); }
+    LogLevel level() const { return static_cast<LogLevel>(level_.load(std::memory_order_relaxed)); }
+    bool enabled(LogLevel level) const { return static_cast<int>(level) >= level_.load(std::memory_order_relaxed); }
+
+    template <typename... Args>
+    void log(LogLevel level, const Args&... args) {
+        abx_detail::LogRecord record;
+        record.level = static_cast<uint8_t>(level);
+        abx_detail::LogRecordBuilder builder(record);
+        int expand[] = {0, (builder.add(args), 0)...};
+        (void)expand;
+        SpscRing<abx_detail::LogRecord>& ring = local_ring();
+        while (!ring.try_push(record)) {
+            // Flusher is behind. Waiting beats silently losing diagnostics.
+            wake_.notify_one();
+            std::this_thread::yield();
+        }
+    }
+
+    // Blocks until everything logged before this call has been written out.
+    void flush() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        uint64_t ticket = ++flush_requested_;
+        wake_.notify_one();
+        flushed_.wait(lock, [&]() { return flush_done_ >= ticket; });
+    }
+
+private:
+    Logger()
+        : level_(static_cast<int>(LogLevel::Info)),
+          stopping_(false),
+          flush_requested_(0),
+          flush_done_(0),
+          out_fd_(-1) {
+        flusher_ = std::thread([this]() { run(); });
+    }
+
+    // Each thread gets its own ring the first time it logs. Only that registration takes the lock.
+    SpscRing<abx_detail::LogRecord>& local_ring() {
+        thread_local SpscRing<abx_detail::LogRecord>* ring = nullptr;
+        if (ring == nullptr) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            rings_.emplace_back(new SpscRing<abx_detail::LogRecord>(RING_CAPACITY));
+            ring = rings_.back().get();
+        }
+        return *ring;
+    }
+
+    void run() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (true) {
+            uint64_t ticket = flush_requested_;
+            bool stopping = stopping_;
+            // Snapshot the ring list; rings are never removed, so the pointers stay good unlocked.
+            std::vector<SpscRing<abx_detail::LogRecord>*> rings;
+            for (const std::unique_ptr<SpscRing<abx_detail::LogRecord>>& ring : rings_) {
+                rings.push_back(ring.get());
+            }
+            lock.unlock();
+            bool wrote = drain(rings);
+            lock.lock();
+            if (ticket > flush_done_) {
+                flush_done_ = ticket;
+                flushed_.notify_all();
+            }
+            if (stopping && !wrote) {
+                return;
+            }
+            if (!wrote && flush_requested_ == ticket && !stopping_) {
+                wake_.wait_for(lock, std::chrono::milliseconds(2));
+            }
+        }
+    }
+
+    // Formats and writes whatever is queued. Returns true if there was anything.
+    bool drain(const std::vector<SpscRing<abx_detail::LogRecord>*>& rings) {
+        bool any = false;
+        abx_detail::LogRecord record;
+        for (SpscRing<abx_detail::LogRecord>* ring : rings) {
+            while (ring->try_pop(record)) {
+                any = true;
+                int fd = record.level >= static_cast<uint8_t>(LogLevel::Warn) ? STDERR_FILENO : STDOUT_FILENO;
+                if (fd != out_fd_) {
+                    write_out(); // Switching streams - keep the lines in order
+                    out_fd_ = fd;
+                }
+                format(record, out_);
+                if (out_.size() >= WRITE_CHUNK) {
+                    write_out();
+                }
+            }
+        }
+        write_out();
+        return any;
+    }
+
+    static void format(const abx_detail::LogRecord& record, std::string& out) {
+        size_t pos = 0;
+        char number[32];
+        while (pos < record.size) {
+            uint8_t tag = static_cast<uint8_t>(record.payload[pos++]);
+            switch (tag) {
+                case abx_detail::ARG_SIGNED: {
+                    int64_t value;
+                    std::memcpy(&value, record.payload + pos, sizeof(value));
+                    pos += sizeof(value);
+                    out.append(number, std::to_chars(number, number + sizeof(number), value).ptr);
+                    break;
+                }
+                case abx_detail::ARG_UNSIGNED: {
+                    uint64_t value;
+                    std::memcpy(&value, record.payload + pos, sizeof(value));
+                    pos += sizeof(value);
+                    out.append(number, std::to_chars(number, number + sizeof(number), value).ptr);
+                    break;
+                }
+                case abx_detail::ARG_DOUBLE: {
+                    double value;
+                    std::memcpy(&value, record.payload + pos, sizeof(value));
+                    pos += sizeof(value);
+                    // %g matches what operator<< prints for a double by default.
+                    int length = std::snprintf(number, sizeof(number), "%g", value);
+                    out.append(number, length > 0 ? static_cast<size_t>(length) : 0);
+                    break;
+                }
+                case abx_detail::ARG_CHAR:
+                    out.push_back(record.payload[pos++]);
+                    break;
+                default: { // ARG_TEXT
+                    uint16_t length;
+                    std::memcpy(&length, record.payload + pos, 2);
+                    out.append(record.payload + pos + 2, length);
+                    pos += 2 + length;
+                    break;
+                }
+            }
+        }
+        if (record.truncated) {
+            out.append("...");
+        }
+        out.push_back('\n');
+    }
+
+    void write_out() {
+        size_t offset = 0;
+        while (offset < out_.size()) {
+            ssize_t written = ::write(out_fd_, out_.data() + offset, out_.size() - offset);
+            if (written < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                break; // Nowhere to report it anyway
+            }
+            offset += static_cast<size_t>(written);
+        }
+        out_.clear();
+    }
+
+    static const size_t WRITE_CHUNK = 64 * 1024;
+
+    std::atomic<int> level_;
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::condition_variable flushed_;
+    bool stopping_;
+    uint64_t flush_requested_;
+    uint64_t flush_done_;
+    std::vector<std::unique_ptr<SpscRing<abx_detail::LogRecord>>> rings_;
+
+    // Flusher thread only.
+    int out_fd_;
+    std::string out_;
+
+    std::thread flusher_; // Last, so everything above exists before it starts
+};
+
+inline void set_log_level(LogLevel level) { Logger::instance().set_level(level); }
+inline bool log_enabled(LogLevel level) { return Logger::instance().enabled(level); }
+inline void log_flush() { Logger::instance().flush(); }
+
+// Each argument is appended as-is (no separators), so these read like the old `<<` chains.
+template <typename... Args>
+void log_debug(const Args&... args) {
+    if (log_enabled(LogLevel::Debug)) Logger::instance().log(LogLevel::Debug, args...);
+}
+template <typename... Args>
+void log_info(const Args&... args) {
+    if (log_enabled(LogLevel::Info)) Logger::instance().log(LogLevel::Info, args...);
+}
+template <typename... Args>
+void log_warn(const Args&... args) {
+    if (log_enabled(LogLevel::Warn)) Logger::instance().log(LogLevel::Warn, args...);
+}
+template <typename... Args>
+void log_error(const Args&... args) {
+    if (log_enabled(LogLevel::Error)) Logger::instance().log(LogLevel::Error, args...);
+}
+
+#endif // ABX_LOGGER_H
@@ -0,0 +1,158 @@
+#ifndef ABX_METRICS_H
+#define ABX_METRICS_H
+
+#include <ostream>
+#include <fstream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+// Lightweight instrumentation for a collection run: a latency histogram plus the fixed set of stages
+// we care about, and a summary at exit.
+
+// Nanoseconds on the monotonic clock. Only differences mean anything.
+inline uint64_t monotonic_ns() {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+// LatencyHistogram is an HDR-style log-linear histogram of nanosecond values.
+//
+// Values below 64 get a bucket each; above that every power of two is split into 32 equal buckets,
+// so any recorded value is off by at most ~3% when read back, across the whole 64-bit range. That's
+// 1920 counters (15 KiB) per histogram, and recording is a count-leading-zeros plus an increment -
+// cheap enough to leave switched on for every burst and every resend.
+class LatencyHistogram {
+public:
+    LatencyHistogram() : counts_(BUCKETS, 0), total_(0), sum_(0), min_(UINT64_MAX), max_(0) {}
+
+    // `count` lets a per-burst measurement stand in for each packet in the burst.
+    void record(uint64_t value_ns, uint64_t count = 1) {
+        if (count == 0) {
+            return;
+        }
+        counts_[bucket_of(value_ns)] += count;
+        total_ += count;
+        sum_ += value_ns * count;
+        if (value_ns < min_) min_ = value_ns;
+        if (value_ns > max_) max_ = value_ns;
+    }
+
+    uint64_t count() const { return total_; }
+    uint64_t min() const { return total_ == 0 ? 0 : min_; }
+    uint64_t max() const { return max_; }
+    double mean() const { return total_ == 0 ? 0.0 : static_cast<double>(sum_) / static_cast<double>(total_); }
+
+    // Value at percentile `p` (0..100): the top of the bucket the p-th value landed in, capped at max().
+    uint64_t percentile(double p) const {
+        if (total_ == 0) {
+            return 0;
+        }
+        uint64_t rank = static_cast<uint64_t>(p / 100.0 * static_cast<double>(total_) + 0.5);
+        if (rank < 1) rank = 1;
+        if (rank > total_) rank = total_;
+        uint64_t seen = 0;
+        for (size_t i = 0; i < BUCKETS; ++i) {
+            seen += counts_[i];
+            if (seen >= rank) {
+                uint64_t top = bucket_top(i);
+                return top < max_ ? top : max_;
+            }
+        }
+        return max_;
+    }
+
+private:
+    static const int SUB_BITS = 6;
+    static const uint64_t SUB_COUNT = uint64_t(1) << SUB_BITS; // 64
+    static const uint64_t HALF = SUB_COUNT / 2;                 // 32 buckets per power of two
+    static const size_t BUCKETS = (64 - SUB_BITS + 2) * HALF;   // 1920
+
+    static size_t bucket_of(uint64_t value) {
+        if (value < SUB_COUNT) {
+            return static_cast<size_t>(value);
+        }
+        int shift = (63 - __builtin_clzll(value)) - (SUB_BITS - 1); // value >> shift lands in [32, 64)
+        return static_cast<size_t>((shift + 1) * HALF + ((value >> shift) - HALF));
+    }
+
+    // Largest value that maps to bucket i.
+    static uint64_t bucket_top(size_t i) {
+        if (i < SUB_COUNT) {
+            return i;
+        }
+        int shift = static_cast<int>(i / HALF) - 1;
+        uint64_t sub = i % HALF + HALF;
+        return ((sub + 1) << shift) - 1;
+    }
+
+    std::vector<uint64_t> counts_;
+    uint64_t total_;
+    uint64_t sum_;
+    uint64_t min_;
+    uint64_t max_;
+};
+
+// The stages a collection run goes through, each with its own histogram.
+struct RunMetrics {
+    LatencyHistogram connect;       // connect() issued -> connection established (stream and resends)
+    LatencyHistogram first_byte;    // Stream request sent -> first data back
+    LatencyHistogram decode;        // Framing + decoding, per packet (each burst's time spread over its packets)
+    LatencyHistogram resend_rtt;    // Resend started -> its packet is back (includes the connect)
+    LatencyHistogram json_emit;     // Formatting + writing output.json, per packet
+
+    // Prints one line per stage that saw any samples: count, p50, p99, p99.9 and max in microseconds.
+    void print(std::ostream& out) const {
+        out << "Stage latencies (microseconds):" << std::endl;
+        out << "  " << std::left << std::setw(12) << "stage" << std::right << std::setw(10) << "count"
+            << std::setw(12) << "p50" << std::setw(12) << "p99" << std::setw(12) << "p99.9"
+            << std::setw(12) << "max" << std::endl;
+        for (size_t i = 0; i < STAGE_COUNT; ++i) {
+            const LatencyHistogram& h = stage(i);
+            if (h.count() == 0) {
+                continue;
+            }
+            out << "  " << std::left << std::setw(12) << stage_name(i) << std::right << std::setw(10) << h.count()
+                << std::fixed << std::setprecision(3)
+                << std::setw(12) << h.percentile(50.0) / 1000.0 << std::setw(12) << h.percentile(99.0) / 1000.0
+                << std::setw(12) << h.percentile(99.9) / 1000.0 << std::setw(12) << h.max() / 1000.0 << std::endl;
+            out.unsetf(std::ios_base::floatfield);
+        }
+    }
+
+    // Same numbers as a JSON object (nanoseconds), for scripts. False if the file couldn't be written.
+    bool write_json(const std::string& path) const {
+        std::ofstream file(path);
+        if (!file.is_open()) {
+            return false;
+        }
+        file << "{\n";
+        for (size_t i = 0; i < STAGE_COUNT; ++i) {
+            const LatencyHistogram& h = stage(i);
+            file << "    \"" << stage_name(i) << "\": {\"count\": " << h.count() << ", \"min_ns\": " << h.min()
+                 << ", \"mean_ns\": " << static_cast<uint64_t>(h.mean()) << ", \"p50_ns\": " << h.percentile(50.0)
+                 << ", \"p99_ns\": " << h.percentile(99.0) << ", \"p999_ns\": " << h.percentile(99.9)
+                 << ", \"max_ns\": " << h.max() << "}" << (i + 1 < STAGE_COUNT ? ",\n" : "\n");
+        }
+        file << "}\n";
+        return static_cast<bool>(file);
+    }
+
+private:
+    static const size_t STAGE_COUNT = 5;
+
+    const LatencyHistogram& stage(size_t i) const {
+        const LatencyHistogram* stages[STAGE_COUNT] = {&connect, &first_byte, &decode, &resend_rtt, &json_emit};
+        return *stages[i];
+    }
+
+    static const char* stage_name(size_t i) {
+        static const char* names[STAGE_COUNT] = {"connect", "first_byte", "decode", "resend_rtt", "json_emit"};
+        return names[i];
+    }
+};
+
+#endif // ABX_METRICS_H
@@ -0,0 +1,165 @@
+#ifndef ABX_ORDER_BOOK_H
+#define ABX_ORDER_BOOK_H
+
+#include <vector>
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+
+#include "packet.h"
+#include "symbol_table.h"
+
+// Per-symbol price-level books rebuilt from the packet stream.
+//
+// Each packet is read as a price-level update: on the side its buysell_indicator names ('B' = bid,
+// 'S' = ask), the level at `price` now holds `quantity` in total. A quantity of 0 (or less) removes
+// the level. Applied in sequence order, that leaves each book holding the latest state of every level.
+//
+// Each side is a flat, sorted std::vector of levels rather than a node-based map. The best price is
+// kept at the back: for bids the highest price, for asks the lowest. Most updates land near the top
+// of the book, so they only touch the last few cache lines, and inserting or removing there moves
+// almost nothing. Best price and depth are plain reads from the back of the array.
+
+struct PriceLevel {
+    int32_t price;
+    int32_t quantity;
+};
+
+class BookSide {
+public:
+    explicit BookSide(bool bids) : bids_(bids) {}
+
+    // Sets the level at `price` to `quantity` (0 or less removes it).
+    void set(int32_t price, int32_t quantity) {
+        // levels_ runs worst -> best, so the top of the book is the end of the vector.
+        std::vector<PriceLevel>::iterator it = find(price);
+        bool exists = it != levels_.end() && it->price == price;
+        if (quantity <= 0) {
+            if (exists) {
+                levels_.erase(it);
+            }
+        } else if (exists) {
+            it->quantity = quantity;
+        } else {
+            levels_.insert(it, PriceLevel{price, quantity});
+        }
+    }
+
+    bool empty() const { return levels_.empty(); }
+    size_t depth() const { return levels_.size(); }
+
+    // i-th best level, 0 being the top of the book. Only for i < depth().
+    const PriceLevel& level(size_t i) const { return levels_[levels_.size() - 1 - i]; }
+    const PriceLevel& best() const { return levels_.back(); }
+
+    // Total quantity over the best `levels` levels.
+    int64_t quantity_within(size_t levels) const {
+        int64_t total = 0;
+        for (size_t i = 0; i < levels && i < levels_.size(); ++i) {
+            total += level(i).quantity;
+        }
+        return total;
+    }
+
+private:
+    // Worse price sorts first; for bids that's lower, for asks higher.
+    bool worse(int32_t a, int32_t b) const { return bids_ ? a < b : a > b; }
+
+    // First level that isn't worse than `price`: the level itself if it exists, otherwise where it
+    // would go. Levels near the top are checked straight off the back before falling back to a
+    // binary search.
+    std::vector<PriceLevel>::iterator find(int32_t price) {
+        static const size_t LINEAR_PROBE = 8;
+        size_t n = levels_.size();
+        size_t probe = n < LINEAR_PROBE ? n : LINEAR_PROBE;
+        for (size_t k = 0; k < probe; ++k) {
+            size_t i = n - 1 - k;
+            if (worse(levels_[i].price, price)) {
+                return levels_.begin() + static_cast<std::ptrdiff_t>(i + 1);
+            }
+        }
+        if (probe == n) {
+            return levels_.begin();
+        }
+        return std::lower_bound(levels_.begin(), levels_.end() - static_cast<std::ptrdiff_t>(probe), price,
+                                [this](const PriceLevel& level, int32_t p) { return worse(level.price, p); });
+    }
+
+    bool bids_;
+    std::vector<PriceLevel> levels_;
+};
+
+class OrderBook {
+public:
+    OrderBook() : bids_(true), asks_(false), updates_(0) {}
+
+    // False (and nothing changes) if the side isn't 'B' or 'S'.
+    bool apply(const Packet& packet) {
+        if (packet.buysell_indicator == 'B') {
+            bids_.set(packet.price, packet.quantity);
+        } else if (packet.buysell_indicator == 'S') {
+            asks_.set(packet.price, packet.quantity);
+        } else {
+            return false;
+        }
+        ++updates_;
+        return true;
+    }
+
+    const BookSide& bids() const { return bids_; }
+    const BookSide& asks() const { return asks_; }
+    size_t updates() const { return updates_; }
+
+    // Both sides have at least one level.
+    bool two_sided() const { return !bids_.empty() && !asks_.empty(); }
+    // Best bid at or above the best ask, which a live book shouldn't be for long.
+    bool crossed() const { return two_sided() && bids_.best().price >= asks_.best().price; }
+
+private:
+    BookSide bids_;
+    BookSide asks_;
+    size_t updates_;
+};
+
+// OrderBookEngine keeps one OrderBook per symbol, indexed by the SymbolTable's dense ids, and
+// applies packets to them. Packets are expected in sequence order; one that doesn't move the sequence
+// forward is counted as out of order and left out, so a replay can't roll a level back.
+class OrderBookEngine {
+public:
+    OrderBookEngine() : last_sequence_(0), rejected_(0), out_of_order_(0) {}
+
+    // True if the packet changed a book.
+    bool apply(const Packet& packet) {
+        if (packet.sequence <= last_sequence_) {
+            ++out_of_order_;
+            return false;
+        }
+        uint32_t id = symbols_.intern(packet.symbol);
+        if (id >= books_.size()) {
+            books_.resize(id + 1);
+        }
+        if (!books_[id].apply(packet)) {
+            ++rejected_;
+            return false;
+        }
+        last_sequence_ = packet.sequence;
+        return true;
+    }
+
+    size_t symbol_count() const { return books_.size(); }
+    const OrderBook& book(uint32_t id) const { return books_[id]; }
+    const std::string& symbol_name(uint32_t id) const { return symbols_.name_of(id); }
+
+    int32_t last_sequence() const { return last_sequence_; }
+    size_t rejected() const { return rejected_; }        // Side wasn't 'B' or 'S'
+    size_t out_of_order() const { return out_of_order_; }
+
+private:
+    SymbolTable symbols_;
+    std::vector<OrderBook> books_;   // By symbol id
+    int32_t last_sequence_;
+    size_t rejected_;
+    size_t out_of_order_;
+};
+
+#endif // ABX_ORDER_BOOK_H
@@ -0,0 +1,130 @@
+#ifndef ABX_PACKET_H
+#define ABX_PACKET_H
+
+#include <string>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>  // memcpy
+#include <type_traits>
+
+#include "packet_schema.h" // WireSchema: the wire layout, described once
+
+// Let's define what a packet looks like once we pull it off the wire.
+//
+// Everything is fixed-size so a Packet is plain old data: 20 bytes, no heap, trivially copyable.
+// The store can hold millions of them back to back and they can be memcpy'd straight to disk.
+// The symbol stays as its raw 4 ASCII bytes packed into a uint32_t (memory order, so the bytes read
+// the same as on the wire); SymbolTable turns that code into a trimmed name when someone needs text.
+struct Packet {
+    uint32_t symbol;             // Like "MSFT" or "AAPL", see symbol_text()
+    int32_t quantity;            // How many shares
+    int32_t price;               // The price level
+    int32_t sequence;            // The packet's unique sequence number
+    char buysell_indicator;      // Should be 'B' or 'S'
+    char reserved[3];            // Explicit padding, always zero so the bytes on disk are deterministic
+
+    // The symbol bytes exactly as they came in (trailing spaces and all).
+    std::string symbol_text() const { return std::string(reinterpret_cast<const char*>(&symbol), 4); }
+
+    // Little helper to describe packet details, good for debugging! Whoever logs it brings the logger,
+    // so this header stays plain data.
+    std::string describe() const {
+        return "Seq: " + std::to_string(sequence) + ", Symbol: " + symbol_text() + ", Side: " +
+               std::string(1, buysell_indicator) + ", Qty: " + std::to_string(quantity) +
+               ", Price: " + std::to_string(price);
+    }
+};
+
+static_assert(std::is_trivially_copyable<Packet>::value, "Packet has to stay memcpy-able");
+static_assert(std::is_standard_layout<Packet>::value, "Packet has to stay memcpy-able");
+static_assert(sizeof(Packet) == 20, "Packet layout changed - anything persisting it needs a look");
+
+// Packs 4 symbol characters the same way the decoders do.
+inline uint32_t symbol_code(const char* text) {
+    uint32_t code;
+    std::memcpy(&code, text, 4);
+    return code;
+}
+
+// The wire layout, in order: 17 bytes, no padding. PACKET_SIZE, parse_packet(), encode_packet(),
+// PacketView's offsets and the keys in output.json all come from this one list (see packet_schema.h),
+// so they can't drift apart. The JSON keys are the ones output.json has always used.
+inline constexpr char JSON_KEY_SYMBOL[] = "symbol";
+inline constexpr char JSON_KEY_BUYSELL[] = "buysell_indicator";
+inline constexpr char JSON_KEY_QUANTITY[] = "quantity";
+inline constexpr char JSON_KEY_PRICE[] = "price";
+inline constexpr char JSON_KEY_SEQUENCE[] = "packetSequence";
+
+using SymbolField = WireField<&Packet::symbol, WireType::Ascii4, JSON_KEY_SYMBOL>;
+using BuySellField = WireField<&Packet::buysell_indicator, WireType::Char, JSON_KEY_BUYSELL>;
+using QuantityField = WireField<&Packet::quantity, WireType::Int32BE, JSON_KEY_QUANTITY>;
+using PriceField = WireField<&Packet::price, WireType::Int32BE, JSON_KEY_PRICE>;
+using SequenceField = WireField<&Packet::sequence, WireType::Int32BE, JSON_KEY_SEQUENCE>;
+
+using PacketWire = WireSchema<SymbolField, BuySellField, QuantityField, PriceField, SequenceField>;
+
+// The size of each packet is fixed, makes things easier.
+const size_t PACKET_SIZE = PacketWire::size;
+static_assert(PACKET_SIZE == 17, "ABX packets are 17 bytes - the server and the SIMD decoders assume it");
+
+// PacketView reads fields straight out of PACKET_SIZE wire bytes, only the ones asked for and only
+// when asked. Something that just wants the sequence (gap checks) or just the price doesn't pay for
+// decoding and copying the whole packet. It doesn't own the bytes: they have to outlive the view.
+class PacketView {
+public:
+    constexpr explicit PacketView(const unsigned char* data) : data_(data) {}
+
+    // Same code Packet::symbol holds. Not constexpr: it's a memcpy, so it matches the decoders on any host.
+    uint32_t symbol() const {
+        return symbol_code(reinterpret_cast<const char*>(data_ + PacketWire::offset_of<SymbolField>()));
+    }
+    constexpr char buysell_indicator() const { return static_cast<char>(data_[PacketWire::offset_of<BuySellField>()]); }
+    constexpr int32_t quantity() const { return load_be32(data_ + PacketWire::offset_of<QuantityField>()); }
+    constexpr int32_t price() const { return load_be32(data_ + PacketWire::offset_of<PriceField>()); }
+    constexpr int32_t sequence() const { return load_be32(data_ + PacketWire::offset_of<SequenceField>()); }
+
+    constexpr const unsigned char* data() const { return data_; }
+
+    // All of it, for when the packet is being kept.
+    Packet to_packet() const;
+
+private:
+    const unsigned char* data_;
+};
+
+namespace abx_detail {
+constexpr unsigned char SAMPLE_WIRE_PACKET[PACKET_SIZE] = {'M', 'S', 'F', 'T', 'B', 0, 0, 0, 50,
+                                                           0, 0, 0x01, 0x2C, 0x80, 0, 0, 7};
+}
+static_assert(PacketView(abx_detail::SAMPLE_WIRE_PACKET).quantity() == 50 &&
+              PacketView(abx_detail::SAMPLE_WIRE_PACKET).price() == 300 &&
+              PacketView(abx_detail::SAMPLE_WIRE_PACKET).sequence() == static_cast<int32_t>(0x80000007u) &&
+              PacketView(abx_detail::SAMPLE_WIRE_PACKET).buysell_indicator() == 'B',
+              "PacketView has to read the wire format big-endian");
+
+// Function to take those raw bytes and turn them into our Packet struct.
+// `data` has to point at (at least) PACKET_SIZE bytes - the framer hands us exactly that.
+// PacketWire unrolls into one load per field: the symbol's bytes as they are (SymbolTable trims them
+// once per distinct symbol), the side byte, and three big-endian ints.
+inline Packet parse_packet(const unsigned char* data) {
+    Packet packet = {}; // Zeroes the padding too
+    PacketWire::decode(data, packet);
+    return packet;
+}
+
+inline Packet PacketView::to_packet() const { return parse_packet(data_); }
+
+// The other direction: writes `packet` as PACKET_SIZE wire bytes at `out` (the mock server and the
+// benchmarks need to produce what a real exchange would send).
+inline void encode_packet(const Packet& packet, unsigned char* out) {
+    PacketWire::encode(packet, out);
+}
+
+// Same thing, for when the bytes are sitting in a vector (like the single resent packet buffer).
+inline Packet parse_packet(const std::vector<char>& raw_data, size_t offset) {
+    // Using unsigned char pointer helps avoid any weird signedness issues with raw bytes.
+    return parse_packet(reinterpret_cast<const unsigned char*>(raw_data.data() + offset));
+}
+
+#endif // ABX_PACKET_H
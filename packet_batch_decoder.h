@@ -0,0 +1,244 @@
+#ifndef ABX_PACKET_BATCH_DECODER_H
+#define ABX_PACKET_BATCH_DECODER_H
+
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>  // memcpy
+
+#include "packet.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define ABX_DECODER_HAS_X86 1
+#else
+#define ABX_DECODER_HAS_X86 0
+#endif
+
+// Batch decoding for runs of back-to-back packets (exactly what PacketFramer::packets() gives us).
+//
+// parse_packet() builds one Packet at a time, field by field. When we've got a
+// whole burst sitting in memory it's much cheaper to decode it column-wise: every field goes into its
+// own array, the symbol stays as its raw 4 bytes, and the three big-endian ints get byte-swapped with
+// SIMD shuffles. Which implementation runs is picked once at runtime from what the CPU supports
+// (AVX2, then SSE4.1, then plain scalar code), so the same binary works on any x86-64 box.
+
+// Where decoded fields go. Caller owns the arrays; each needs room for `count` entries.
+struct PacketColumns {
+    uint32_t* symbol;            // The 4 ASCII symbol bytes, copied as-is (memory order, not a number!)
+    char* buysell_indicator;     // 'B' or 'S'
+    int32_t* quantity;
+    int32_t* price;
+    int32_t* sequence;
+};
+
+// Owning version of the columns, handy for a decode buffer that gets reused every recv().
+struct DecodedBatch {
+    std::vector<uint32_t> symbol;
+    std::vector<char> buysell_indicator;
+    std::vector<int32_t> quantity;
+    std::vector<int32_t> price;
+    std::vector<int32_t> sequence;
+    size_t count = 0;
+
+    // Makes room for `n` packets. Only ever grows, so steady state doesn't allocate.
+    PacketColumns prepare(size_t n) {
+        if (symbol.size() < n) {
+            symbol.resize(n);
+            buysell_indicator.resize(n);
+            quantity.resize(n);
+            price.resize(n);
+            sequence.resize(n);
+        }
+        count = n;
+        PacketColumns columns = {symbol.data(), buysell_indicator.data(), quantity.data(), price.data(), sequence.data()};
+        return columns;
+    }
+
+    // Turns row `i` back into a regular Packet, for code that still wants one.
+    Packet packet(size_t i) const {
+        Packet p = {};
+        p.symbol = symbol[i];
+        p.buysell_indicator = buysell_indicator[i];
+        p.quantity = quantity[i];
+        p.price = price[i];
+        p.sequence = sequence[i];
+        return p;
+    }
+};
+
+enum class DecoderKind { Scalar, SSE41, AVX2 };
+
+inline const char* decoder_name(DecoderKind kind) {
+    switch (kind) {
+        case DecoderKind::AVX2: return "avx2";
+        case DecoderKind::SSE41: return "sse4.1";
+        default: return "scalar";
+    }
+}
+
+namespace abx_detail {
+
+inline void decode_scalar(const unsigned char* packets, size_t count, const PacketColumns& out) {
+    for (size_t i = 0; i < count; ++i) {
+        PacketView p(packets + i * PACKET_SIZE);
+        out.symbol[i] = p.symbol();
+        out.buysell_indicator[i] = p.buysell_indicator();
+        out.quantity[i] = p.quantity();
+        out.price[i] = p.price();
+        out.sequence[i] = p.sequence();
+    }
+}
+
+#if ABX_DECODER_HAS_X86
+
+// The shuffle masks below are written for this exact layout; if PacketWire changes, they have to too.
+static_assert(PacketWire::offset_of<BuySellField>() == 4 && PacketWire::offset_of<QuantityField>() == 5 &&
+              PacketWire::offset_of<PriceField>() == 9 && PacketWire::offset_of<SequenceField>() == 13 &&
+              PACKET_SIZE == 17, "The SIMD decoders' shuffle masks don't match PacketWire any more");
+
+// The trick: load the 16 bytes at packet+1 (side, quantity, price, sequence - exactly the tail of the
+// packet, so we never read past it) and shuffle them into four little-endian int32 lanes:
+//   lane 0 = quantity, lane 1 = price, lane 2 = sequence, lane 3 = side byte (zero-extended).
+// Four packets give a 4x4 matrix of lanes; transposing it turns rows-per-packet into rows-per-field,
+// which we can store straight into the column arrays.
+__attribute__((target("ssse3,sse4.1")))
+inline __m128i shuffle_fields_128(const unsigned char* packet) {
+    const __m128i swap_mask = _mm_setr_epi8(7, 6, 5, 4,       // quantity (packet bytes 5..8)
+                                            11, 10, 9, 8,     // price (9..12)
+                                            15, 14, 13, 12,   // sequence (13..16)
+                                            3, -128, -128, -128); // side (byte 4), zero padded
+    return _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(packet + 1)), swap_mask);
+}
+
+__attribute__((target("ssse3,sse4.1")))
+inline void decode_sse41(const unsigned char* packets, size_t count, const PacketColumns& out) {
+    // Grabs byte 0 of each int32 lane - that's where the side characters ended up after the transpose.
+    const __m128i side_gather = _mm_setr_epi8(0, 4, 8, 12, -128, -128, -128, -128,
+                                              -128, -128, -128, -128, -128, -128, -128, -128);
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        const unsigned char* p = packets + i * PACKET_SIZE;
+        __m128i a = shuffle_fields_128(p);
+        __m128i b = shuffle_fields_128(p + PACKET_SIZE);
+        __m128i c = shuffle_fields_128(p + 2 * PACKET_SIZE);
+        __m128i d = shuffle_fields_128(p + 3 * PACKET_SIZE);
+
+        __m128i ab_lo = _mm_unpacklo_epi32(a, b);   // qa qb pa pb
+        __m128i cd_lo = _mm_unpacklo_epi32(c, d);   // qc qd pc pd
+        __m128i ab_hi = _mm_unpackhi_epi32(a, b);   // sa sb xa xb
+        __m128i cd_hi = _mm_unpackhi_epi32(c, d);   // sc sd xc xd
+
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out.quantity + i), _mm_unpacklo_epi64(ab_lo, cd_lo));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out.price + i), _mm_unpackhi_epi64(ab_lo, cd_lo));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out.sequence + i), _mm_unpacklo_epi64(ab_hi, cd_hi));
+
+        int32_t sides = _mm_cvtsi128_si32(_mm_shuffle_epi8(_mm_unpackhi_epi64(ab_hi, cd_hi), side_gather));
+        std::memcpy(out.buysell_indicator + i, &sides, 4);
+
+        for (size_t k = 0; k < 4; ++k) {
+            std::memcpy(&out.symbol[i + k], p + k * PACKET_SIZE, 4);
+        }
+    }
+    // Whatever doesn't fill a group of four.
+    PacketColumns tail = {out.symbol + i, out.buysell_indicator + i, out.quantity + i, out.price + i, out.sequence + i};
+    decode_scalar(packets + i * PACKET_SIZE, count - i, tail);
+}
+
+// Same idea with 256-bit registers: each register holds two packets (one per 128-bit lane), and the
+// unpack instructions work per lane, so one transpose handles eight packets.
+__attribute__((target("avx2")))
+inline __m256i shuffle_fields_256(const unsigned char* low_packet, const unsigned char* high_packet) {
+    const __m256i swap_mask = _mm256_setr_epi8(7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12, 3, -128, -128, -128,
+                                               7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12, 3, -128, -128, -128);
+    __m128i low = _mm_loadu_si128(reinterpret_cast<const __m128i*>(low_packet + 1));
+    __m128i high = _mm_loadu_si128(reinterpret_cast<const __m128i*>(high_packet + 1));
+    __m256i both = _mm256_inserti128_si256(_mm256_castsi128_si256(low), high, 1);
+    return _mm256_shuffle_epi8(both, swap_mask);
+}
+
+__attribute__((target("avx2")))
+inline void decode_avx2(const unsigned char* packets, size_t count, const PacketColumns& out) {
+    const __m256i side_gather = _mm256_setr_epi8(0, 4, 8, 12, -128, -128, -128, -128,
+                                                 -128, -128, -128, -128, -128, -128, -128, -128,
+                                                 0, 4, 8, 12, -128, -128, -128, -128,
+                                                 -128, -128, -128, -128, -128, -128, -128, -128);
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        const unsigned char* p = packets + i * PACKET_SIZE;
+        // Packets 0-3 go in the low lanes and 4-7 in the high lanes, so after the per-lane transpose
+        // each output register is eight consecutive values of one field.
+        __m256i a = shuffle_fields_256(p, p + 4 * PACKET_SIZE);
+        __m256i b = shuffle_fields_256(p + PACKET_SIZE, p + 5 * PACKET_SIZE);
+        __m256i c = shuffle_fields_256(p + 2 * PACKET_SIZE, p + 6 * PACKET_SIZE);
+        __m256i d = shuffle_fields_256(p + 3 * PACKET_SIZE, p + 7 * PACKET_SIZE);
+
+        __m256i ab_lo = _mm256_unpacklo_epi32(a, b);
+        __m256i cd_lo = _mm256_unpacklo_epi32(c, d);
+        __m256i ab_hi = _mm256_unpackhi_epi32(a, b);
+        __m256i cd_hi = _mm256_unpackhi_epi32(c, d);
+
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out.quantity + i), _mm256_unpacklo_epi64(ab_lo, cd_lo));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out.price + i), _mm256_unpackhi_epi64(ab_lo, cd_lo));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out.sequence + i), _mm256_unpacklo_epi64(ab_hi, cd_hi));
+
+        __m256i sides = _mm256_shuffle_epi8(_mm256_unpackhi_epi64(ab_hi, cd_hi), side_gather);
+        int32_t low_sides = _mm256_cvtsi256_si32(sides);
+        int32_t high_sides = _mm256_extract_epi32(sides, 4);
+        std::memcpy(out.buysell_indicator + i, &low_sides, 4);
+        std::memcpy(out.buysell_indicator + i + 4, &high_sides, 4);
+
+        for (size_t k = 0; k < 8; ++k) {
+            std::memcpy(&out.symbol[i + k], p + k * PACKET_SIZE, 4);
+        }
+    }
+    PacketColumns tail = {out.symbol + i, out.buysell_indicator + i, out.quantity + i, out.price + i, out.sequence + i};
+    decode_sse41(packets + i * PACKET_SIZE, count - i, tail);
+}
+
+#endif // ABX_DECODER_HAS_X86
+
+} // namespace abx_detail
+
+// Which decoder this CPU can run. __builtin_cpu_supports does the CPUID (and OS AVX state) checks for us.
+inline DecoderKind best_decoder() {
+#if ABX_DECODER_HAS_X86
+    static const DecoderKind kind = __builtin_cpu_supports("avx2") ? DecoderKind::AVX2
+                                  : __builtin_cpu_supports("sse4.1") ? DecoderKind::SSE41
+                                  : DecoderKind::Scalar;
+    return kind;
+#else
+    return DecoderKind::Scalar;
+#endif
+}
+
+// Decodes `count` back-to-back packets starting at `packets` into `out`, using `kind`.
+// Asking for something the CPU can't do quietly drops down to the best supported decoder.
+inline void decode_packets(const unsigned char* packets, size_t count, const PacketColumns& out,
+                           DecoderKind kind) {
+#if ABX_DECODER_HAS_X86
+    DecoderKind supported = best_decoder();
+    if (kind == DecoderKind::AVX2 && supported == DecoderKind::AVX2) {
+        abx_detail::decode_avx2(packets, count, out);
+        return;
+    }
+    if (kind != DecoderKind::Scalar && supported != DecoderKind::Scalar) {
+        abx_detail::decode_sse41(packets, count, out);
+        return;
+    }
+#else
+    (void)kind;
+#endif
+    abx_detail::decode_scalar(packets, count, out);
+}
+
+inline void decode_packets(const unsigned char* packets, size_t count, const PacketColumns& out) {
+    decode_packets(packets, count, out, best_decoder());
+}
+
+// The usual way to call it: decode straight into a reusable DecodedBatch.
+inline void decode_packets(const unsigned char* packets, size_t count, DecodedBatch& batch) {
+    decode_packets(packets, count, batch.prepare(count));
+}
+
+#endif // ABX_PACKET_BATCH_DECODER_H
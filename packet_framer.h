@@ -0,0 +1,160 @@
+#ifndef ABX_PACKET_FRAMER_H
+#define ABX_PACKET_FRAMER_H
+
+#include <vector>
+#include <cstddef>
+#include <cstring>  // memmove
+#include <cerrno>
+
+#include <sys/types.h>
+#include <sys/socket.h>     // recv
+
+#include "packet.h"
+
+// PacketFramer turns the raw TCP byte stream into complete PACKET_SIZE-byte packets.
+//
+// The old Stage 3 loop appended each recv() to a std::vector<char> and then erased every packet
+// off the front, which memmoves the whole rest of the buffer once per packet - O(N^2) for a burst.
+// Instead we keep one fixed block of memory with two cursors:
+//
+//   [0, read_pos)            already handed out, free to reuse
+//   [read_pos, write_pos)    received but not consumed yet
+//   [write_pos, capacity)    free space that recv() writes straight into
+//
+// Complete packets are always contiguous in [read_pos, write_pos), so callers get pointers right
+// into the buffer (no copies). The only time bytes move is when the free tail gets too small to be
+// worth a recv(): then whatever is left over gets slid to the front. As long as callers drain all
+// complete packets after each receive, that leftover is a partial packet (< PACKET_SIZE bytes).
+class PacketFramer {
+public:
+    static const size_t DEFAULT_CAPACITY = 64 * 1024;
+
+    // Capacity gets rounded up to a power of two (and never below a handful of packets).
+    explicit PacketFramer(size_t capacity = DEFAULT_CAPACITY)
+        : buffer_(round_up_pow2(capacity > MIN_CAPACITY ? capacity : static_cast<size_t>(MIN_CAPACITY))),
+          read_pos_(0),
+          write_pos_(0) {}
+
+    // Where the next bytes should land, and how many fit there.
+    // Call prepare_write() first if you want the framer to make room.
+    char* write_ptr() { return buffer_.data() + write_pos_; }
+    size_t writable() const { return buffer_.size() - write_pos_; }
+
+    // Tell the framer that `n` bytes were written at write_ptr().
+    void commit(size_t n) { write_pos_ += n; }
+
+    // Reclaims consumed space so there's a decent chunk free at write_ptr().
+    void prepare_write() {
+        if (read_pos_ == write_pos_) {
+            // Everything got consumed - just rewind, nothing to move.
+            read_pos_ = write_pos_ = 0;
+        } else if (writable() < buffer_.size() / 4 && read_pos_ > 0) {
+            // Running out of tail room. Slide the leftover (normally a partial packet) to the front.
+            size_t pending = write_pos_ - read_pos_;
+            std::memmove(buffer_.data(), buffer_.data() + read_pos_, pending);
+            read_pos_ = 0;
+            write_pos_ = pending;
+        }
+    }
+
+    // recv() straight into the free space. Same return convention as recv():
+    // > 0 bytes read, 0 for peer closed, -1 with errno set (ENOBUFS if the buffer is full because
+    // nobody consumed the packets sitting in it).
+    ssize_t receive(int socket_fd, int flags = 0) {
+        prepare_write();
+        if (writable() == 0) {
+            errno = ENOBUFS;
+            return -1;
+        }
+        ssize_t bytes_read = recv(socket_fd, write_ptr(), writable(), flags);
+        if (bytes_read > 0) {
+            commit(static_cast<size_t>(bytes_read));
+        }
+        return bytes_read;
+    }
+
+    // Copies a chunk that arrived some other way (tests, benchmarks, other transports).
+    // Returns how many bytes fit - could be less than `size` if the buffer is full.
+    size_t append(const char* data, size_t size) {
+        prepare_write();
+        size_t n = size < writable() ? size : writable();
+        std::memcpy(write_ptr(), data, n);
+        commit(n);
+        return n;
+    }
+
+    // Frames a chunk that's already sitting in someone else's memory (say, a buffer the kernel just
+    // filled) without copying it in wholesale. Whole packets inside the chunk are handed to
+    // on_run(first_packet, count) right where they are; only a packet straddling two chunks gets
+    // stitched together in our own buffer. Any unconsumed packets already in here go out first.
+    template <typename RunHandler>
+    void frame_chunk(const char* data, size_t size, RunHandler on_run) {
+        if (pending_bytes() > 0) {
+            size_t partial = pending_bytes() % PACKET_SIZE;
+            size_t take = partial == 0 ? 0 : PACKET_SIZE - partial;
+            if (take > size) {
+                take = size;
+            }
+            append(data, take);
+            data += take;
+            size -= take;
+            size_t ready = complete_packets();
+            if (ready > 0) {
+                on_run(packets(), ready);
+                consume(ready);
+            }
+            if (pending_bytes() > 0) {
+                return; // Chunk was too small to even finish the partial packet
+            }
+        }
+        size_t whole = size / PACKET_SIZE;
+        if (whole > 0) {
+            on_run(reinterpret_cast<const unsigned char*>(data), whole);
+        }
+        append(data + whole * PACKET_SIZE, size - whole * PACKET_SIZE);
+    }
+
+    // How many full packets are ready, and a pointer to the first one.
+    // They're back-to-back, so packet i lives at packets() + i * PACKET_SIZE.
+    size_t complete_packets() const { return (write_pos_ - read_pos_) / PACKET_SIZE; }
+    const unsigned char* packets() const {
+        return reinterpret_cast<const unsigned char*>(buffer_.data() + read_pos_);
+    }
+
+    // Mark `count` packets (from the front) as handled.
+    void consume(size_t count) { read_pos_ += count * PACKET_SIZE; }
+
+    // Convenience for one-at-a-time loops: hands out a view of the next packet and consumes it.
+    // The pointer stays valid until the next receive()/append()/prepare_write().
+    bool next_packet(const unsigned char*& packet) {
+        if (write_pos_ - read_pos_ < PACKET_SIZE) {
+            return false;
+        }
+        packet = packets();
+        read_pos_ += PACKET_SIZE;
+        return true;
+    }
+
+    // Bytes received but not handed out yet (a partial packet at the end of a stream ends up here).
+    size_t pending_bytes() const { return write_pos_ - read_pos_; }
+    size_t capacity() const { return buffer_.size(); }
+
+    void reset() { read_pos_ = write_pos_ = 0; }
+
+private:
+    static const size_t MIN_CAPACITY = 8 * PACKET_SIZE;
+
+    static size_t round_up_pow2(size_t value) {
+        size_t result = 1;
+        while (result < value) {
+            result <<= 1;
+        }
+        return result;
+    }
+
+    std::vector<char> buffer_;
+    size_t read_pos_;
+    size_t write_pos_;
+};
+
+#endif // ABX_PACKET_FRAMER_H
@@ -0,0 +1,164 @@
+#ifndef ABX_PACKET_SCHEMA_H
+#define ABX_PACKET_SCHEMA_H
+
+#include <utility>   // index_sequence
+#include <type_traits>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>   // memcpy
+
+// A compile-time description of a fixed-size wire format, and everything that can be generated
+// from it: total size, field offsets, a decoder, an encoder, and a per-field walk for output.
+//
+// A schema is a list of WireField<member, type, json name> in wire order. Offsets are running sums of
+// the field sizes, all constexpr, so decode() and encode() expand into one straight-line load or
+// store per field, the same code you'd write by hand but without the hand-typed offsets. packet.h
+// describes the ABX packet this way; adding a field there updates PACKET_SIZE, the decoders, the
+// encoder and output.json together.
+
+// How a field is laid out on the wire.
+enum class WireType {
+    Ascii4,   // 4 ASCII bytes, kept as they are in a uint32_t (memory order)
+    Char,     // 1 ASCII byte
+    Int32BE,  // Big-endian int32
+};
+
+// Big-endian int32 at `p`, the way every number on the wire is sent. constexpr, so it works on
+// constant byte arrays at compile time too.
+constexpr int32_t load_be32(const unsigned char* p) {
+    return static_cast<int32_t>((static_cast<uint32_t>(p[0]) << 24) |
+                                (static_cast<uint32_t>(p[1]) << 16) |
+                                (static_cast<uint32_t>(p[2]) << 8) |
+                                 static_cast<uint32_t>(p[3]));
+}
+
+inline void store_be32(int32_t value, unsigned char* out) {
+    uint32_t bits = static_cast<uint32_t>(value);
+    out[0] = static_cast<unsigned char>(bits >> 24); // Most significant first
+    out[1] = static_cast<unsigned char>(bits >> 16);
+    out[2] = static_cast<unsigned char>(bits >> 8);
+    out[3] = static_cast<unsigned char>(bits);
+}
+
+template <WireType Type>
+struct WireCodec;
+
+template <>
+struct WireCodec<WireType::Ascii4> {
+    static constexpr size_t size = 4;
+    static void decode(const unsigned char* in, uint32_t& value) { std::memcpy(&value, in, 4); }
+    static void encode(uint32_t value, unsigned char* out) { std::memcpy(out, &value, 4); }
+};
+
+template <>
+struct WireCodec<WireType::Char> {
+    static constexpr size_t size = 1;
+    static void decode(const unsigned char* in, char& value) { value = static_cast<char>(in[0]); }
+    static void encode(char value, unsigned char* out) { out[0] = static_cast<unsigned char>(value); }
+};
+
+template <>
+struct WireCodec<WireType::Int32BE> {
+    static constexpr size_t size = 4;
+    static void decode(const unsigned char* in, int32_t& value) { value = load_be32(in); }
+    static void encode(int32_t value, unsigned char* out) { store_be32(value, out); }
+};
+
+// One field: which struct member it fills, how it's encoded, and its key in the JSON output.
+// `JsonName` has to be a constexpr char array with linkage (string literals can't be template args).
+template <auto Member, WireType Type, const char* JsonName>
+struct WireField {
+    static constexpr WireType type = Type;
+    static constexpr size_t size = WireCodec<Type>::size;
+    static constexpr const char* json_name = JsonName;
+
+    template <typename Struct>
+    static void decode(const unsigned char* in, Struct& out) { WireCodec<Type>::decode(in, out.*Member); }
+
+    template <typename Struct>
+    static void encode(const Struct& in, unsigned char* out) { WireCodec<Type>::encode(in.*Member, out); }
+
+    template <typename Struct>
+    static auto get(const Struct& in) -> decltype(in.*Member) { return in.*Member; }
+
+    // Where the member sits inside the decoded struct, for formats that share the struct itself.
+    template <typename Struct>
+    static size_t member_offset() {
+        static const Struct probe = {};
+        return static_cast<size_t>(reinterpret_cast<const char*>(&(probe.*Member)) -
+                                   reinterpret_cast<const char*>(&probe));
+    }
+};
+
+template <typename... Fields>
+struct WireSchema {
+    static constexpr size_t field_count = sizeof...(Fields);
+    static constexpr size_t size = (Fields::size + ... + 0);
+
+    // Byte offset of the I-th field.
+    template <size_t I>
+    static constexpr size_t offset() {
+        constexpr size_t sizes[] = {Fields::size...};
+        size_t total = 0;
+        for (size_t i = 0; i < I; ++i) {
+            total += sizes[i];
+        }
+        return total;
+    }
+
+    // Byte offset of `Field`, which has to be one of this schema's fields.
+    template <typename Field>
+    static constexpr size_t offset_of() {
+        static_assert((std::is_same<Field, Fields>::value || ...), "Field isn't part of this schema");
+        return offset_of_impl<Field>(std::index_sequence_for<Fields...>());
+    }
+
+    // `in` has to point at (at least) `size` bytes.
+    template <typename Struct>
+    static void decode(const unsigned char* in, Struct& out) {
+        decode_impl(in, out, std::index_sequence_for<Fields...>());
+    }
+
+    template <typename Struct>
+    static void encode(const Struct& in, unsigned char* out) {
+        encode_impl(in, out, std::index_sequence_for<Fields...>());
+    }
+
+    // Calls visit(field_tag, value) for each field in wire order, where field_tag is a
+    // value-initialised Field (so visitors can overload on Field::type or read Field::json_name).
+    template <typename Struct, typename Visit>
+    static void for_each_field(const Struct& in, Visit&& visit) {
+        (visit(Fields(), Fields::get(in)), ...);
+    }
+
+    // Calls visit(field_tag, wire_offset) for each field in wire order, with no struct involved.
+    template <typename Visit>
+    static void for_each_field_type(Visit&& visit) {
+        for_each_field_type_impl(visit, std::index_sequence_for<Fields...>());
+    }
+
+private:
+    template <typename Visit, size_t... I>
+    static void for_each_field_type_impl(Visit& visit, std::index_sequence<I...>) {
+        (visit(Fields(), offset<I>()), ...);
+    }
+
+    template <typename Field, size_t... I>
+    static constexpr size_t offset_of_impl(std::index_sequence<I...>) {
+        size_t found = 0;
+        ((std::is_same<Field, Fields>::value ? (found = offset<I>(), 0) : 0), ...);
+        return found;
+    }
+
+    template <typename Struct, size_t... I>
+    static void decode_impl(const unsigned char* in, Struct& out, std::index_sequence<I...>) {
+        (Fields::decode(in + offset<I>(), out), ...);
+    }
+
+    template <typename Struct, size_t... I>
+    static void encode_impl(const Struct& in, unsigned char* out, std::index_sequence<I...>) {
+        (Fields::encode(in, out + offset<I>()), ...);
+    }
+};
+
+#endif // ABX_PACKET_SCHEMA_H
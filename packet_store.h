@@ -0,0 +1,178 @@
+#ifndef ABX_PACKET_STORE_H
+#define ABX_PACKET_STORE_H
+
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+#include "packet.h"
+
+// PacketStore keeps packets in a plain array indexed by sequence number, plus a bitmap saying which
+// slots are actually filled.
+//
+// Sequences are dense and start at 1, so this beats a std::map on every front: inserting is just
+// "write slot, set bit" (no tree node allocation), finding the gaps is a scan over 64-bit words where
+// full words are skipped in one compare and holes are found with count-trailing-zeros, and walking
+// the packets in order is a linear pass over memory.
+class PacketStore {
+public:
+    // Hard ceiling on sequence numbers. At 20 bytes a slot that's still 5 GB of store, so on its own it
+    // doesn't protect much; MAX_SEQUENCE_JUMP below is what stops one corrupt sequence from blowing up.
+    static const int32_t MAX_SEQUENCE = 1 << 28;
+    // A packet may land at most this far past twice the current max_sequence(). A real stream grows
+    // one sequence at a time (holes and reordering included), so a jump further than that is garbage,
+    // and the store, missing_sequences() and the resends it drives can at most double per packet.
+    static const int32_t MAX_SEQUENCE_JUMP = 1 << 20;
+
+    PacketStore() : count_(0), max_sequence_(0), contiguous_prefix_(0) {}
+
+    // Adds (or replaces) the packet at its sequence number. Returns false if the sequence is
+    // outside 1..MAX_SEQUENCE or more than MAX_SEQUENCE_JUMP past 2 x max_sequence(), in which case
+    // nothing gets stored.
+    bool insert(const Packet& packet) {
+        int32_t sequence = packet.sequence;
+        if (sequence < 1 || sequence > MAX_SEQUENCE ||
+            sequence > int64_t(max_sequence_) * 2 + MAX_SEQUENCE_JUMP) {
+            return false;
+        }
+        size_t index = static_cast<size_t>(sequence - 1);
+        if (index >= slots_.size()) {
+            grow(index + 1);
+        }
+        uint64_t bit = uint64_t(1) << (index & 63);
+        uint64_t& word = present_[index >> 6];
+        if (!(word & bit)) {
+            word |= bit;
+            ++count_;
+        }
+        slots_[index] = packet;
+        if (sequence > max_sequence_) {
+            max_sequence_ = sequence;
+        }
+        // Filling the first hole can glue a whole run of later packets onto the prefix.
+        while (contiguous_prefix_ < max_sequence_ && contains(contiguous_prefix_ + 1)) {
+            ++contiguous_prefix_;
+        }
+        return true;
+    }
+
+    bool contains(int32_t sequence) const {
+        if (sequence < 1 || sequence > max_sequence_) {
+            return false;
+        }
+        size_t index = static_cast<size_t>(sequence - 1);
+        return (present_[index >> 6] >> (index & 63)) & 1;
+    }
+
+    // Only valid when contains(sequence) is true.
+    const Packet& get(int32_t sequence) const { return slots_[static_cast<size_t>(sequence - 1)]; }
+
+    size_t size() const { return count_; }
+    bool empty() const { return count_ == 0; }
+    int32_t max_sequence() const { return max_sequence_; }
+
+    // Highest N such that every sequence 1..N is present (0 until sequence 1 shows up).
+    // Anything up to here is final and can be handed to output straight away.
+    int32_t contiguous_prefix() const { return contiguous_prefix_; }
+
+    // Every sequence in 1..max_sequence() that we don't have, in increasing order.
+    std::vector<int32_t> missing_sequences() const {
+        std::vector<int32_t> missing;
+        missing.reserve(static_cast<size_t>(max_sequence_) - count_);
+        size_t words = (static_cast<size_t>(max_sequence_) + 63) / 64;
+        for (size_t w = 0; w < words; ++w) {
+            uint64_t holes = ~present_[w] & valid_mask(w);
+            while (holes) {
+                missing.push_back(static_cast<int32_t>(w * 64 + __builtin_ctzll(holes) + 1));
+                holes &= holes - 1; // Clear the lowest set bit
+            }
+        }
+        return missing;
+    }
+
+    // Calls fn(packet) for every stored packet in increasing sequence order.
+    template <typename Fn>
+    void for_each(Fn fn) const { for_each_from(1, fn); }
+
+    // Same, but only for sequences >= first.
+    template <typename Fn>
+    void for_each_from(int32_t first, Fn fn) const {
+        if (first < 1) {
+            first = 1;
+        }
+        if (first > max_sequence_) {
+            return;
+        }
+        size_t first_index = static_cast<size_t>(first - 1);
+        size_t words = (static_cast<size_t>(max_sequence_) + 63) / 64;
+        for (size_t w = first_index / 64; w < words; ++w) {
+            uint64_t bits = present_[w];
+            if (w == first_index / 64) {
+                bits &= ~uint64_t(0) << (first_index & 63); // Skip the ones before `first`
+            }
+            while (bits) {
+                fn(slots_[w * 64 + __builtin_ctzll(bits)]);
+                bits &= bits - 1;
+            }
+        }
+    }
+
+private:
+    // Bits of word `w` that correspond to sequences <= max_sequence_.
+    uint64_t valid_mask(size_t w) const {
+        size_t last_index = static_cast<size_t>(max_sequence_) - 1;
+        if (w < last_index / 64) {
+            return ~uint64_t(0);
+        }
+        return ~uint64_t(0) >> (63 - (last_index & 63));
+    }
+
+    // Doubles the capacity (at least to `needed` slots), so appending in order is amortised O(1).
+    void grow(size_t needed) {
+        size_t capacity = slots_.empty() ? 1024 : slots_.size() * 2;
+        while (capacity < needed) {
+            capacity *= 2;
+        }
+        slots_.resize(capacity);
+        present_.resize((capacity + 63) / 64, 0);
+    }
+
+    std::vector<Packet> slots_;      // slots_[seq - 1]
+    std::vector<uint64_t> present_;  // Bit (seq - 1) set when that slot holds a real packet
+    size_t count_;
+    int32_t max_sequence_;
+    int32_t contiguous_prefix_;
+};
+
+// PrefixCursor remembers how far one consumer (the JSON writer, say) has gotten through a store's
+// contiguous prefix, so each packet is handed over exactly once, in order, as soon as it's final.
+class PrefixCursor {
+public:
+    PrefixCursor() : next_(1) {}
+
+    // Hands over every packet that joined the prefix since last time. Returns how many that was.
+    template <typename Fn>
+    size_t advance(const PacketStore& store, Fn fn) {
+        size_t handed_over = 0;
+        while (next_ <= store.contiguous_prefix()) {
+            fn(store.get(next_++));
+            ++handed_over;
+        }
+        return handed_over;
+    }
+
+    // End of the run: hands over whatever is left past the prefix, skipping the holes that never got filled.
+    template <typename Fn>
+    void finish(const PacketStore& store, Fn fn) {
+        store.for_each_from(next_, fn);
+        next_ = store.max_sequence() + 1;
+    }
+
+    // Next sequence this consumer is waiting for.
+    int32_t next() const { return next_; }
+
+private:
+    int32_t next_;
+};
+
+#endif // ABX_PACKET_STORE_H
@@ -0,0 +1,450 @@
+#ifndef ABX_RESEND_ENGINE_H
+#define ABX_RESEND_ENGINE_H
+
+#include <vector>
+#include <deque>
+#include <functional>
+#include <string>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>  // strerror
+#include <cerrno>
+
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <netinet/in.h>
+#include <unistd.h>
+
+#include "packet.h"
+#include "event_loop.h"
+#include "metrics.h"
+#include "logger.h"
+#include "completion_policy.h"
+#include "resend_protocol.h"
+
+// ResendEngine fetches missing sequences with up to `max_in_flight` resend connections open at the
+// same time.
+//
+// The protocol still wants one TCP connection per resend request (and the client closes it), but
+// nothing says they have to happen one after another. Every connection goes through the same
+// little state machine - non-blocking connect, send the request, read back 17 bytes per packet asked
+// for - driven by the shared EventLoop, each with its own deadline on the loop's timer wheel. As
+// soon as one finishes, the next queued request takes its slot, so total recovery time scales with
+// requests / max_in_flight instead of gaps.
+//
+// Which request format gets used is up to set_protocol() (see resend_protocol.h). On Auto it sticks
+// with Call Type 2 until that can't do the job - a sequence above 127, or more holes than there are
+// slots - and then asks the server what it supports before sending anything else. With Range, nearby
+// holes are fetched together in one round trip.
+//
+// Deadlines come from the CompletionPolicy (derived from measured round trips), and a resend that
+// times out or fails goes back to the front of the queue with a longer deadline until the policy
+// says to stop retrying. A range that broke off halfway only asks again for the part it didn't get.
+class ResendEngine {
+public:
+    struct Report {
+        size_t recovered = 0;              // Packets that came back (ranges may include some we had)
+        std::vector<int32_t> failed;       // Sequences we couldn't get (timeout, refused, short read...)
+        size_t requests = 0;               // Resend connections made (a whole range counts once)
+        size_t retries = 0;                // Extra attempts made after a timeout or failure
+        double wall_seconds = 0.0;         // Time spent with at least one resend queued or in flight
+        size_t peak_in_flight = 0;
+    };
+
+    // Called for every packet that comes back.
+    typedef std::function<void(const Packet&)> PacketHandler;
+
+    ResendEngine(EventLoop& loop, const sockaddr_in& server_addr, size_t max_in_flight, CompletionPolicy& policy,
+                 PacketHandler on_packet)
+        : loop_(loop),
+          server_addr_(server_addr),
+          slots_(max_in_flight == 0 ? 1 : max_in_flight),
+          policy_(policy),
+          on_packet_(std::move(on_packet)),
+          metrics_(nullptr),
+          protocol_(ResendProtocol::Auto),
+          probe_queued_(false),
+          probe_attempt_(0),
+          probing_(false),
+          in_flight_(0) {
+        for (size_t i = slots_.size(); i > 0; --i) {
+            slots_[i - 1].slot = static_cast<uint32_t>(i - 1);
+            free_slots_.push_back(i - 1);
+        }
+    }
+
+    ~ResendEngine() {
+        for (Connection& connection : slots_) {
+            if (connection.fd != -1) {
+                finish(connection);
+            }
+        }
+    }
+
+    ResendEngine(const ResendEngine&) = delete;
+    ResendEngine& operator=(const ResendEngine&) = delete;
+
+    // Queues sequences for resending and starts as many as there are free slots. Can be called again
+    // while earlier ones are still in flight.
+    void submit(const std::vector<int32_t>& sequences) {
+        if (sequences.empty()) {
+            return;
+        }
+        if (idle()) {
+            busy_since_ = Clock::now();
+        }
+        if (protocol_ == ResendProtocol::Auto && (probing_ || probe_queued_ || needs_probe(sequences))) {
+            // Hold on to them until we know how to ask.
+            held_.insert(held_.end(), sequences.begin(), sequences.end());
+            probe_queued_ = !probing_;
+        } else {
+            plan_resend_requests(protocol(), sequences, queue_);
+        }
+        fill_slots();
+    }
+
+    // Legacy, Wide or Range to use that one from the start; Auto (the default) to find out.
+    void set_protocol(ResendProtocol protocol) { protocol_ = protocol; }
+
+    // What's in use now. Auto means we haven't needed to ask yet, which amounts to Legacy.
+    ResendProtocol protocol() const { return protocol_ == ResendProtocol::Auto ? ResendProtocol::Legacy : protocol_; }
+    bool negotiated() const { return protocol_ != ResendProtocol::Auto; }
+
+    // Whether Auto would ask the server before sending these.
+    bool needs_probe(const std::vector<int32_t>& sequences) const {
+        if (protocol_ != ResendProtocol::Auto) {
+            return false;
+        }
+        if (sequences.size() > slots_.size()) {
+            return true; // Enough of them that fewer round trips would pay off
+        }
+        return !fits_legacy(sequences);
+    }
+
+    // Asks the server what it supports without resending anything. Run the loop until idle().
+    void probe() {
+        if (protocol_ != ResendProtocol::Auto || probing_ || probe_queued_) {
+            return;
+        }
+        if (idle()) {
+            busy_since_ = Clock::now();
+        }
+        probe_queued_ = true;
+        fill_slots();
+    }
+
+    // Optional: where to record connect times and resend round trips.
+    void set_metrics(RunMetrics* metrics) { metrics_ = metrics; }
+
+    // Nothing queued and nothing in flight.
+    bool idle() const { return queue_.empty() && held_.empty() && !probe_queued_ && in_flight_ == 0; }
+
+    const Report& report() const { return report_; }
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    enum State { Connecting, Sending, Receiving };
+
+    struct Connection {
+        int fd = -1;
+        uint32_t slot = 0;
+        bool probe = false;        // Capabilities question rather than a resend
+        ResendRequest request = {0, 0, 0};
+        int32_t delivered = 0;     // Packets of the request handed over so far
+        uint64_t timeout_ms = 0;
+        State state = Connecting;
+        unsigned char wire[MAX_RESEND_REQUEST_SIZE];
+        size_t wire_size = 0;
+        size_t bytes_sent = 0;
+        unsigned char response[PACKET_SIZE];
+        size_t bytes_received = 0;
+        TimerWheel::TimerId deadline = TimerWheel::INVALID_TIMER;
+        uint64_t started_ns = 0;
+    };
+
+    void fill_slots() {
+        while ((probe_queued_ || !queue_.empty()) && !free_slots_.empty()) {
+            bool probe = probe_queued_;
+            ResendRequest next = {0, 0, 0};
+            if (probe) {
+                probe_queued_ = false;
+                probing_ = true;
+                next.attempt = probe_attempt_;
+            } else {
+                next = queue_.front();
+                queue_.pop_front();
+            }
+            size_t slot = free_slots_.back();
+            if (start(slots_[slot], next, probe)) {
+                free_slots_.pop_back();
+                ++in_flight_;
+            } else if (probe) {
+                probe_answered(ResendProtocol::Legacy);
+            } else {
+                give_up(next);
+            }
+        }
+        if (in_flight_ > report_.peak_in_flight) {
+            report_.peak_in_flight = in_flight_;
+        }
+        if (idle()) {
+            report_.wall_seconds += std::chrono::duration<double>(Clock::now() - busy_since_).count();
+        }
+    }
+
+    // For log messages.
+    static std::string describe(const Connection& connection) {
+        if (connection.probe) {
+            return "capabilities probe";
+        }
+        return describe_request(connection.request);
+    }
+
+    // Opens a non-blocking socket and kicks off the connect. False means we couldn't even get that far.
+    bool start(Connection& connection, const ResendRequest& request, bool probe) {
+        connection.probe = probe;
+        connection.request = request;
+        connection.fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (connection.fd == -1) {
+            log_error("  Error creating resend socket for ", describe(connection), "! ", strerror(errno));
+            return false;
+        }
+        connection.delivered = 0;
+        connection.timeout_ms = policy_.resend_timeout_ms(request.attempt);
+        connection.state = Connecting;
+        if (probe) {
+            connection.wire[0] = CALL_TYPE_CAPABILITIES;
+            connection.wire[1] = 0;
+            connection.wire_size = CAPABILITIES_REQUEST_SIZE;
+        } else {
+            connection.wire_size = encode_resend_request(protocol(), request, connection.wire);
+            ++report_.requests;
+        }
+        connection.bytes_sent = 0;
+        connection.bytes_received = 0;
+        connection.started_ns = monotonic_ns();
+
+        if (connect(connection.fd, reinterpret_cast<const sockaddr*>(&server_addr_), sizeof(server_addr_)) < 0 &&
+            errno != EINPROGRESS) {
+            log_error("  Resend connection failed for ", describe(connection), "! ", strerror(errno));
+            close(connection.fd);
+            connection.fd = -1;
+            return false;
+        }
+
+        uint32_t slot = connection.slot;
+        if (!loop_.add(connection.fd, EPOLLIN | EPOLLOUT | EPOLLRDHUP, [this, slot](uint32_t) { on_io(slot); })) {
+            close(connection.fd);
+            connection.fd = -1;
+            return false;
+        }
+        connection.deadline = loop_.run_after(connection.timeout_ms, [this, slot]() {
+            Connection& timed_out = slots_[slot];
+            timed_out.deadline = TimerWheel::INVALID_TIMER;
+            // The loop may have been too busy (with the stream, say) to get to an answer that's
+            // already waiting on the socket.
+            if (timed_out.state != Connecting && advance(timed_out)) {
+                release(timed_out);
+                return;
+            }
+            if (timed_out.probe && timed_out.state != Receiving) {
+                log_info("  Capabilities probe didn't get through within ", timed_out.timeout_ms, " ms, trying again.");
+            } else if (timed_out.probe) {
+                log_info("  No answer to the capabilities probe within ", timed_out.timeout_ms, " ms.");
+            } else if (policy_.should_retry(timed_out.request.attempt)) {
+                log_warn("  Resend for ", describe(timed_out), " timed out after ", timed_out.timeout_ms,
+                         " ms, retrying.");
+            } else {
+                log_error("  Resend for ", describe(timed_out), " timed out after ", timed_out.timeout_ms, " ms.");
+            }
+            failed(timed_out);
+            release(timed_out);
+        });
+        return true;
+    }
+
+    void on_io(uint32_t slot) {
+        Connection& connection = slots_[slot];
+        if (advance(connection)) {
+            release(connection);
+        }
+    }
+
+    // Pushes a connection as far as it can go right now. Returns true once it's done (either way).
+    bool advance(Connection& connection) {
+        if (connection.state == Connecting) {
+            int error = 0;
+            socklen_t length = sizeof(error);
+            if (getsockopt(connection.fd, SOL_SOCKET, SO_ERROR, &error, &length) < 0 || error != 0) {
+                log_error("  Resend connection failed for ", describe(connection), "! ",
+                          strerror(error != 0 ? error : errno));
+                failed(connection);
+                return true;
+            }
+            if (metrics_ != nullptr) {
+                metrics_->connect.record(monotonic_ns() - connection.started_ns);
+            }
+            connection.state = Sending;
+        }
+
+        if (connection.state == Sending) {
+            while (connection.bytes_sent < connection.wire_size) {
+                ssize_t sent = send(connection.fd, connection.wire + connection.bytes_sent,
+                                    connection.wire_size - connection.bytes_sent, MSG_NOSIGNAL);
+                if (sent < 0) {
+                    if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                        return false; // Socket buffer full (for a few bytes?!) - wait for the next edge
+                    }
+                    log_error("  Error sending resend request for ", describe(connection), "! ", strerror(errno));
+                    failed(connection);
+                    return true;
+                }
+                connection.bytes_sent += static_cast<size_t>(sent);
+            }
+            connection.state = Receiving;
+        }
+
+        // Receiving: one packet (17 bytes) per sequence asked for, possibly in pieces - or the single
+        // capabilities byte.
+        size_t unit = connection.probe ? 1 : PACKET_SIZE;
+        while (true) {
+            ssize_t got = recv(connection.fd, connection.response + connection.bytes_received,
+                               unit - connection.bytes_received, 0);
+            if (got > 0) {
+                connection.bytes_received += static_cast<size_t>(got);
+                if (connection.bytes_received < unit) {
+                    continue;
+                }
+                connection.bytes_received = 0;
+                if (connection.probe) {
+                    policy_.on_resend_rtt(monotonic_ns() - connection.started_ns);
+                    probe_answered(protocol_from_capabilities(connection.response[0]));
+                    return true;
+                }
+                deliver(connection);
+                if (connection.delivered == connection.request.count()) {
+                    return true;
+                }
+            } else if (got == 0) {
+                if (connection.probe) {
+                    log_info("  Server hung up on the capabilities probe.");
+                } else {
+                    log_error("  Server closed connection prematurely while getting resent packet for ",
+                              describe(connection), ". Got ", connection.delivered, " of ",
+                              connection.request.count(), " packets and ", connection.bytes_received,
+                              " bytes of the next one.");
+                }
+                failed(connection);
+                return true;
+            } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                return false; // Rest of the packet hasn't shown up yet
+            } else if (errno != EINTR) {
+                log_error("  Error receiving resent packet for ", describe(connection), "! ", strerror(errno));
+                failed(connection);
+                return true;
+            }
+        }
+    }
+
+    // A whole packet of the request is in `response`.
+    void deliver(Connection& connection) {
+        Packet packet = parse_packet(connection.response);
+        int32_t expected = connection.request.first + connection.delivered;
+        // Quick check: Is this the packet we actually asked for?
+        if (packet.sequence != expected) {
+            log_warn("  Warning: Requested seq ", expected, " but received packet has seq ",
+                     packet.sequence, ". Data might be mixed up or corrupted.");
+            // We'll still hand it back under its *reported* sequence, but this is suspicious.
+        }
+        ++connection.delivered;
+        ++report_.recovered;
+        if (connection.delivered == 1) {
+            // First packet back is one round trip, however long the range is.
+            uint64_t round_trip_ns = monotonic_ns() - connection.started_ns;
+            policy_.on_resend_rtt(round_trip_ns);
+            if (metrics_ != nullptr) {
+                metrics_->resend_rtt.record(round_trip_ns);
+            }
+        }
+        on_packet_(packet);
+    }
+
+    // This attempt didn't work out: either what's left of it goes to the front of the queue for
+    // another try, or those sequences are written off.
+    void failed(Connection& connection) {
+        if (connection.probe) {
+            // Only silence after the question went out says the server doesn't know it. A probe that
+            // never got that far is asked again.
+            if (connection.state == Receiving || !policy_.should_retry(connection.request.attempt)) {
+                probe_answered(ResendProtocol::Legacy);
+            } else {
+                probing_ = false;
+                probe_queued_ = true;
+                probe_attempt_ = connection.request.attempt + 1;
+            }
+            return;
+        }
+        ResendRequest rest = connection.request;
+        rest.first += connection.delivered;
+        if (policy_.should_retry(rest.attempt)) {
+            ++rest.attempt;
+            queue_.push_front(rest);
+            ++report_.retries;
+        } else {
+            give_up(rest);
+        }
+    }
+
+    void give_up(const ResendRequest& request) {
+        for (int32_t sequence = request.first; sequence <= request.last; ++sequence) {
+            report_.failed.push_back(sequence);
+        }
+    }
+
+    // The probe is over, one way or the other: settle the protocol and release what was held back.
+    void probe_answered(ResendProtocol protocol) {
+        probing_ = false;
+        protocol_ = protocol;
+        log_info("  Resending with the ", resend_protocol_name(protocol_), " request format.");
+        plan_resend_requests(protocol_, held_, queue_);
+        held_.clear();
+    }
+
+    // Closes the connection, frees its slot and lets the next queued request have it.
+    void release(Connection& connection) {
+        finish(connection);
+        free_slots_.push_back(connection.slot);
+        --in_flight_;
+        fill_slots();
+    }
+
+    // IMPORTANT: The spec says closing the resend connection is the client's job for Call Type 2.
+    void finish(Connection& connection) {
+        loop_.cancel(connection.deadline);
+        connection.deadline = TimerWheel::INVALID_TIMER;
+        loop_.remove(connection.fd);
+        close(connection.fd);
+        connection.fd = -1;
+    }
+
+    EventLoop& loop_;
+    sockaddr_in server_addr_;
+    std::vector<Connection> slots_;
+    std::vector<size_t> free_slots_;
+    std::deque<ResendRequest> queue_;
+    std::vector<int32_t> held_;    // Waiting on the capabilities probe
+    CompletionPolicy& policy_;
+    PacketHandler on_packet_;
+    RunMetrics* metrics_;
+    ResendProtocol protocol_;
+    bool probe_queued_;
+    int probe_attempt_;            // Tries so far at getting the probe to the server
+    bool probing_;
+    size_t in_flight_;
+    Clock::time_point busy_since_;
+    Report report_;
+};
+
+#endif // ABX_RESEND_ENGINE_H
@@ -0,0 +1,436 @@
+#ifndef ABX_RESEND_PIPELINE_H
+#define ABX_RESEND_PIPELINE_H
+
+#include <vector>
+#include <deque>
+#include <unordered_map>
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>  // strerror, memmove
+#include <cerrno>
+
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <netinet/in.h>
+#include <unistd.h>
+
+#include "packet.h"
+#include "event_loop.h"
+#include "metrics.h"
+#include "logger.h"
+#include "completion_policy.h"
+#include "resend_protocol.h"
+#include "resend_engine.h"  // Report and PacketHandler, so callers can use either one
+
+// ResendPipeline fetches missing sequences over ONE connection that stays open, with up to `depth`
+// requests written back-to-back before their answers come in.
+//
+// ResendEngine pays a TCP handshake and teardown for every request, because the protocol says the
+// client closes the connection after a Call Type 2 resend. Both main.js and the mock server will,
+// however, happily keep reading 2-byte requests off the same socket and answer each in turn. So
+// here requests are just appended to an output buffer and flushed whenever the socket takes them;
+// whatever comes back is cut into packets and matched to what we asked for by sequence number, so
+// the order answers arrive in doesn't matter.
+//
+// The request format works like ResendEngine's (see resend_protocol.h), except that on Auto we only
+// ask about capabilities when a sequence doesn't fit Call Type 2 - with no handshake per request,
+// fewer requests buy little. The question goes out first on a fresh connection, and if there's no
+// answer in time we reconnect and stick with Call Type 2, so a late answer can't get mixed up with
+// packets.
+//
+// If nothing comes back for a resend deadline (CompletionPolicy), or the connection drops, everything
+// still outstanding is asked for again on a new connection. After the policy's retries run out with
+// no progress in between, whatever is left is written off.
+class ResendPipeline {
+public:
+    static const size_t DEFAULT_DEPTH = 256;
+
+    ResendPipeline(EventLoop& loop, const sockaddr_in& server_addr, size_t depth, CompletionPolicy& policy,
+                   ResendEngine::PacketHandler on_packet)
+        : loop_(loop),
+          server_addr_(server_addr),
+          depth_(depth == 0 ? 1 : depth),
+          policy_(policy),
+          on_packet_(std::move(on_packet)),
+          metrics_(nullptr),
+          protocol_(ResendProtocol::Auto),
+          probe_wanted_(false),
+          state_(Closed),
+          fd_(-1),
+          deadline_(TimerWheel::INVALID_TIMER),
+          out_sent_(0),
+          in_(IN_BUFFER_SIZE),
+          in_used_(0),
+          failures_(0),
+          connect_started_ns_(0),
+          last_progress_ns_(0),
+          busy_(false) {}
+
+    ~ResendPipeline() { close_connection(); }
+
+    ResendPipeline(const ResendPipeline&) = delete;
+    ResendPipeline& operator=(const ResendPipeline&) = delete;
+
+    // Queues sequences for resending. Can be called again while earlier ones are still outstanding.
+    void submit(const std::vector<int32_t>& sequences) {
+        if (sequences.empty()) {
+            return;
+        }
+        mark_busy();
+        if (protocol_ == ResendProtocol::Auto && (probe_wanted_ || !fits_legacy(sequences))) {
+            held_.insert(held_.end(), sequences.begin(), sequences.end());
+            probe_wanted_ = true;
+        } else {
+            plan_resend_requests(protocol(), sequences, queue_);
+        }
+        pump();
+        check_idle();
+    }
+
+    void set_protocol(ResendProtocol protocol) { protocol_ = protocol; }
+    ResendProtocol protocol() const { return protocol_ == ResendProtocol::Auto ? ResendProtocol::Legacy : protocol_; }
+
+    // Optional: where to record connect times and resend round trips.
+    void set_metrics(RunMetrics* metrics) { metrics_ = metrics; }
+
+    // Nothing queued and nothing outstanding.
+    bool idle() const { return queue_.empty() && held_.empty() && awaiting_.empty(); }
+
+    const ResendEngine::Report& report() const { return report_; }
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    enum State { Closed, Connecting, Probing, Open };
+
+    static const size_t IN_BUFFER_SIZE = 64 * 1024;
+
+    bool has_work() const { return !queue_.empty() || !held_.empty() || !awaiting_.empty(); }
+
+    // Gets a connection going if there's work and none is open, and writes out whatever fits.
+    void pump() {
+        if (state_ == Closed && has_work()) {
+            open_connection();
+            return; // Writing starts once the connect finishes
+        }
+        if (state_ == Open) {
+            write_requests();
+            flush();
+        }
+    }
+
+    void open_connection() {
+        fd_ = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (fd_ == -1) {
+            log_error("  Error creating persistent resend socket! ", strerror(errno));
+            connection_failed();
+            return;
+        }
+        connect_started_ns_ = monotonic_ns();
+        last_progress_ns_ = connect_started_ns_;
+        state_ = Connecting;
+        if (connect(fd_, reinterpret_cast<const sockaddr*>(&server_addr_), sizeof(server_addr_)) < 0 &&
+            errno != EINPROGRESS) {
+            log_error("  Persistent resend connection failed! ", strerror(errno));
+            connection_failed();
+            return;
+        }
+        if (!loop_.add(fd_, EPOLLIN | EPOLLOUT | EPOLLRDHUP, [this](uint32_t) { on_io(); })) {
+            connection_failed();
+            return;
+        }
+        arm_deadline(policy_.resend_timeout_ms(failures_));
+    }
+
+    void on_io() {
+        if (state_ == Connecting) {
+            int error = 0;
+            socklen_t length = sizeof(error);
+            if (getsockopt(fd_, SOL_SOCKET, SO_ERROR, &error, &length) < 0 || error != 0) {
+                log_error("  Persistent resend connection failed! ", strerror(error != 0 ? error : errno));
+                connection_failed();
+                check_idle();
+                return;
+            }
+            if (metrics_ != nullptr) {
+                metrics_->connect.record(monotonic_ns() - connect_started_ns_);
+            }
+            last_progress_ns_ = monotonic_ns();
+            if (probe_wanted_ && protocol_ == ResendProtocol::Auto) {
+                state_ = Probing;
+                out_.push_back(CALL_TYPE_CAPABILITIES);
+                out_.push_back(0);
+            } else {
+                state_ = Open;
+                write_requests();
+            }
+        }
+        if (flush() && receive()) {
+            pump();
+        }
+        check_idle();
+    }
+
+    // Turns queued requests into bytes, as long as that keeps at most `depth` sequences outstanding
+    // (a range bigger than that still goes out on its own).
+    void write_requests() {
+        uint64_t now_ns = monotonic_ns();
+        while (!queue_.empty() &&
+               (awaiting_.empty() || awaiting_.size() + static_cast<size_t>(queue_.front().count()) <= depth_)) {
+            ResendRequest request = queue_.front();
+            queue_.pop_front();
+            unsigned char wire[MAX_RESEND_REQUEST_SIZE];
+            size_t size = encode_resend_request(protocol(), request, wire);
+            out_.insert(out_.end(), wire, wire + size);
+            for (int32_t sequence = request.first; sequence <= request.last; ++sequence) {
+                awaiting_[sequence] = now_ns;
+            }
+            ++report_.requests;
+        }
+        if (awaiting_.size() > report_.peak_in_flight) {
+            report_.peak_in_flight = awaiting_.size();
+        }
+    }
+
+    // Sends as much of the output buffer as the socket takes. False if the connection broke.
+    bool flush() {
+        while (out_sent_ < out_.size()) {
+            ssize_t sent = send(fd_, out_.data() + out_sent_, out_.size() - out_sent_, MSG_NOSIGNAL);
+            if (sent < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                    return true; // Rest goes out on the next EPOLLOUT edge
+                }
+                log_error("  Error sending pipelined resend requests! ", strerror(errno));
+                connection_failed();
+                return false;
+            }
+            out_sent_ += static_cast<size_t>(sent);
+        }
+        out_.clear();
+        out_sent_ = 0;
+        return true;
+    }
+
+    // Reads until EAGAIN and hands over every whole packet. False if the connection is gone.
+    bool receive() {
+        while (true) {
+            ssize_t got = recv(fd_, in_.data() + in_used_, in_.size() - in_used_, 0);
+            if (got > 0) {
+                in_used_ += static_cast<size_t>(got);
+                if (!consume()) {
+                    return false;
+                }
+            } else if (got == 0) {
+                if (state_ == Probing) {
+                    log_info("  Server hung up on the capabilities probe.");
+                    settle_protocol(ResendProtocol::Legacy);
+                    close_connection();
+                    pump();
+                    return false;
+                }
+                if (has_work()) {
+                    log_error("  Server closed the persistent resend connection with ", awaiting_.size(),
+                              " packets still outstanding.");
+                    connection_failed();
+                } else {
+                    close_connection();
+                }
+                return false;
+            } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                return true;
+            } else if (errno != EINTR) {
+                log_error("  Error receiving on the persistent resend connection! ", strerror(errno));
+                connection_failed();
+                return false;
+            }
+        }
+    }
+
+    // Works through what's in the input buffer. False if it closed the connection.
+    bool consume() {
+        size_t offset = 0;
+        if (state_ == Probing) {
+            last_progress_ns_ = monotonic_ns();
+            policy_.on_resend_rtt(last_progress_ns_ - connect_started_ns_);
+            settle_protocol(protocol_from_capabilities(in_[0]));
+            state_ = Open;
+            offset = 1;
+            write_requests();
+            if (!flush()) {
+                return false;
+            }
+        }
+        while (in_used_ - offset >= PACKET_SIZE) {
+            deliver(parse_packet(in_.data() + offset));
+            offset += PACKET_SIZE;
+        }
+        std::memmove(in_.data(), in_.data() + offset, in_used_ - offset);
+        in_used_ -= offset;
+        if (idle()) {
+            close_connection(); // All done - the client closes resend connections
+            return false;
+        }
+        return true;
+    }
+
+    void deliver(const Packet& packet) {
+        uint64_t now_ns = monotonic_ns();
+        std::unordered_map<int32_t, uint64_t>::iterator it = awaiting_.find(packet.sequence);
+        if (it == awaiting_.end()) {
+            log_warn("  Warning: Received resent packet with seq ", packet.sequence,
+                     " that we weren't waiting for. Data might be mixed up or corrupted.");
+            // We'll still hand it back under its *reported* sequence, but this is suspicious.
+        } else {
+            if (metrics_ != nullptr) {
+                metrics_->resend_rtt.record(now_ns - it->second);
+            }
+            awaiting_.erase(it);
+        }
+        ++report_.recovered;
+        failures_ = 0;
+        last_progress_ns_ = now_ns;
+        on_packet_(packet);
+    }
+
+    // Timer: fires when the connection may have stalled. Only a real stall (no progress for a whole
+    // deadline) counts; otherwise it just re-arms for the rest of the window.
+    void arm_deadline(uint64_t delay_ms) {
+        loop_.cancel(deadline_);
+        deadline_ = loop_.run_after(delay_ms, [this]() {
+            deadline_ = TimerWheel::INVALID_TIMER;
+            // Read whatever has arrived first; a busy loop may not have got to it yet.
+            if ((state_ == Probing || state_ == Open) && !receive()) {
+                pump();
+                check_idle();
+                return;
+            }
+            uint64_t limit_ms = policy_.resend_timeout_ms(state_ == Probing ? 0 : failures_);
+            uint64_t quiet_ms = (monotonic_ns() - last_progress_ns_) / 1000000;
+            if (quiet_ms < limit_ms) {
+                arm_deadline(limit_ms - quiet_ms);
+                return;
+            }
+            if (state_ == Probing) {
+                // Reconnect rather than risk a late answer landing in the middle of the packets.
+                log_info("  No answer to the capabilities probe within ", limit_ms, " ms.");
+                settle_protocol(ResendProtocol::Legacy);
+                close_connection();
+            } else {
+                log_warn("  Persistent resend connection made no progress for ", limit_ms, " ms (",
+                         awaiting_.size(), " packets outstanding).");
+                connection_failed();
+            }
+            pump();
+            check_idle();
+        });
+    }
+
+    void settle_protocol(ResendProtocol protocol) {
+        protocol_ = protocol;
+        probe_wanted_ = false;
+        log_info("  Resending with the ", resend_protocol_name(protocol_), " request format.");
+        plan_resend_requests(protocol_, held_, queue_);
+        held_.clear();
+    }
+
+    // The connection is no good. Everything outstanding goes back to the front of the queue for a new
+    // connection, unless we've failed too often in a row, in which case everything left is given up.
+    void connection_failed() {
+        close_connection();
+        std::vector<int32_t> outstanding;
+        outstanding.reserve(awaiting_.size());
+        for (const std::pair<const int32_t, uint64_t>& entry : awaiting_) {
+            outstanding.push_back(entry.first);
+        }
+        awaiting_.clear();
+        std::sort(outstanding.begin(), outstanding.end());
+
+        if (policy_.should_retry(failures_)) {
+            ++failures_;
+            ++report_.retries;
+            std::deque<ResendRequest> again;
+            plan_resend_requests(protocol(), outstanding, again);
+            for (ResendRequest& request : again) {
+                request.attempt = failures_;
+            }
+            queue_.insert(queue_.begin(), again.begin(), again.end());
+            pump();
+            return;
+        }
+
+        log_error("  Giving up on the persistent resend connection after ", failures_ + 1, " failures in a row.");
+        report_.failed.insert(report_.failed.end(), outstanding.begin(), outstanding.end());
+        for (const ResendRequest& request : queue_) {
+            for (int32_t sequence = request.first; sequence <= request.last; ++sequence) {
+                report_.failed.push_back(sequence);
+            }
+        }
+        queue_.clear();
+        report_.failed.insert(report_.failed.end(), held_.begin(), held_.end());
+        held_.clear();
+        failures_ = 0; // Anything submitted later gets a fresh start
+    }
+
+    void close_connection() {
+        loop_.cancel(deadline_);
+        deadline_ = TimerWheel::INVALID_TIMER;
+        if (fd_ != -1) {
+            loop_.remove(fd_);
+            close(fd_);
+            fd_ = -1;
+        }
+        state_ = Closed;
+        out_.clear();
+        out_sent_ = 0;
+        in_used_ = 0;
+    }
+
+    void mark_busy() {
+        if (!busy_) {
+            busy_ = true;
+            busy_since_ = Clock::now();
+        }
+    }
+
+    void check_idle() {
+        if (busy_ && idle()) {
+            busy_ = false;
+            report_.wall_seconds += std::chrono::duration<double>(Clock::now() - busy_since_).count();
+        }
+    }
+
+    EventLoop& loop_;
+    sockaddr_in server_addr_;
+    size_t depth_;
+    CompletionPolicy& policy_;
+    ResendEngine::PacketHandler on_packet_;
+    RunMetrics* metrics_;
+    ResendProtocol protocol_;
+    bool probe_wanted_;
+
+    State state_;
+    int fd_;
+    TimerWheel::TimerId deadline_;
+    std::vector<unsigned char> out_;
+    size_t out_sent_;
+    std::vector<unsigned char> in_;
+    size_t in_used_;
+
+    std::deque<ResendRequest> queue_;                    // Not written yet
+    std::vector<int32_t> held_;                          // Waiting on the capabilities probe
+    std::unordered_map<int32_t, uint64_t> awaiting_;     // Written, packet not back yet -> when it was written
+    int failures_;                                       // Connection failures since the last packet
+    uint64_t connect_started_ns_;
+    uint64_t last_progress_ns_;
+
+    bool busy_;
+    Clock::time_point busy_since_;
+    ResendEngine::Report report_;
+};
+
+#endif // ABX_RESEND_PIPELINE_H
@@ -0,0 +1,146 @@
+#ifndef ABX_RESEND_PROTOCOL_H
+#define ABX_RESEND_PROTOCOL_H
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <cstddef>
+#include <cstdint>
+
+// Wire formats for asking the server to send packets again.
+//
+// Call Type 2 is all main.js knows: 2 bytes, {2, sequence}, with the sequence read as an Int8. So
+// anything above 127 comes out as garbage, and every sequence costs its own connection. We add three
+// call types on top, which the mock server implements:
+//
+//   * Call Type 3 (Capabilities): {3, 0}. The server answers with one byte of CAP_* flags. main.js
+//     never answers it, so no reply within the resend deadline means "legacy only".
+//   * Call Type 4 (Wide Resend): {4, seq as 4-byte big-endian}. One packet back, same as Call Type 2.
+//   * Call Type 5 (Range Resend): {5, first, last, both 4-byte big-endian}. Every packet first..last
+//     back, in order, none left out.
+//
+// We only use the new ones after the server has said it supports them, since main.js would read our
+// 5- or 9-byte requests as a mess of 2-byte ones.
+
+enum class ResendProtocol { Auto, Legacy, Wide, Range };
+
+const unsigned char CALL_TYPE_RESEND = 2;
+const unsigned char CALL_TYPE_CAPABILITIES = 3;
+const unsigned char CALL_TYPE_WIDE_RESEND = 4;
+const unsigned char CALL_TYPE_RANGE_RESEND = 5;
+
+const uint8_t CAP_WIDE_RESEND = 1 << 0;
+const uint8_t CAP_RANGE_RESEND = 1 << 1;
+
+const size_t MAX_RESEND_REQUEST_SIZE = 9;   // Call Type 5
+const size_t CAPABILITIES_REQUEST_SIZE = 2;
+
+// Highest sequence Call Type 2 can carry through main.js's readInt8.
+const int32_t LEGACY_MAX_SEQUENCE = 127;
+
+// A range never covers more than this many packets, so one slow range can't hold up the rest.
+const int32_t MAX_RANGE_PACKETS = 1024;
+// Holes at most this many sequences apart go into the same range. Re-receiving a few packets we
+// already have (17 bytes each) is much cheaper than another connection.
+const int32_t RANGE_MERGE_GAP = 8;
+
+// One request: a single sequence (first == last) or a range.
+struct ResendRequest {
+    int32_t first;
+    int32_t last;
+    int attempt;   // 0 for the first try
+
+    int32_t count() const { return last - first + 1; }
+};
+
+inline const char* resend_protocol_name(ResendProtocol protocol) {
+    switch (protocol) {
+        case ResendProtocol::Legacy: return "legacy (Call Type 2)";
+        case ResendProtocol::Wide: return "wide (Call Type 4)";
+        case ResendProtocol::Range: return "range (Call Type 5)";
+        default: return "auto";
+    }
+}
+
+// "seq 5" or "seqs 5-20", for log messages.
+inline std::string describe_request(const ResendRequest& request) {
+    if (request.count() == 1) {
+        return "seq " + std::to_string(request.first);
+    }
+    return "seqs " + std::to_string(request.first) + "-" + std::to_string(request.last);
+}
+
+// Whether Call Type 2 can ask for all of these.
+inline bool fits_legacy(const std::vector<int32_t>& sequences) {
+    for (int32_t sequence : sequences) {
+        if (sequence > LEGACY_MAX_SEQUENCE) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Best thing the server says it can do.
+inline ResendProtocol protocol_from_capabilities(uint8_t capabilities) {
+    if (capabilities & CAP_RANGE_RESEND) return ResendProtocol::Range;
+    if (capabilities & CAP_WIDE_RESEND) return ResendProtocol::Wide;
+    return ResendProtocol::Legacy;
+}
+
+inline void put_be32(int32_t value, unsigned char* out) {
+    uint32_t bits = static_cast<uint32_t>(value);
+    out[0] = static_cast<unsigned char>(bits >> 24);
+    out[1] = static_cast<unsigned char>(bits >> 16);
+    out[2] = static_cast<unsigned char>(bits >> 8);
+    out[3] = static_cast<unsigned char>(bits);
+}
+
+inline int32_t get_be32(const unsigned char* in) {
+    return static_cast<int32_t>((uint32_t(in[0]) << 24) | (uint32_t(in[1]) << 16) | (uint32_t(in[2]) << 8) | in[3]);
+}
+
+// Writes the request into `out` (MAX_RESEND_REQUEST_SIZE bytes of room) and returns its size.
+// Legacy and Wide only look at `first`.
+inline size_t encode_resend_request(ResendProtocol protocol, const ResendRequest& request, unsigned char* out) {
+    switch (protocol) {
+        case ResendProtocol::Wide:
+            out[0] = CALL_TYPE_WIDE_RESEND;
+            put_be32(request.first, out + 1);
+            return 5;
+        case ResendProtocol::Range:
+            out[0] = CALL_TYPE_RANGE_RESEND;
+            put_be32(request.first, out + 1);
+            put_be32(request.last, out + 5);
+            return 9;
+        default:
+            // Note: The server reads the sequence number as an Int8 (1 byte), so anything above 127 gets mangled.
+            out[0] = CALL_TYPE_RESEND;
+            out[1] = static_cast<unsigned char>(request.first);
+            return 2;
+    }
+}
+
+// Turns a sorted list of missing sequences into requests: one per sequence, or for Range, runs of
+// nearby holes merged together (up to MAX_RANGE_PACKETS each).
+inline void plan_resend_requests(ResendProtocol protocol, const std::vector<int32_t>& sequences,
+                                 std::deque<ResendRequest>& out) {
+    if (protocol != ResendProtocol::Range) {
+        for (int32_t sequence : sequences) {
+            out.push_back(ResendRequest{sequence, sequence, 0});
+        }
+        return;
+    }
+    size_t i = 0;
+    while (i < sequences.size()) {
+        ResendRequest request = {sequences[i], sequences[i], 0};
+        ++i;
+        while (i < sequences.size() && sequences[i] > request.last &&
+               sequences[i] - request.last <= RANGE_MERGE_GAP && sequences[i] - request.first < MAX_RANGE_PACKETS) {
+            request.last = sequences[i];
+            ++i;
+        }
+        out.push_back(request);
+    }
+}
+
+#endif // ABX_RESEND_PROTOCOL_H
@@ -0,0 +1,322 @@
+#ifndef ABX_SESSION_MANAGER_H
+#define ABX_SESSION_MANAGER_H
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>  // strtol
+#include <cstring>  // memset, strerror
+#include <cerrno>
+
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "packet.h"
+#include "packet_store.h"
+#include "json_writer.h"
+#include "event_loop.h"
+#include "stream_session.h"
+#include "resend_engine.h"
+#include "resend_pipeline.h"
+#include "resend_protocol.h"
+#include "gap_tracker.h"
+#include "completion_policy.h"
+#include "metrics.h"
+#include "logger.h"
+
+// One ABX server to collect from.
+struct Endpoint {
+    std::string host;
+    int port = 0;
+    sockaddr_in addr;
+    std::string output_path;   // output_<host>_<port>.json
+};
+
+// Parses "HOST:PORT" (IPv4 address, port 1-65535). False if it isn't one.
+inline bool parse_endpoint(const std::string& text, Endpoint& endpoint) {
+    size_t colon = text.rfind(':');
+    if (colon == std::string::npos || colon == 0 || colon + 1 == text.size()) {
+        return false;
+    }
+    endpoint.host = text.substr(0, colon);
+    char* end = nullptr;
+    long port = std::strtol(text.c_str() + colon + 1, &end, 10);
+    if (*end != '\0' || port < 1 || port > 65535) {
+        return false;
+    }
+    endpoint.port = static_cast<int>(port);
+    std::memset(&endpoint.addr, 0, sizeof(endpoint.addr));
+    endpoint.addr.sin_family = AF_INET;
+    endpoint.addr.sin_port = htons(static_cast<uint16_t>(port));
+    if (inet_pton(AF_INET, endpoint.host.c_str(), &endpoint.addr.sin_addr) <= 0) {
+        return false;
+    }
+    endpoint.output_path = "output_" + endpoint.host + "_" + std::to_string(endpoint.port) + ".json";
+    return true;
+}
+
+// SessionManager collects from many endpoints at once, all on one EventLoop.
+//
+// Each endpoint gets what main() sets up for the single server: its own store, CompletionPolicy (so
+// one slow feed doesn't skew another's timeouts), StreamSession, gap tracker, resend engine (or
+// persistent pipeline) and JSON writer. They all share the loop, so a hundred mostly idle feeds cost
+// one thread and one epoll_wait. Each session moves through the same phases as a single run:
+//
+//   Streaming  stream running, holes re-requested as they're confirmed
+//   Resending  stream over, waiting on whatever is still missing
+//   Done       output file finished
+//
+// The latency histograms in RunMetrics are shared, so they describe every session together. Per
+// session progress (packets, holes, recovered) is logged every PROGRESS_INTERVAL_MS and summarised
+// at the end along with the aggregate throughput.
+class SessionManager {
+public:
+    static const uint64_t PROGRESS_INTERVAL_MS = 1000;
+
+    struct Settings {
+        int connect_timeout_ms = 5000;
+        CompletionPolicy::Config completion;
+        size_t resend_concurrency = 16;
+        ResendProtocol resend_protocol = ResendProtocol::Auto;
+        bool persistent_resend = false;
+        size_t pipeline_depth = ResendPipeline::DEFAULT_DEPTH;
+        bool early_resend = true;
+        int32_t reorder_window = 16;
+    };
+
+    SessionManager(EventLoop& loop, const Settings& settings, RunMetrics& metrics)
+        : loop_(loop), settings_(settings), metrics_(metrics), progress_timer_(TimerWheel::INVALID_TIMER) {}
+
+    SessionManager(const SessionManager&) = delete;
+    SessionManager& operator=(const SessionManager&) = delete;
+
+    void add(const Endpoint& endpoint) {
+        sessions_.emplace_back(new Session(*this, endpoint));
+    }
+
+    // Runs every session to the end. True if every one of them produced a complete output file.
+    bool run() {
+        uint64_t started_ns = monotonic_ns();
+        for (std::unique_ptr<Session>& session : sessions_) {
+            session->start();
+        }
+        schedule_progress();
+        loop_.run_until([this]() {
+            bool all_done = true;
+            for (std::unique_ptr<Session>& session : sessions_) {
+                session->step();
+                all_done = all_done && session->phase == Done;
+            }
+            if (all_done) {
+                loop_.cancel(progress_timer_);
+            }
+            return all_done;
+        });
+        summarise((monotonic_ns() - started_ns) / 1e9);
+
+        bool ok = true;
+        for (const std::unique_ptr<Session>& session : sessions_) {
+            ok = ok && session->ok;
+        }
+        return ok;
+    }
+
+private:
+    enum Phase { Streaming, Resending, Done };
+
+    struct Session {
+        Session(SessionManager& manager, const Endpoint& endpoint)
+            : manager(manager),
+              endpoint(endpoint),
+              label(endpoint.host + ":" + std::to_string(endpoint.port)),
+              policy(manager.settings_.completion),
+              gaps(manager.settings_.reorder_window),
+              phase(Streaming),
+              ok(false),
+              early_requests(0),
+              asked_for(0) {}
+
+        // Opens the output file and kicks off the stream. A session that can't even do that is Done.
+        void start() {
+            const Settings& settings = manager.settings_;
+            if (!json_writer.open(endpoint.output_path)) {
+                log_error("[", label, "] Couldn't open ", endpoint.output_path, " for writing. ", strerror(errno));
+                phase = Done;
+                return;
+            }
+            ResendEngine::PacketHandler store_packet = [this](const Packet& packet) {
+                if (!store.insert(packet)) {
+                    log_warn("[", label, "] Resent packet has out-of-range sequence ", packet.sequence, ", dropping it.");
+                }
+                emit_json_prefix();
+            };
+            if (settings.persistent_resend) {
+                pipeline.reset(new ResendPipeline(manager.loop_, endpoint.addr, settings.pipeline_depth, policy,
+                                                  store_packet));
+                pipeline->set_protocol(settings.resend_protocol);
+                pipeline->set_metrics(&manager.metrics_);
+            } else {
+                engine.reset(new ResendEngine(manager.loop_, endpoint.addr, settings.resend_concurrency, policy,
+                                              store_packet));
+                engine->set_protocol(settings.resend_protocol);
+                engine->set_metrics(&manager.metrics_);
+            }
+
+            stream.reset(new StreamSession(manager.loop_, endpoint.addr, settings.connect_timeout_ms, policy,
+                                           [this](const DecodedBatch& decoded) { store_batch(decoded); }));
+            stream->set_metrics(&manager.metrics_);
+            log_info("[", label, "] Connecting for the initial stream, writing to ", endpoint.output_path, ".");
+            if (!stream->start()) {
+                finish();
+            }
+        }
+
+        void store_batch(const DecodedBatch& decoded) {
+            for (size_t i = 0; i < decoded.count; ++i) {
+                if (!store.insert(decoded.packet(i))) {
+                    log_warn("[", label, "] Ignoring packet with out-of-range sequence ", decoded.sequence[i], ".");
+                }
+            }
+            emit_json_prefix();
+            if (manager.settings_.early_resend) {
+                due.clear();
+                gaps.observe(store, due);
+                if (!due.empty()) {
+                    submit(due);
+                }
+            }
+        }
+
+        void submit(const std::vector<int32_t>& sequences) {
+            if (pipeline) {
+                pipeline->submit(sequences);
+            } else {
+                engine->submit(sequences);
+            }
+        }
+
+        bool resends_idle() const { return pipeline ? pipeline->idle() : engine->idle(); }
+
+        // Moves on to the next phase once the current one is over. Called after every loop turn.
+        void step() {
+            if (phase == Streaming && stream->finished()) {
+                StreamSession::Status status = stream->status();
+                early_requests = gaps.requested_count();
+                if (status != StreamSession::Completed && stream->bytes_received() == 0) {
+                    // Nothing to fill in, but anything asked for early still has to land or give up
+                    // before the file is closed, so this waits in Resending like any other session.
+                    log_error("[", label, "] Stream ended before any data arrived.");
+                    asked_for = early_requests;
+                } else {
+                    std::vector<int32_t> missing = gaps.remaining(store);
+                    asked_for = missing.size() + early_requests;
+                    log_info("[", label, "] Stream over with ", store.size(), " packets up to seq ",
+                             store.max_sequence(), "; ", missing.size(), " more to request (", early_requests,
+                             " already requested).");
+                    submit(missing);
+                }
+                phase = Resending;
+            }
+            if (phase == Resending && resends_idle()) {
+                finish();
+            }
+        }
+
+        void finish() {
+            size_t written_before = json_writer.packets_written();
+            uint64_t started_ns = monotonic_ns();
+            json_cursor.finish(store, [this](const Packet& packet) { json_writer.write_packet(packet); });
+            bool json_ok = json_writer.finish();
+            size_t written = json_writer.packets_written() - written_before;
+            if (written > 0) {
+                manager.metrics_.json_emit.record((monotonic_ns() - started_ns) / written, written);
+            }
+            if (!json_ok) {
+                log_error("[", label, "] Couldn't write ", endpoint.output_path, ". ", strerror(errno));
+            }
+            // Like a single run: a stream that never delivered anything counts as a failure.
+            ok = json_ok && bytes_received() > 0;
+            log_info("[", label, "] Done: ", json_writer.packets_written(), " packets written to ",
+                     endpoint.output_path, " (", store.missing_sequences().size(), " still missing).");
+            phase = Done;
+        }
+
+        void emit_json_prefix() {
+            uint64_t started_ns = monotonic_ns();
+            size_t written = json_cursor.advance(store, [this](const Packet& packet) { json_writer.write_packet(packet); });
+            if (written > 0) {
+                json_writer.flush();
+                manager.metrics_.json_emit.record((monotonic_ns() - started_ns) / written, written);
+            }
+        }
+
+        size_t bytes_received() const { return stream ? stream->bytes_received() : 0; }
+
+        // Ranges can bring back packets we already had, so count from the store.
+        size_t recovered() const {
+            size_t still_missing = store.missing_sequences().size();
+            return still_missing < asked_for ? asked_for - still_missing : 0;
+        }
+
+        SessionManager& manager;
+        Endpoint endpoint;
+        std::string label;   // "host:port", for log lines
+        PacketStore store;
+        CompletionPolicy policy;
+        GapTracker gaps;
+        std::vector<int32_t> due;
+        std::unique_ptr<StreamSession> stream;
+        std::unique_ptr<ResendEngine> engine;
+        std::unique_ptr<ResendPipeline> pipeline;
+        JsonStreamWriter json_writer;
+        PrefixCursor json_cursor;
+        Phase phase;
+        bool ok;
+        size_t early_requests;
+        size_t asked_for;     // Holes requested, early and after the stream
+    };
+
+    void schedule_progress() {
+        progress_timer_ = loop_.run_after(PROGRESS_INTERVAL_MS, [this]() {
+            size_t packets = 0;
+            size_t done = 0;
+            for (const std::unique_ptr<Session>& session : sessions_) {
+                packets += session->store.size();
+                done += session->phase == Done ? 1 : 0;
+                if (session->phase != Done) {
+                    log_info("  [", session->label, "] ", (session->phase == Streaming ? "streaming" : "resending"),
+                             ": ", session->store.size(), " packets, ", session->bytes_received(), " bytes");
+                }
+            }
+            log_info("Progress: ", done, " of ", sessions_.size(), " sessions done, ", packets, " packets so far.");
+            schedule_progress();
+        });
+    }
+
+    void summarise(double wall_seconds) {
+        size_t packets = 0;
+        size_t bytes = 0;
+        log_info("Session summary:");
+        for (const std::unique_ptr<Session>& session : sessions_) {
+            size_t still_missing = session->store.missing_sequences().size();
+            packets += session->store.size();
+            bytes += session->bytes_received();
+            log_info("  ", session->label, " -> ", session->endpoint.output_path, ": ", session->store.size(),
+                     " packets, ", session->recovered(), " of ", session->asked_for, " holes recovered, ", still_missing, " missing",
+                     (session->ok ? "" : " (FAILED)"));
+        }
+        log_info("Collected ", packets, " packets (", bytes, " stream bytes) from ", sessions_.size(),
+                 " endpoints in ", wall_seconds * 1000.0, " ms: ", (wall_seconds > 0 ? packets / wall_seconds : 0.0),
+                 " packets/s, ", (wall_seconds > 0 ? bytes / wall_seconds / (1024.0 * 1024.0) : 0.0), " MiB/s.");
+    }
+
+    EventLoop& loop_;
+    Settings settings_;
+    RunMetrics& metrics_;
+    std::vector<std::unique_ptr<Session>> sessions_;
+    TimerWheel::TimerId progress_timer_;
+};
+
+#endif // ABX_SESSION_MANAGER_H
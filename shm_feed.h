@@ -0,0 +1,346 @@
+#ifndef ABX_SHM_FEED_H
+#define ABX_SHM_FEED_H
+
+#include <atomic>
+#include <new>      // placement new
+#include <string>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>  // memcpy, memcmp, strncpy
+#include <cerrno>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "packet.h"
+
+// A shared-memory ring that hands decoded packets to other processes on the same host.
+//
+// One publisher (the client, with --shm-publish) writes each packet into the next slot of a ring in
+// a file it mmaps MAP_SHARED; put the file under /dev/shm and it never touches a disk. Any number of
+// subscribers map the same file read-only and follow along. Neither side makes a syscall per packet,
+// and the publisher never waits: a subscriber that falls a whole ring behind skips ahead to what's
+// still there and counts what it lost.
+//
+// Every slot is a little seqlock. While packet n is being written its stamp is 2n+1, and once the
+// packet is in, 2n+2. A subscriber wanting packet n copies the slot only when the stamp says 2n+2,
+// then checks the stamp again; if it moved, the publisher lapped it mid-copy and the copy is thrown
+// away. (Reading the packet bytes while they may be changing is the usual seqlock data race; the
+// stamp check is what makes the result safe to use.)
+//
+// File layout, in the publisher's byte order (`byte_order` lets a reader on the other kind refuse):
+//
+//     offset 0            ShmFeedHeader: capacity, slot size, and the packet schema as a field
+//                         table (name, wire type, wire offset, offset in the slot's Packet), so a
+//                         subscriber built against a different Packet refuses to attach
+//     header_size         ShmFeedSlot[capacity], 32 bytes each: stamp, then the Packet as-is
+
+const uint16_t SHM_FEED_VERSION = 1;
+const uint32_t SHM_FEED_BYTE_ORDER = 0x01020304;
+const size_t SHM_FEED_MAX_FIELDS = 8;
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "The ring's stamps have to be lock-free to be shared");
+static_assert(std::atomic<uint32_t>::is_always_lock_free, "The ring's flags have to be lock-free to be shared");
+
+struct ShmFeedField {
+    char name[24];           // JSON key from PacketWire, NUL padded
+    uint8_t type;            // WireType
+    uint8_t size;            // Bytes on the wire
+    uint16_t wire_offset;
+    uint16_t slot_offset;    // Where the decoded value sits in the slot's Packet
+    uint16_t reserved;
+};
+
+static_assert(sizeof(ShmFeedField) == 32, "ShmFeedField layout changed - bump SHM_FEED_VERSION");
+
+struct ShmFeedHeader {
+    char magic[4];                       // "ABXS", written last so a half-made file doesn't match
+    uint16_t version;                    // SHM_FEED_VERSION
+    uint16_t header_size;                // sizeof(ShmFeedHeader); the slots start here
+    uint32_t byte_order;                 // SHM_FEED_BYTE_ORDER as the publisher saw it
+    uint32_t slot_size;                  // sizeof(ShmFeedSlot)
+    uint64_t capacity;                   // Slots, a power of two
+    uint32_t packet_size;                // sizeof(Packet)
+    uint32_t field_count;
+    ShmFeedField fields[SHM_FEED_MAX_FIELDS];
+    alignas(64) std::atomic<uint64_t> published;  // Packets published so far
+    std::atomic<uint32_t> finished;               // 1 once the publisher won't publish any more
+};
+
+static_assert(sizeof(ShmFeedHeader) == 384, "ShmFeedHeader layout changed - bump SHM_FEED_VERSION");
+
+struct alignas(32) ShmFeedSlot {
+    std::atomic<uint64_t> stamp;   // 2n+1 while packet n is being written, 2n+2 once it's in
+    Packet packet;
+};
+
+static_assert(sizeof(ShmFeedSlot) == 32, "ShmFeedSlot layout changed - bump SHM_FEED_VERSION");
+
+namespace abx_detail {
+
+// The header fields describing PacketWire and the Packet struct - the publisher writes them and a
+// subscriber compares them with its own.
+inline void describe_schema(ShmFeedHeader& header) {
+    static_assert(PacketWire::field_count <= SHM_FEED_MAX_FIELDS, "Too many fields for the feed header");
+    header.packet_size = sizeof(Packet);
+    header.field_count = PacketWire::field_count;
+    std::memset(header.fields, 0, sizeof(header.fields));
+    size_t i = 0;
+    PacketWire::for_each_field_type([&](auto field, size_t wire_offset) {
+        ShmFeedField& out = header.fields[i++];
+        std::strncpy(out.name, decltype(field)::json_name, sizeof(out.name) - 1);
+        out.type = static_cast<uint8_t>(decltype(field)::type);
+        out.size = static_cast<uint8_t>(decltype(field)::size);
+        out.wire_offset = static_cast<uint16_t>(wire_offset);
+        out.slot_offset = static_cast<uint16_t>(decltype(field)::template member_offset<Packet>());
+    });
+}
+
+} // namespace abx_detail
+
+// Writer side. Only one thread may publish at a time.
+class ShmFeedPublisher {
+public:
+    static const size_t DEFAULT_CAPACITY = 65536;
+
+    ShmFeedPublisher() : header_(nullptr), slots_(nullptr), length_(0), mask_(0), next_(0) {}
+    ~ShmFeedPublisher() { close_feed(); }
+
+    ShmFeedPublisher(const ShmFeedPublisher&) = delete;
+    ShmFeedPublisher& operator=(const ShmFeedPublisher&) = delete;
+
+    // Creates the ring at `path` with `capacity` slots (rounded up to a power of two). A file already
+    // there is unlinked first, so subscribers still attached to an old run keep their own copy
+    // instead of watching it get rewritten. False with errno set on failure.
+    bool create(const std::string& path, size_t capacity = DEFAULT_CAPACITY) {
+        close_feed();
+        size_t slots = 2;
+        while (slots < capacity) {
+            slots <<= 1;
+        }
+        if (unlink(path.c_str()) != 0 && errno != ENOENT) {
+            return false;
+        }
+        int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+        if (fd == -1) {
+            return false;
+        }
+        size_t length = sizeof(ShmFeedHeader) + slots * sizeof(ShmFeedSlot);
+        if (ftruncate(fd, static_cast<off_t>(length)) != 0) {
+            int saved = errno;
+            close(fd);
+            errno = saved;
+            return false;
+        }
+        void* mapped = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        int saved = errno;
+        close(fd); // The mapping keeps the file alive
+        if (mapped == MAP_FAILED) {
+            errno = saved;
+            return false;
+        }
+        length_ = length;
+        mask_ = slots - 1;
+        next_ = 0;
+
+        // ftruncate gave us zeroes, which is every stamp at "nothing yet"; the atomics still get
+        // constructed properly before anyone relies on them.
+        header_ = new (mapped) ShmFeedHeader();
+        header_->version = SHM_FEED_VERSION;
+        header_->header_size = sizeof(ShmFeedHeader);
+        header_->byte_order = SHM_FEED_BYTE_ORDER;
+        header_->slot_size = sizeof(ShmFeedSlot);
+        header_->capacity = slots;
+        abx_detail::describe_schema(*header_);
+        header_->published.store(0, std::memory_order_relaxed);
+        header_->finished.store(0, std::memory_order_relaxed);
+        slots_ = reinterpret_cast<ShmFeedSlot*>(static_cast<unsigned char*>(mapped) + sizeof(ShmFeedHeader));
+        for (size_t i = 0; i < slots; ++i) {
+            new (&slots_[i]) ShmFeedSlot();
+            slots_[i].stamp.store(0, std::memory_order_relaxed);
+        }
+        std::atomic_thread_fence(std::memory_order_release);
+        std::memcpy(header_->magic, "ABXS", 4);
+        return true;
+    }
+
+    void publish(const Packet& packet) {
+        uint64_t n = next_;
+        ShmFeedSlot& slot = slots_[n & mask_];
+        slot.stamp.store(2 * n + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release); // The odd stamp lands before the packet does
+        std::memcpy(&slot.packet, &packet, sizeof(Packet));
+        slot.stamp.store(2 * n + 2, std::memory_order_release);
+        header_->published.store(n + 1, std::memory_order_release);
+        next_ = n + 1;
+    }
+
+    // Tells subscribers nothing else is coming; they get Finished once they've read the rest.
+    void finish() {
+        if (header_ != nullptr) {
+            header_->finished.store(1, std::memory_order_release);
+        }
+    }
+
+    // Finishes and unmaps. The file stays, so late subscribers can still read the last ring's worth.
+    void close_feed() {
+        if (header_ != nullptr) {
+            finish();
+            munmap(header_, length_);
+        }
+        header_ = nullptr;
+        slots_ = nullptr;
+        length_ = 0;
+    }
+
+    bool is_open() const { return header_ != nullptr; }
+    uint64_t published() const { return next_; }
+    size_t capacity() const { return mask_ + 1; }
+
+private:
+    ShmFeedHeader* header_;
+    ShmFeedSlot* slots_;
+    size_t length_;
+    uint64_t mask_;
+    uint64_t next_;
+};
+
+// Reader side: one per consuming thread. poll() is a few loads from the shared mapping, no syscalls.
+class ShmFeedSubscriber {
+public:
+    enum Result {
+        Received,   // `out` has the next packet
+        Empty,      // Nothing new yet
+        Finished,   // The publisher is done and everything it published has been read (or lost)
+    };
+
+    ShmFeedSubscriber() : header_(nullptr), slots_(nullptr), length_(0), mask_(0), next_(0), lost_(0) {}
+    ~ShmFeedSubscriber() { close_feed(); }
+
+    ShmFeedSubscriber(const ShmFeedSubscriber&) = delete;
+    ShmFeedSubscriber& operator=(const ShmFeedSubscriber&) = delete;
+
+    // Attaches to the ring at `path`. With `from_start`, reading begins at the oldest packet still in
+    // the ring; otherwise at the next one published. False with errno set on failure - EINVAL if it
+    // isn't a feed this build understands (wrong magic, version, byte order or packet schema).
+    bool open(const std::string& path, bool from_start = true) {
+        close_feed();
+        int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd == -1) {
+            return false;
+        }
+        struct stat info;
+        if (fstat(fd, &info) != 0) {
+            int saved = errno;
+            close(fd);
+            errno = saved;
+            return false;
+        }
+        size_t length = static_cast<size_t>(info.st_size);
+        if (length < sizeof(ShmFeedHeader)) {
+            close(fd);
+            errno = EINVAL;
+            return false;
+        }
+        void* mapped = mmap(nullptr, length, PROT_READ, MAP_SHARED, fd, 0);
+        int saved = errno;
+        close(fd);
+        if (mapped == MAP_FAILED) {
+            errno = saved;
+            return false;
+        }
+        header_ = static_cast<const ShmFeedHeader*>(mapped);
+        length_ = length;
+        if (!valid()) {
+            close_feed();
+            errno = EINVAL;
+            return false;
+        }
+        slots_ = reinterpret_cast<const ShmFeedSlot*>(static_cast<const unsigned char*>(mapped) + header_->header_size);
+        mask_ = header_->capacity - 1;
+        uint64_t published = header_->published.load(std::memory_order_acquire);
+        next_ = from_start ? oldest(published) : published;
+        lost_ = 0;
+        return true;
+    }
+
+    void close_feed() {
+        if (header_ != nullptr) {
+            munmap(const_cast<ShmFeedHeader*>(header_), length_);
+        }
+        header_ = nullptr;
+        slots_ = nullptr;
+        length_ = 0;
+    }
+
+    Result poll(Packet& out) {
+        for (;;) {
+            uint64_t n = next_;
+            const ShmFeedSlot& slot = slots_[n & mask_];
+            uint64_t stamp = slot.stamp.load(std::memory_order_acquire);
+            if (stamp < 2 * n + 2) {
+                // Still an older lap's packet, or packet n half written.
+                if (header_->finished.load(std::memory_order_acquire) != 0 &&
+                    n >= header_->published.load(std::memory_order_acquire)) {
+                    return Finished;
+                }
+                return Empty;
+            }
+            if (stamp == 2 * n + 2) {
+                std::memcpy(&out, &slot.packet, sizeof(Packet));
+                std::atomic_thread_fence(std::memory_order_acquire); // The copy happens before the re-check
+                if (slot.stamp.load(std::memory_order_relaxed) == stamp) {
+                    next_ = n + 1;
+                    return Received;
+                }
+            }
+            // The publisher has lapped us: skip to what's still in the ring.
+            uint64_t resume = oldest(header_->published.load(std::memory_order_acquire));
+            if (resume > n) {
+                lost_ += resume - n;
+                next_ = resume;
+            }
+        }
+    }
+
+    bool is_open() const { return header_ != nullptr; }
+    size_t capacity() const { return header_ ? mask_ + 1 : 0; }
+    uint64_t next_index() const { return next_; }   // Publish index of the next packet poll() returns
+    uint64_t lost() const { return lost_; }         // Packets skipped because the publisher lapped us
+    uint64_t published() const { return header_ ? header_->published.load(std::memory_order_acquire) : 0; }
+
+private:
+    // The oldest packet worth starting from, given how many are published: a ring's worth back, less
+    // an eighth of slack so the publisher doesn't overwrite it again before we get there.
+    uint64_t oldest(uint64_t published) const {
+        uint64_t keep = header_->capacity - header_->capacity / 8;
+        return published > keep ? published - keep : 0;
+    }
+
+    bool valid() const {
+        if (std::memcmp(header_->magic, "ABXS", 4) != 0 || header_->version != SHM_FEED_VERSION ||
+            header_->byte_order != SHM_FEED_BYTE_ORDER || header_->header_size != sizeof(ShmFeedHeader) ||
+            header_->slot_size != sizeof(ShmFeedSlot) || header_->capacity < 2 ||
+            (header_->capacity & (header_->capacity - 1)) != 0) {
+            return false;
+        }
+        if (header_->capacity > (length_ - sizeof(ShmFeedHeader)) / sizeof(ShmFeedSlot)) {
+            return false;
+        }
+        ShmFeedHeader expected;
+        abx_detail::describe_schema(expected);
+        return header_->packet_size == expected.packet_size && header_->field_count == expected.field_count &&
+               std::memcmp(header_->fields, expected.fields, sizeof(expected.fields)) == 0;
+    }
+
+    const ShmFeedHeader* header_;
+    const ShmFeedSlot* slots_;
+    size_t length_;
+    uint64_t mask_;
+    uint64_t next_;
+    uint64_t lost_;
+};
+
+#endif // ABX_SHM_FEED_H
@@ -0,0 +1,83 @@
+#ifndef ABX_SPSC_RING_H
+#define ABX_SPSC_RING_H
+
+#include <atomic>
+#include <vector>
+#include <cstddef>
+
+// SpscRing is a bounded single-producer / single-consumer queue with no locks.
+//
+// One thread pushes, one other thread pops, and neither ever waits on the other: each side owns one
+// index and only reads the other's. The indexes live on separate cache lines so the two threads
+// don't keep stealing the same line from each other, and each side caches the last value it saw of
+// the other's index so the shared line is only touched when the ring looks full (or empty).
+//
+// T should be cheap to copy; slots are reused, never destroyed, until the ring goes away.
+template <typename T>
+class SpscRing {
+public:
+    // Capacity gets rounded up to a power of two.
+    explicit SpscRing(size_t capacity)
+        : slots_(round_up_pow2(capacity < 2 ? 2 : capacity)),
+          mask_(slots_.size() - 1),
+          head_(0),
+          cached_tail_(0),
+          tail_(0),
+          cached_head_(0) {}
+
+    SpscRing(const SpscRing&) = delete;
+    SpscRing& operator=(const SpscRing&) = delete;
+
+    // Producer side. False if the ring is full.
+    bool try_push(const T& value) {
+        size_t tail = tail_.load(std::memory_order_relaxed);
+        if (tail - cached_head_ == slots_.size()) {
+            cached_head_ = head_.load(std::memory_order_acquire);
+            if (tail - cached_head_ == slots_.size()) {
+                return false;
+            }
+        }
+        slots_[tail & mask_] = value;
+        tail_.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer side. False if the ring is empty.
+    bool try_pop(T& value) {
+        size_t head = head_.load(std::memory_order_relaxed);
+        if (head == cached_tail_) {
+            cached_tail_ = tail_.load(std::memory_order_acquire);
+            if (head == cached_tail_) {
+                return false;
+            }
+        }
+        value = slots_[head & mask_];
+        head_.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Only a snapshot - the other side may be moving while you look.
+    bool empty() const { return head_.load(std::memory_order_acquire) == tail_.load(std::memory_order_acquire); }
+    size_t capacity() const { return slots_.size(); }
+
+private:
+    static size_t round_up_pow2(size_t value) {
+        size_t result = 1;
+        while (result < value) {
+            result <<= 1;
+        }
+        return result;
+    }
+
+    std::vector<T> slots_;
+    const size_t mask_;
+
+    // Consumer's line.
+    alignas(64) std::atomic<size_t> head_;
+    size_t cached_tail_;
+    // Producer's line.
+    alignas(64) std::atomic<size_t> tail_;
+    size_t cached_head_;
+};
+
+#endif // ABX_SPSC_RING_H
@@ -0,0 +1,241 @@
+#ifndef ABX_STREAM_SESSION_H
+#define ABX_STREAM_SESSION_H
+
+#include <functional>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>  // strerror
+#include <cerrno>
+
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <netinet/in.h>
+#include <unistd.h>
+
+#include "packet.h"
+#include "packet_framer.h"
+#include "packet_batch_decoder.h"
+#include "event_loop.h"
+#include "metrics.h"
+#include "logger.h"
+#include "completion_policy.h"
+
+// StreamSession is Stages 1-3 as a non-blocking state machine on the EventLoop: connect, send the
+// "Stream All Packets" request, then frame and decode whatever arrives until the server hangs up.
+//
+// Two deadlines replace the old SO_RCVTIMEO: one for the connect, and an idle deadline that's pushed
+// back every time data shows up. How long "idle" is comes from the CompletionPolicy, which learns it
+// from the gaps between bursts. Both live on the loop's timer wheel, so a stalled stream never
+// blocks anything else running on the same loop.
+class StreamSession {
+public:
+    enum Status { NotStarted, Connecting, Streaming, Completed, TimedOut, Failed };
+
+    // Called once per burst with every packet decoded from it.
+    typedef std::function<void(const DecodedBatch&)> BatchHandler;
+
+    StreamSession(EventLoop& loop, const sockaddr_in& server_addr, int connect_timeout_ms, CompletionPolicy& policy,
+                  BatchHandler on_batch)
+        : loop_(loop),
+          server_addr_(server_addr),
+          connect_timeout_ms_(connect_timeout_ms),
+          policy_(policy),
+          on_batch_(std::move(on_batch)),
+          metrics_(nullptr),
+          socket_(-1),
+          status_(NotStarted),
+          timer_(TimerWheel::INVALID_TIMER),
+          last_activity_ms_(0),
+          idle_due_ms_(0),
+          connect_started_ns_(0),
+          request_sent_ns_(0),
+          bytes_received_(0),
+          packets_received_(0) {}
+
+    ~StreamSession() { shut_down(status_); }
+
+    StreamSession(const StreamSession&) = delete;
+    StreamSession& operator=(const StreamSession&) = delete;
+
+    // Optional: where to record connect, first-byte and decode latencies.
+    void set_metrics(RunMetrics* metrics) { metrics_ = metrics; }
+
+    // Kicks off the connect. False (and status() == Failed) if we couldn't even get a socket going.
+    bool start() {
+        socket_ = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (socket_ == -1) {
+            log_error("Error creating initial socket! ", strerror(errno));
+            status_ = Failed;
+            return false;
+        }
+        connect_started_ns_ = monotonic_ns();
+        if (connect(socket_, reinterpret_cast<const sockaddr*>(&server_addr_), sizeof(server_addr_)) < 0 &&
+            errno != EINPROGRESS) {
+            log_error("Connection failed! ", strerror(errno));
+            shut_down(Failed);
+            return false;
+        }
+        status_ = Connecting;
+        // Registered for both directions up front; with edge triggering we'll hear about each once.
+        if (!loop_.add(socket_, EPOLLIN | EPOLLOUT | EPOLLRDHUP, [this](uint32_t events) { on_io(events); })) {
+            shut_down(Failed);
+            return false;
+        }
+        timer_ = loop_.run_after(static_cast<uint64_t>(connect_timeout_ms_), [this]() {
+            timer_ = TimerWheel::INVALID_TIMER;
+            log_error("Connection attempt timed out after ", connect_timeout_ms_, " ms.");
+            shut_down(TimedOut);
+        });
+        return true;
+    }
+
+    bool finished() const { return status_ == Completed || status_ == TimedOut || status_ == Failed; }
+    Status status() const { return status_; }
+    size_t bytes_received() const { return bytes_received_; }
+    size_t packets_received() const { return packets_received_; }
+
+private:
+    void on_io(uint32_t events) {
+        if (status_ == Connecting) {
+            if (!(events & (EPOLLOUT | EPOLLERR | EPOLLHUP))) {
+                return;
+            }
+            int error = 0;
+            socklen_t length = sizeof(error);
+            if (getsockopt(socket_, SOL_SOCKET, SO_ERROR, &error, &length) < 0 || error != 0) {
+                log_error("Connection failed! ", strerror(error != 0 ? error : errno));
+                shut_down(Failed);
+                return;
+            }
+            if (metrics_ != nullptr) {
+                metrics_->connect.record(monotonic_ns() - connect_started_ns_);
+            }
+            policy_.on_connect_rtt(monotonic_ns() - connect_started_ns_);
+            log_info("Successfully connected for the initial stream!");
+            if (!send_request()) {
+                return;
+            }
+            status_ = Streaming;
+            loop_.cancel(timer_);
+            last_activity_ms_ = loop_.now_ms();
+            arm_idle_timer(policy_.idle_timeout_ms());
+            // Data may already be waiting - and with edge triggering nobody will tell us again.
+        }
+        if (status_ == Streaming) {
+            drain();
+        }
+    }
+
+    // The spec says the request is just 1 byte with value 1 (Stream All Packets).
+    bool send_request() {
+        unsigned char request_payload = 1;
+        ssize_t bytes_sent = send(socket_, &request_payload, 1, MSG_NOSIGNAL);
+        if (bytes_sent != 1) {
+            log_error("Error sending 'Stream All Packets' request! ",
+                      (bytes_sent == -1 ? strerror(errno) : "short send"));
+            shut_down(Failed);
+            return false;
+        }
+        request_sent_ns_ = monotonic_ns();
+        log_info("Sent 'Stream All Packets' request (1 byte).");
+        return true;
+    }
+
+    // Edge-triggered, so keep reading until the kernel has nothing more for us.
+    void drain() {
+        while (true) {
+            ssize_t bytes_read = framer_.receive(socket_);
+            if (bytes_read > 0) {
+                uint64_t decode_started_ns = metrics_ != nullptr ? monotonic_ns() : 0;
+                if (bytes_received_ == 0 && metrics_ != nullptr) {
+                    metrics_->first_byte.record(decode_started_ns - request_sent_ns_);
+                }
+                bytes_received_ += static_cast<size_t>(bytes_read);
+                last_activity_ms_ = loop_.now_ms();
+                policy_.on_stream_data();
+                if (last_activity_ms_ + policy_.idle_timeout_ms() < idle_due_ms_) {
+                    // The policy just tightened the idle limit; don't sit out the old, longer timer.
+                    loop_.cancel(timer_);
+                    arm_idle_timer(policy_.idle_timeout_ms());
+                }
+                size_t packet_count = framer_.complete_packets();
+                if (packet_count > 0) {
+                    decode_packets(framer_.packets(), packet_count, decoded_);
+                    framer_.consume(packet_count);
+                    packets_received_ += packet_count;
+                    if (metrics_ != nullptr) {
+                        metrics_->decode.record((monotonic_ns() - decode_started_ns) / packet_count, packet_count);
+                    }
+                    on_batch_(decoded_);
+                }
+            } else if (bytes_read == 0) {
+                // recv returning 0 means the server closed the connection gracefully.
+                log_info("Server closed the initial connection gracefully.");
+                if (framer_.pending_bytes() > 0) {
+                    log_warn("Warning: ", framer_.pending_bytes(),
+                             " trailing bytes didn't make up a whole packet, ignoring them.");
+                }
+                shut_down(Completed);
+                return;
+            } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                return; // All caught up - wait for the next edge
+            } else if (errno != EINTR) {
+                log_error("A non-timeout error occurred during initial receiving: ", strerror(errno));
+                // We'll proceed with the data received up to this point.
+                shut_down(Failed);
+                return;
+            }
+        }
+    }
+
+    // Rather than re-arming a timer on every recv(), the timer checks when we last heard from the
+    // server and only gives up once a full idle period has really passed.
+    void arm_idle_timer(uint64_t delay_ms) {
+        idle_due_ms_ = loop_.now_ms() + delay_ms;
+        timer_ = loop_.run_after(delay_ms, [this]() {
+            timer_ = TimerWheel::INVALID_TIMER;
+            uint64_t idle_for = loop_.now_ms() - last_activity_ms_;
+            uint64_t limit = policy_.idle_timeout_ms(); // Can shrink as the policy learns the stream's rhythm
+            if (idle_for < limit) {
+                arm_idle_timer(limit - idle_for);
+                return;
+            }
+            log_error("Receive timeout reached for initial data stream (quiet for ", idle_for,
+                      " ms). Proceeding with received data.");
+            shut_down(TimedOut);
+        });
+    }
+
+    void shut_down(Status final_status) {
+        loop_.cancel(timer_);
+        timer_ = TimerWheel::INVALID_TIMER;
+        if (socket_ != -1) {
+            loop_.remove(socket_);
+            close(socket_);
+            socket_ = -1;
+        }
+        status_ = final_status;
+    }
+
+    EventLoop& loop_;
+    sockaddr_in server_addr_;
+    int connect_timeout_ms_;
+    CompletionPolicy& policy_;
+    BatchHandler on_batch_;
+    RunMetrics* metrics_;
+
+    int socket_;
+    Status status_;
+    TimerWheel::TimerId timer_;
+    uint64_t last_activity_ms_;
+    uint64_t idle_due_ms_;     // When the idle timer is next going to check
+    uint64_t connect_started_ns_;
+    uint64_t request_sent_ns_;
+
+    PacketFramer framer_;
+    DecodedBatch decoded_; // Reused for every burst so decoding doesn't allocate once warmed up
+    size_t bytes_received_;
+    size_t packets_received_;
+};
+
+#endif // ABX_STREAM_SESSION_H
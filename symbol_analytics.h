@@ -0,0 +1,82 @@
+#ifndef ABX_SYMBOL_ANALYTICS_H
+#define ABX_SYMBOL_ANALYTICS_H
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <iomanip>
+#include <cstddef>
+#include <cstdint>
+
+#include "packet.h"
+#include "symbol_table.h"
+
+// Running totals for one symbol.
+struct SymbolStats {
+    size_t packets = 0;
+    int64_t buy_quantity = 0;
+    int64_t sell_quantity = 0;
+    int64_t total_quantity = 0;   // Buys, sells, and anything with some other side
+    int64_t notional = 0;         // Sum of price x quantity; int64 is plenty for any feed this size
+    int32_t high = 0;
+    int32_t low = 0;
+
+    // Volume-weighted average price, 0 with no volume yet.
+    double vwap() const { return total_quantity != 0 ? static_cast<double>(notional) / total_quantity : 0.0; }
+};
+
+// SymbolAnalytics accumulates per-symbol VWAP, volume and price range in the same pass that writes
+// output.json, so none of it needs a second read of the file.
+//
+// Accumulators live in a plain array indexed by the SymbolTable's dense ids. The id is looked up per
+// packet: a short scan for the handful of symbols a feed usually has, a flat-table probe past that
+// (see SymbolTable::intern).
+class SymbolAnalytics {
+public:
+    void add(const Packet& packet) {
+        uint32_t id = symbols_.intern(packet.symbol);
+        if (id >= stats_.size()) {
+            stats_.resize(id + 1);
+        }
+        SymbolStats& s = stats_[id];
+        if (s.packets == 0 || packet.price > s.high) s.high = packet.price;
+        if (s.packets == 0 || packet.price < s.low) s.low = packet.price;
+        ++s.packets;
+        if (packet.buysell_indicator == 'B') {
+            s.buy_quantity += packet.quantity;
+        } else if (packet.buysell_indicator == 'S') {
+            s.sell_quantity += packet.quantity;
+        }
+        s.total_quantity += packet.quantity;
+        s.notional += static_cast<int64_t>(packet.price) * packet.quantity;
+    }
+
+    size_t symbol_count() const { return stats_.size(); }
+    const SymbolStats& stats(uint32_t id) const { return stats_[id]; }
+    const std::string& symbol_name(uint32_t id) const { return symbols_.name_of(id); }
+
+    // Summary as a JSON array, one object per symbol in order of first appearance. False if the file
+    // couldn't be written.
+    bool write_json(const std::string& path) const {
+        std::ofstream file(path);
+        if (!file.is_open()) {
+            return false;
+        }
+        file << "[";
+        for (uint32_t id = 0; id < stats_.size(); ++id) {
+            const SymbolStats& s = stats_[id];
+            file << (id == 0 ? "\n" : ",\n") << "    {\"symbol\": \"" << symbols_.name_of(id) << "\", \"packets\": "
+                 << s.packets << ", \"buy_quantity\": " << s.buy_quantity << ", \"sell_quantity\": " << s.sell_quantity
+                 << ", \"total_quantity\": " << s.total_quantity << ", \"vwap\": " << std::fixed
+                 << std::setprecision(4) << s.vwap() << ", \"high\": " << s.high << ", \"low\": " << s.low << "}";
+        }
+        file << (stats_.empty() ? "]\n" : "\n]\n");
+        return static_cast<bool>(file);
+    }
+
+private:
+    SymbolTable symbols_;
+    std::vector<SymbolStats> stats_;   // By symbol id
+};
+
+#endif // ABX_SYMBOL_ANALYTICS_H
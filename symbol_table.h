@@ -0,0 +1,130 @@
+#ifndef ABX_SYMBOL_TABLE_H
+#define ABX_SYMBOL_TABLE_H
+
+#include <string>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+#include "packet.h"
+
+// SymbolTable interns the raw 4-byte symbol codes from Packet::symbol.
+//
+// A feed only ever has a handful of distinct symbols, so instead of trimming the same four bytes for
+// every packet we do it once per symbol and hand out a small dense id (0, 1, 2... in order of first
+// appearance). Those ids are good array indexes for anything that keeps per-symbol state.
+//
+// Every consumer (JSON writer, analytics, order book, columnar file) keeps its own table and looks the
+// code up per packet; ids aren't resolved once at decode and carried along, because that would need one
+// table shared by the decoders and everything downstream. The lookup is kept cheap instead: a repeat
+// of the last symbol is one compare, a small table is a scan, and past that it's one multiply and
+// usually one probe into a flat open-addressed array, no allocation and no pointer chasing.
+class SymbolTable {
+public:
+    SymbolTable() : slots_(MIN_SLOTS, 0), slot_shift_(32 - MIN_SLOT_BITS), last_code_(0), last_id_(NO_ID) {}
+
+    // Dense id for `code`, adding it if we haven't seen it before.
+    uint32_t intern(uint32_t code) {
+        // Feeds tend to repeat the same symbol a few times in a row, skip the lookup when they do.
+        if (last_id_ != NO_ID && code == last_code_) {
+            return last_id_;
+        }
+        uint32_t id = NO_ID;
+        if (codes_.size() <= LINEAR_SCAN_LIMIT) {
+            // A few symbols fit in a cache line or two; comparing them all beats even a cheap hash.
+            for (size_t i = 0; i < codes_.size(); ++i) {
+                if (codes_[i] == code) {
+                    id = static_cast<uint32_t>(i);
+                    break;
+                }
+            }
+        } else {
+            id = find(code);
+        }
+        if (id == NO_ID) {
+            id = static_cast<uint32_t>(codes_.size());
+            codes_.push_back(code);
+            names_.push_back(trim(code));
+            if (codes_.size() * 2 > slots_.size()) {
+                rehash(slots_.size() * 2);
+            } else {
+                place(code, id);
+            }
+        }
+        last_code_ = code;
+        last_id_ = id;
+        return id;
+    }
+
+    // Trimmed name for a symbol code ("IBM " -> "IBM").
+    const std::string& name(uint32_t code) { return names_[intern(code)]; }
+
+    // Lookups by id, for ids this table handed out.
+    const std::string& name_of(uint32_t id) const { return names_[id]; }
+    uint32_t code_of(uint32_t id) const { return codes_[id]; }
+
+    size_t size() const { return codes_.size(); }
+
+private:
+    static const uint32_t NO_ID = 0xFFFFFFFFu;
+    // Up to this many symbols, intern() scans codes_ instead of probing slots_.
+    static const size_t LINEAR_SCAN_LIMIT = 16;
+    static const unsigned MIN_SLOT_BITS = 6;
+    static const size_t MIN_SLOTS = size_t(1) << MIN_SLOT_BITS;
+
+    // Fibonacci hashing: the top bits of code x 2^32/phi, so codes differing only in their last letter
+    // still land far apart.
+    size_t slot_of(uint32_t code) const { return static_cast<uint32_t>(code * 2654435769u) >> slot_shift_; }
+
+    // Each slot is code << 32 | (id + 1); 0 is empty (code 0 is a valid symbol, id + 1 never is 0).
+    uint32_t find(uint32_t code) const {
+        size_t mask = slots_.size() - 1;
+        for (size_t i = slot_of(code);; i = (i + 1) & mask) {
+            uint64_t slot = slots_[i];
+            if (slot == 0) {
+                return NO_ID;
+            }
+            if (static_cast<uint32_t>(slot >> 32) == code) {
+                return static_cast<uint32_t>(slot) - 1;
+            }
+        }
+    }
+
+    void place(uint32_t code, uint32_t id) {
+        size_t mask = slots_.size() - 1;
+        size_t i = slot_of(code);
+        while (slots_[i] != 0) {
+            i = (i + 1) & mask;
+        }
+        slots_[i] = (static_cast<uint64_t>(code) << 32) | (static_cast<uint64_t>(id) + 1);
+    }
+
+    // Kept at most half full so probes stay short.
+    void rehash(size_t slot_count) {
+        slots_.assign(slot_count, 0);
+        --slot_shift_;
+        for (size_t id = 0; id < codes_.size(); ++id) {
+            place(codes_[id], static_cast<uint32_t>(id));
+        }
+    }
+
+    // Trailing spaces come off. NULs stay: the old Stage 6 trim (find_last_not_of(" \0")) only ever
+    // matched the space, and output.json has to stay byte-for-byte the same.
+    static std::string trim(uint32_t code) {
+        const char* bytes = reinterpret_cast<const char*>(&code);
+        size_t length = 4;
+        while (length > 0 && bytes[length - 1] == ' ') {
+            --length;
+        }
+        return std::string(bytes, length);
+    }
+
+    std::vector<uint32_t> codes_;
+    std::vector<std::string> names_;
+    std::vector<uint64_t> slots_;   // Power-of-two size, code -> id
+    unsigned slot_shift_;           // 32 - log2(slots_.size())
+    uint32_t last_code_;
+    uint32_t last_id_;
+};
+
+#endif // ABX_SYMBOL_TABLE_H
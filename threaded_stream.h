@@ -0,0 +1,393 @@
+#ifndef ABX_THREADED_STREAM_H
+#define ABX_THREADED_STREAM_H
+
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <functional>
+#include <string>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>  // strerror
+#include <cerrno>
+
+#include <pthread.h>
+#include <sched.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <unistd.h>
+
+#include "packet.h"
+#include "packet_framer.h"
+#include "packet_batch_decoder.h"
+#include "stream_session.h" // StreamSession::Status
+#include "spsc_ring.h"
+#include "metrics.h"
+#include "logger.h"
+#include "completion_policy.h"
+
+// ThreadedStream is Stages 1-3 split over three threads, so a slow consumer never holds up the socket:
+//
+//   network --(filled chunks)--> decode --(final packets)--> output
+//      ^                            |
+//      +-------(empty chunks)-------+
+//
+// - The network thread only connects, sends the request and recv()s into fixed-size chunks. It waits
+//   in poll() with the CompletionPolicy's idle timeout, so it decides when the stream is over.
+// - The decode thread frames each chunk (PacketFramer::frame_chunk, no copying except for a packet
+//   split across two chunks), decodes the packets in batches and hands them to the batch handler,
+//   which files them in the store. Packets that are final go on to the output thread via publish().
+// - The output thread hands them to the output handler (the JSON writer, say) in runs.
+//
+// Rings are SpscRings, one producer and one consumer each. Backpressure is just the rings filling
+// up: the network thread runs out of empty chunks and stops reading (so TCP flow control slows the
+// server down), and publish() waits for room on the output ring. Waiting spins briefly, then yields,
+// then naps, since the other side is usually only a moment behind.
+//
+// Everything runs inside run() and every thread has been joined when it returns, so the handlers
+// can use the caller's state without locks as long as nothing else touches it meanwhile: the batch
+// handler is only ever called on the decode thread and the output handler on the output thread.
+class ThreadedStream {
+public:
+    struct Config {
+        size_t chunk_size = 64 * 1024;     // Bytes per recv()
+        size_t chunk_count = 64;           // Chunks in flight between network and decode
+        size_t output_capacity = 1 << 16;  // Packets queued for the output thread
+        // CPU to pin each thread to, -1 to leave it to the scheduler.
+        int network_cpu = -1;
+        int decode_cpu = -1;
+        int output_cpu = -1;
+    };
+
+    struct StreamResult {
+        StreamSession::Status status = StreamSession::NotStarted;
+        size_t bytes_received = 0;
+        size_t packets_received = 0;
+    };
+
+    // Decode thread: every packet decoded from one chunk.
+    typedef std::function<void(const DecodedBatch&)> BatchHandler;
+    // Output thread: a run of published packets. `caught_up` is true when nothing else is queued
+    // behind them, i.e. a good moment to flush.
+    typedef std::function<void(const Packet*, size_t, bool caught_up)> OutputHandler;
+
+    ThreadedStream(const sockaddr_in& server_addr, int connect_timeout_ms, CompletionPolicy& policy,
+                   const Config& config)
+        : server_addr_(server_addr),
+          connect_timeout_ms_(connect_timeout_ms),
+          policy_(policy),
+          config_(config),
+          metrics_(nullptr),
+          request_sent_ns_(0),
+          storage_(config.chunk_size * config.chunk_count),
+          empty_chunks_(config.chunk_count),
+          full_chunks_(config.chunk_count),
+          output_(config.output_capacity),
+          decode_done_(false) {}
+
+    ThreadedStream(const ThreadedStream&) = delete;
+    ThreadedStream& operator=(const ThreadedStream&) = delete;
+
+    // Optional: where to record connect, first-byte and decode latencies. Each histogram is only
+    // written from one thread.
+    void set_metrics(RunMetrics* metrics) { metrics_ = metrics; }
+
+    // Runs the whole stream and returns once all three threads are done.
+    StreamResult run(BatchHandler on_batch, OutputHandler on_output) {
+        result_ = StreamResult();
+        decode_done_.store(false, std::memory_order_relaxed);
+        for (uint32_t chunk = 0; chunk < config_.chunk_count; ++chunk) {
+            empty_chunks_.try_push(chunk);
+        }
+
+        std::thread output([this, &on_output]() { output_loop(on_output); });
+        std::thread decode([this, &on_batch]() { decode_loop(on_batch); });
+        std::thread network([this]() { network_loop(); });
+        pin(output, config_.output_cpu, "output");
+        pin(decode, config_.decode_cpu, "decode");
+        pin(network, config_.network_cpu, "network");
+        network.join();
+        decode.join();
+        output.join();
+        return result_;
+    }
+
+    // Decode thread only (from inside the batch handler): queues a final packet for the output
+    // thread, waiting for room if it's behind.
+    void publish(const Packet& packet) {
+        Backoff backoff;
+        while (!output_.try_push(packet)) {
+            backoff.pause();
+        }
+    }
+
+private:
+    static const uint32_t END_OF_STREAM = 0xFFFFFFFFu;
+    static const size_t OUTPUT_RUN = 256;
+
+    struct Chunk {
+        uint32_t index;   // END_OF_STREAM after the last one
+        uint32_t size;
+    };
+
+    class Backoff {
+    public:
+        Backoff() : rounds_(0) {}
+        void pause() {
+            if (rounds_ < 64) {
+#if defined(__x86_64__) || defined(__i386__)
+                __builtin_ia32_pause();
+#endif
+            } else if (rounds_ < 128) {
+                std::this_thread::yield();
+            } else {
+                std::this_thread::sleep_for(std::chrono::microseconds(50));
+            }
+            ++rounds_;
+        }
+
+    private:
+        unsigned rounds_;
+    };
+
+    char* chunk_data(uint32_t index) { return storage_.data() + static_cast<size_t>(index) * config_.chunk_size; }
+
+    static void pin(std::thread& thread, int cpu, const char* name) {
+        if (cpu < 0) {
+            return;
+        }
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        int error = pthread_setaffinity_np(thread.native_handle(), sizeof(set), &set);
+        if (error != 0) {
+            log_warn("Couldn't pin the ", name, " thread to CPU ", cpu, ": ", strerror(error));
+        }
+    }
+
+    // --- Network thread ---
+
+    void network_loop() {
+        int fd = connect_to_server();
+        if (fd != -1) {
+            receive(fd);
+            close(fd);
+        }
+        Backoff backoff;
+        while (!full_chunks_.try_push(Chunk{END_OF_STREAM, 0})) {
+            backoff.pause();
+        }
+    }
+
+    int connect_to_server() {
+        int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (fd == -1) {
+            log_error("Error creating initial socket! ", strerror(errno));
+            result_.status = StreamSession::Failed;
+            return -1;
+        }
+        uint64_t started_ns = monotonic_ns();
+        result_.status = StreamSession::Connecting;
+        if (connect(fd, reinterpret_cast<const sockaddr*>(&server_addr_), sizeof(server_addr_)) < 0) {
+            if (errno != EINPROGRESS) {
+                log_error("Connection failed! ", strerror(errno));
+                return give_up(fd, StreamSession::Failed);
+            }
+            pollfd waiting = {fd, POLLOUT, 0};
+            int ready = poll_retrying(waiting, connect_timeout_ms_);
+            if (ready == 0) {
+                log_error("Connection attempt timed out after ", connect_timeout_ms_, " ms.");
+                return give_up(fd, StreamSession::TimedOut);
+            }
+            int error = 0;
+            socklen_t length = sizeof(error);
+            if (ready < 0 || getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &length) < 0 || error != 0) {
+                log_error("Connection failed! ", strerror(error != 0 ? error : errno));
+                return give_up(fd, StreamSession::Failed);
+            }
+        }
+        if (metrics_ != nullptr) {
+            metrics_->connect.record(monotonic_ns() - started_ns);
+        }
+        policy_.on_connect_rtt(monotonic_ns() - started_ns);
+        log_info("Successfully connected for the initial stream!");
+
+        // The spec says the request is just 1 byte with value 1 (Stream All Packets).
+        unsigned char request_payload = 1;
+        ssize_t bytes_sent = send(fd, &request_payload, 1, MSG_NOSIGNAL);
+        if (bytes_sent != 1) {
+            log_error("Error sending 'Stream All Packets' request! ",
+                      (bytes_sent == -1 ? strerror(errno) : "short send"));
+            return give_up(fd, StreamSession::Failed);
+        }
+        request_sent_ns_ = monotonic_ns();
+        log_info("Sent 'Stream All Packets' request (1 byte).");
+        result_.status = StreamSession::Streaming;
+        return fd;
+    }
+
+    int give_up(int fd, StreamSession::Status status) {
+        close(fd);
+        result_.status = status;
+        return -1;
+    }
+
+    static int poll_retrying(pollfd& waiting, uint64_t timeout_ms) {
+        while (true) {
+            int ready = poll(&waiting, 1, static_cast<int>(timeout_ms));
+            if (ready >= 0 || errno != EINTR) {
+                return ready;
+            }
+        }
+    }
+
+    void receive(int fd) {
+        uint64_t last_activity_ns = monotonic_ns();
+        Backoff backoff;
+        while (true) {
+            uint32_t chunk;
+            if (!empty_chunks_.try_pop(chunk)) {
+                // Decode is behind: stop reading and let the socket buffer (and then TCP) hold the rest.
+                backoff.pause();
+                last_activity_ns = monotonic_ns(); // Our stall, not the server's
+                continue;
+            }
+            backoff = Backoff();
+
+            ssize_t bytes_read = receive_chunk(fd, chunk_data(chunk), last_activity_ns);
+            if (bytes_read > 0) {
+                if (result_.bytes_received == 0 && metrics_ != nullptr) {
+                    metrics_->first_byte.record(monotonic_ns() - request_sent_ns_);
+                }
+                result_.bytes_received += static_cast<size_t>(bytes_read);
+                last_activity_ns = monotonic_ns();
+                policy_.on_stream_data();
+                // Never full: there are only chunk_count chunks, and this one was just taken out.
+                full_chunks_.try_push(Chunk{chunk, static_cast<uint32_t>(bytes_read)});
+                continue;
+            }
+            // The unused chunk isn't handed back: the decode thread is empty_chunks_'s only producer,
+            // and nothing pops it again once we return.
+            if (bytes_read == 0) {
+                // recv returning 0 means the server closed the connection gracefully.
+                log_info("Server closed the initial connection gracefully.");
+                result_.status = StreamSession::Completed;
+            } else if (errno == ETIMEDOUT) {
+                log_error("Receive timeout reached for initial data stream (quiet for ",
+                          (monotonic_ns() - last_activity_ns) / 1000000, " ms). Proceeding with received data.");
+                result_.status = StreamSession::TimedOut;
+            } else {
+                log_error("A non-timeout error occurred during initial receiving: ", strerror(errno));
+                // We'll proceed with the data received up to this point.
+                result_.status = StreamSession::Failed;
+            }
+            return;
+        }
+    }
+
+    // recv() into `data`, waiting for more as long as the policy doesn't call the stream idle. Returns
+    // what recv() returned, or -1 with errno set to ETIMEDOUT once it's been quiet for too long.
+    ssize_t receive_chunk(int fd, char* data, uint64_t last_activity_ns) {
+        while (true) {
+            ssize_t bytes_read = recv(fd, data, config_.chunk_size, 0);
+            if (bytes_read >= 0) {
+                return bytes_read;
+            }
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                return -1;
+            }
+            uint64_t quiet_ms = (monotonic_ns() - last_activity_ns) / 1000000;
+            uint64_t limit_ms = policy_.idle_timeout_ms(); // Can shrink as the policy learns the stream's rhythm
+            if (quiet_ms >= limit_ms) {
+                errno = ETIMEDOUT;
+                return -1;
+            }
+            pollfd waiting = {fd, POLLIN, 0};
+            if (poll_retrying(waiting, limit_ms - quiet_ms) < 0) {
+                return -1;
+            }
+        }
+    }
+
+    // --- Decode thread ---
+
+    void decode_loop(const BatchHandler& on_batch) {
+        PacketFramer framer;
+        DecodedBatch decoded; // Reused for every chunk so decoding doesn't allocate once warmed up
+        size_t packets_received = 0;
+        Backoff backoff;
+        while (true) {
+            Chunk chunk;
+            if (!full_chunks_.try_pop(chunk)) {
+                backoff.pause();
+                continue;
+            }
+            backoff = Backoff();
+            if (chunk.index == END_OF_STREAM) {
+                break;
+            }
+            framer.frame_chunk(chunk_data(chunk.index), chunk.size, [&](const unsigned char* packets, size_t count) {
+                uint64_t decode_started_ns = metrics_ != nullptr ? monotonic_ns() : 0;
+                decode_packets(packets, count, decoded);
+                if (metrics_ != nullptr) {
+                    metrics_->decode.record((monotonic_ns() - decode_started_ns) / count, count);
+                }
+                packets_received += count;
+                on_batch(decoded);
+            });
+            empty_chunks_.try_push(chunk.index); // Room for all of them, always
+        }
+        if (framer.pending_bytes() > 0) {
+            log_warn("Warning: ", framer.pending_bytes(), " trailing bytes didn't make up a whole packet, ignoring them.");
+        }
+        result_.packets_received = packets_received; // Network thread is done with result_ by now
+        decode_done_.store(true, std::memory_order_release);
+    }
+
+    // --- Output thread ---
+
+    void output_loop(const OutputHandler& on_output) {
+        Packet run[OUTPUT_RUN];
+        Backoff backoff;
+        while (true) {
+            size_t count = 0;
+            while (count < OUTPUT_RUN && output_.try_pop(run[count])) {
+                ++count;
+            }
+            if (count > 0) {
+                backoff = Backoff();
+                on_output(run, count, count < OUTPUT_RUN);
+                continue;
+            }
+            // Decode finishing is only final once the ring has been checked again afterwards.
+            if (decode_done_.load(std::memory_order_acquire)) {
+                if (output_.empty()) {
+                    return;
+                }
+                continue;
+            }
+            backoff.pause();
+        }
+    }
+
+    sockaddr_in server_addr_;
+    int connect_timeout_ms_;
+    CompletionPolicy& policy_;   // Network thread only while running
+    Config config_;
+    RunMetrics* metrics_;
+    uint64_t request_sent_ns_;
+
+    std::vector<char> storage_;        // chunk_count chunks of chunk_size bytes
+    SpscRing<uint32_t> empty_chunks_;  // decode -> network
+    SpscRing<Chunk> full_chunks_;      // network -> decode
+    SpscRing<Packet> output_;          // decode -> output
+    std::atomic<bool> decode_done_;
+    StreamResult result_;
+};
+
+#endif // ABX_THREADED_STREAM_H
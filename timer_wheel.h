@@ -0,0 +1,141 @@
+#ifndef ABX_TIMER_WHEEL_H
+#define ABX_TIMER_WHEEL_H
+
+#include <vector>
+#include <functional>
+#include <cstddef>
+#include <cstdint>
+
+// TimerWheel holds all the "give up on this socket at time T" deadlines for the event loop.
+//
+// It's a hashed timing wheel with 1 ms ticks: a timer due at tick T lives in slot T % WHEEL_SIZE,
+// so scheduling and cancelling are O(1) no matter how many connections are in flight. Timers further
+// out than one revolution just sit in their slot until the wheel comes around to the right lap.
+// Timer records are pooled and reused, so steady state doesn't allocate (beyond the callback itself).
+class TimerWheel {
+public:
+    typedef uint64_t TimerId;
+    static const TimerId INVALID_TIMER = 0;
+
+    explicit TimerWheel(uint64_t now_ms = 0) : slots_(WHEEL_SIZE), current_tick_(now_ms), active_count_(0) {}
+
+    // Runs `callback` from advance() once the clock reaches `expires_ms`. Times already in the past go
+    // in the first tick the wheel hasn't processed yet, so they fire on the next advance() - or later
+    // in this one, when scheduled from a callback and the clock is already past that tick.
+    TimerId schedule(uint64_t expires_ms, std::function<void()> callback) {
+        if (expires_ms < current_tick_) {
+            expires_ms = current_tick_;
+        }
+        uint32_t index;
+        if (!free_.empty()) {
+            index = free_.back();
+            free_.pop_back();
+        } else {
+            index = static_cast<uint32_t>(timers_.size());
+            timers_.push_back(Timer());
+        }
+        Timer& timer = timers_[index];
+        timer.expires = expires_ms;
+        timer.active = true;
+        ++timer.generation; // Old ids pointing at this record stop matching
+        timer.callback = std::move(callback);
+        slots_[expires_ms & (WHEEL_SIZE - 1)].push_back(index);
+        ++active_count_;
+        return (static_cast<uint64_t>(timer.generation) << 32) | index;
+    }
+
+    // Safe to call with stale ids or INVALID_TIMER - it just does nothing.
+    void cancel(TimerId id) {
+        uint32_t index = static_cast<uint32_t>(id & 0xffffffffu);
+        uint32_t generation = static_cast<uint32_t>(id >> 32);
+        if (id == INVALID_TIMER || index >= timers_.size()) {
+            return;
+        }
+        Timer& timer = timers_[index];
+        if (timer.active && timer.generation == generation) {
+            timer.active = false;
+            timer.callback = nullptr;
+            --active_count_;
+            // The record stays in its slot list until the wheel passes it, then gets recycled.
+        }
+    }
+
+    // Fires every timer due at or before `now_ms`.
+    void advance(uint64_t now_ms) {
+        if (now_ms < current_tick_) {
+            return;
+        }
+        // Past one full revolution every slot needs a visit exactly once: the last lap's worth of ticks.
+        if (now_ms - current_tick_ >= WHEEL_SIZE) {
+            current_tick_ = now_ms + 1 - WHEEL_SIZE;
+        }
+        while (current_tick_ <= now_ms) {
+            std::vector<uint32_t>& slot = slots_[current_tick_ & (WHEEL_SIZE - 1)];
+            // Marked processed before its callbacks run, so anything they schedule for "now" lands in
+            // the next tick rather than this slot, which the wheel won't be back to for a whole lap.
+            ++current_tick_;
+            if (slot.empty()) {
+                continue;
+            }
+            // Callbacks may schedule new timers into this very slot, so work on a private copy.
+            std::vector<uint32_t> due;
+            due.swap(slot);
+            for (uint32_t index : due) {
+                Timer& timer = timers_[index];
+                if (!timer.active) {
+                    recycle(index);
+                } else if (timer.expires <= now_ms) {
+                    std::function<void()> callback = std::move(timer.callback);
+                    timer.active = false;
+                    --active_count_;
+                    recycle(index);
+                    callback();
+                } else {
+                    slot.push_back(index); // Due on a later lap
+                }
+            }
+        }
+    }
+
+    // Milliseconds until the next timer is due (0 if one is already due), or -1 if there are none.
+    int64_t next_timeout_ms(uint64_t now_ms) const {
+        if (active_count_ == 0) {
+            return -1;
+        }
+        for (uint64_t t = current_tick_; t < current_tick_ + WHEEL_SIZE; ++t) {
+            const std::vector<uint32_t>& slot = slots_[t & (WHEEL_SIZE - 1)];
+            for (uint32_t index : slot) {
+                const Timer& timer = timers_[index];
+                if (timer.active && timer.expires <= t) {
+                    return t > now_ms ? static_cast<int64_t>(t - now_ms) : 0;
+                }
+            }
+        }
+        // Nothing within a lap - check back after one.
+        return static_cast<int64_t>(current_tick_ + WHEEL_SIZE - now_ms);
+    }
+
+    size_t pending() const { return active_count_; }
+
+private:
+    static const uint64_t WHEEL_SIZE = 1024; // Must be a power of two
+
+    struct Timer {
+        uint64_t expires = 0;
+        uint32_t generation = 0;
+        bool active = false;
+        std::function<void()> callback;
+    };
+
+    void recycle(uint32_t index) {
+        free_.push_back(index);
+    }
+
+    std::vector<Timer> timers_;
+    std::vector<uint32_t> free_;
+    std::vector<std::vector<uint32_t>> slots_;
+    uint64_t current_tick_; // Next tick that hasn't been processed yet
+    size_t active_count_;
+};
+
+#endif // ABX_TIMER_WHEEL_H